@@ -98,28 +98,29 @@ namespace acmacs::seqdb::inline v3
 
     // ======================================================================
 
-    inline bool matches(sequence_aligned_ref_t seq, const nucleotide_at_pos1_list_t& nuc_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
+    // Seq: sequence_aligned_ref_t, packed_sequences_t::sequence_t
+    template <typename Seq> inline bool matches(const Seq& seq, const nucleotide_at_pos1_list_t& nuc_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
     {
         return std::all_of(std::begin(nuc_at_pos1), std::end(nuc_at_pos1),
-                           [seq](const nucleotide_at_pos1_t& pos1_nuc) { return at_pos(seq, std::get<pos1_t>(pos1_nuc)) == std::get<char>(pos1_nuc); });
+                           [&seq](const nucleotide_at_pos1_t& pos1_nuc) { return at_pos(seq, std::get<pos1_t>(pos1_nuc)) == std::get<char>(pos1_nuc); });
     }
 
-    inline bool matches(sequence_aligned_ref_t seq, const nucleotide_at_pos1_eq_list_t& nuc_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
+    template <typename Seq> inline bool matches(const Seq& seq, const nucleotide_at_pos1_eq_list_t& nuc_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
     {
         return std::all_of(std::begin(nuc_at_pos1), std::end(nuc_at_pos1),
-                           [seq](const nucleotide_at_pos1_eq_t& pos1_nuc) { return (at_pos(seq, std::get<pos1_t>(pos1_nuc)) == std::get<char>(pos1_nuc)) == std::get<bool>(pos1_nuc); });
+                           [&seq](const nucleotide_at_pos1_eq_t& pos1_nuc) { return (at_pos(seq, std::get<pos1_t>(pos1_nuc)) == std::get<char>(pos1_nuc)) == std::get<bool>(pos1_nuc); });
     }
 
-    inline bool matches(sequence_aligned_ref_t seq, const amino_acid_at_pos1_list_t& aa_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
+    template <typename Seq> inline bool matches(const Seq& seq, const amino_acid_at_pos1_list_t& aa_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
     {
         return std::all_of(std::begin(aa_at_pos1), std::end(aa_at_pos1),
-                           [seq](const amino_acid_at_pos1_t& pos1_aa) { return at_pos(seq, std::get<pos1_t>(pos1_aa)) == std::get<char>(pos1_aa); });
+                           [&seq](const amino_acid_at_pos1_t& pos1_aa) { return at_pos(seq, std::get<pos1_t>(pos1_aa)) == std::get<char>(pos1_aa); });
     }
 
-    inline bool matches(sequence_aligned_ref_t seq, const amino_acid_at_pos1_eq_list_t& aa_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
+    template <typename Seq> inline bool matches(const Seq& seq, const amino_acid_at_pos1_eq_list_t& aa_at_pos1) // all_of is not constexpr until c++20 (g++9.1)
     {
         return std::all_of(std::begin(aa_at_pos1), std::end(aa_at_pos1),
-                           [seq](const amino_acid_at_pos1_eq_t& pos1_aa) { return (at_pos(seq, std::get<pos1_t>(pos1_aa)) == std::get<char>(pos1_aa)) == std::get<bool>(pos1_aa); });
+                           [&seq](const amino_acid_at_pos1_eq_t& pos1_aa) { return (at_pos(seq, std::get<pos1_t>(pos1_aa)) == std::get<char>(pos1_aa)) == std::get<bool>(pos1_aa); });
     }
 
     // ======================================================================
@@ -0,0 +1,401 @@
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+
+#include "acmacs-base/omp.hh"
+#include "acmacs-base/to-json.hh"
+#include "acmacs-base/string-split.hh"
+#include "seqdb-3/aggregate.hh"
+#include "seqdb-3/seqdb.hh"
+
+// ----------------------------------------------------------------------
+
+namespace local
+{
+    using field_t = acmacs::seqdb::aggregate_t::field_t;
+    using namespace std::string_view_literals;
+
+    constexpr std::array fields{
+        std::pair{"year"sv, field_t::year},
+        std::pair{"month"sv, field_t::month},
+        std::pair{"season"sv, field_t::season},
+        std::pair{"continent"sv, field_t::continent},
+        std::pair{"country"sv, field_t::country},
+        std::pair{"clade"sv, field_t::clade},
+        std::pair{"lab"sv, field_t::lab},
+    };
+
+    inline std::string name(const acmacs::seqdb::aggregate_t::key_t& key)
+    {
+        if (key.field == field_t::aa)
+            return fmt::format("aa{}", key.pos);
+        return std::string{std::find_if(std::begin(fields), std::end(fields), [&key](const auto& en) { return en.second == key.field; })->first};
+    }
+
+    inline bool is_date(field_t field) { return field == field_t::year || field == field_t::month || field == field_t::season; }
+
+    struct year_month_t
+    {
+        int year{0};  // 0 if date is empty or invalid
+        int month{0}; // 0 if date has no month
+    };
+
+    // "2020-04-18", "2020-04", "2020"
+    inline year_month_t year_month(std::string_view date)
+    {
+        const auto digits = [date](size_t first, size_t last) {
+            int value{0};
+            for (size_t pos{first}; pos < last; ++pos) {
+                if (date[pos] < '0' || date[pos] > '9')
+                    return -1;
+                value = value * 10 + (date[pos] - '0');
+            }
+            return value;
+        };
+
+        year_month_t result;
+        if (date.size() >= 4 && (date.size() == 4 || date[4] == '-')) {
+            if (const auto year = digits(0, 4); year > 0) {
+                result.year = year;
+                if (date.size() >= 7 && (date.size() == 7 || date[7] == '-')) {
+                    if (const auto month = digits(5, 7); month >= 1 && month <= 12)
+                        result.month = month;
+                }
+            }
+        }
+        return result;
+    }
+
+    inline std::string csv_field(std::string_view value)
+    {
+        if (value.find_first_of(",\"\n") == std::string_view::npos && (value.empty() || (value.front() != ' ' && value.back() != ' ')))
+            return std::string{value};
+        std::string result{"\""};
+        for (const char cc : value) {
+            if (cc == '"')
+                result.push_back('"');
+            result.push_back(cc);
+        }
+        result.push_back('"');
+        return result;
+    }
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::aggregate_t::aggregate_t(std::string_view keys)
+{
+    for (const auto& key : acmacs::string::split(keys, ",", acmacs::string::Split::StripRemoveEmpty)) {
+        if (const auto found = std::find_if(std::begin(local::fields), std::end(local::fields), [key](const auto& en) { return en.first == key; }); found != std::end(local::fields)) {
+            keys_.push_back(key_t{found->second});
+        }
+        else if (key.size() > 2 && key.substr(0, 2) == "aa") {
+            size_t pos{0};
+            if (const auto [end, ec] = std::from_chars(key.data() + 2, key.data() + key.size(), pos); ec != std::errc{} || end != key.data() + key.size() || pos == 0)
+                throw std::runtime_error{fmt::format("invalid group-by key \"{}\": aa position expected, e.g. aa142", key)};
+            keys_.push_back(key_t{field_t::aa, pos1_t{pos}});
+        }
+        else
+            throw std::runtime_error{fmt::format("invalid group-by key \"{}\", supported: year, month, season, continent, country, clade, lab, aaNNN", key)};
+    }
+    if (keys_.empty())
+        throw std::runtime_error{fmt::format("no group-by keys in \"{}\"", keys)};
+
+} // acmacs::seqdb::v3::aggregate_t::aggregate_t
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::aggregate_table_t acmacs::seqdb::v3::aggregate_t::aggregate(const Seqdb& seqdb, const subset& sub) const
+{
+    aggregate_table_t table;
+    std::transform(std::begin(keys_), std::end(keys_), std::back_inserter(table.columns), [](const auto& key) { return local::name(key); });
+
+    const size_t number_of_refs{sub.size()};
+    const bool parallel = number_of_refs > 0x4000;
+
+    // years seen define the code range of year, month and season keys
+    int first_year{std::numeric_limits<int>::max()}, last_year{0};
+    if (std::any_of(std::begin(keys_), std::end(keys_), [](const auto& key) { return local::is_date(key.field); })) {
+#pragma omp parallel for default(shared) schedule(static) reduction(min : first_year) reduction(max : last_year) if (parallel)
+        for (size_t ref_no = 0; ref_no < number_of_refs; ++ref_no) {
+            if (const auto year = local::year_month(sub[ref_no].entry->date()).year; year > 0) {
+                first_year = std::min(first_year, year);
+                last_year = std::max(last_year, year);
+            }
+        }
+    }
+    const size_t years = last_year >= first_year ? static_cast<size_t>(last_year - first_year + 1) : 0;
+
+    // dense codes of each key and strides of the combined code (the first key is the most significant)
+    struct dimension_t
+    {
+        size_t size{0};
+        const dictionary_t* dictionary{nullptr};
+        dictionary_code_t empty{dictionary_t::not_found}; // code of the empty value in dictionary, e.g. no continent
+        size_t stride{1};
+    };
+    const auto& dictionaries = seqdb.dictionaries();
+    std::vector<dimension_t> dimensions(keys_.size());
+    for (size_t key_no{0}; key_no < keys_.size(); ++key_no) {
+        auto& dim = dimensions[key_no];
+        switch (keys_[key_no].field) {
+            case field_t::year:
+                dim.size = years;
+                break;
+            case field_t::month:
+                dim.size = years * 12;
+                break;
+            case field_t::season:
+                dim.size = years > 0 ? years * 2 + 1 : 0; // Jan-Mar of the first year belong to the season started in Oct of the previous year
+                break;
+            case field_t::continent:
+                dim.dictionary = &dictionaries.continents;
+                break;
+            case field_t::country:
+                dim.dictionary = &dictionaries.countries;
+                break;
+            case field_t::clade:
+                dim.dictionary = &dictionaries.clades;
+                break;
+            case field_t::lab:
+                dim.dictionary = &dictionaries.labs;
+                break;
+            case field_t::aa:
+                dim.size = 256; // raw char, e.g. X or - are kept as they are
+                break;
+        }
+        if (dim.dictionary) {
+            dim.size = dim.dictionary->size();
+            dim.empty = dim.dictionary->find(std::string_view{});
+        }
+    }
+    size_t number_of_codes{1};
+    for (size_t key_no = keys_.size(); key_no > 0; --key_no) {
+        auto& dim = dimensions[key_no - 1];
+        dim.stride = number_of_codes;
+        if (dim.size > 0 && number_of_codes > std::numeric_limits<size_t>::max() / dim.size)
+            throw std::runtime_error{fmt::format("too many groups for {}", table.columns)};
+        number_of_codes *= dim.size;
+    }
+    if (number_of_codes == 0) { // e.g. no dates at all
+        table.skipped = number_of_refs;
+        return table;
+    }
+
+    // refs are split into parts, each part is counted by its own thread into its own counters, counters are merged afterwards
+    // if there are too many combinations for dense counters, combined codes are collected and counted by sorting
+    constexpr size_t max_dense_codes{0x100000};
+    const bool dense = number_of_codes <= max_dense_codes;
+    struct part_t
+    {
+        std::vector<uint32_t> counters;
+        std::vector<size_t> codes;
+        size_t total{0};
+        size_t skipped{0};
+    };
+    const size_t number_of_parts = parallel ? static_cast<size_t>(omp_get_max_threads()) : 1;
+    std::vector<part_t> parts(number_of_parts);
+
+#pragma omp parallel for default(shared) schedule(static, 1) if (parallel)
+    for (size_t part_no = 0; part_no < number_of_parts; ++part_no) {
+        auto& part = parts[part_no];
+        if (dense)
+            part.counters.resize(number_of_codes, 0);
+        std::vector<std::vector<size_t>> values(keys_.size()); // codes of the ref for each key, clade and lab may have several
+        std::vector<size_t> index(keys_.size());
+        const size_t last_ref = number_of_refs * (part_no + 1) / number_of_parts;
+        for (size_t ref_no = number_of_refs * part_no / number_of_parts; ref_no < last_ref; ++ref_no) {
+            const auto& rf = sub[ref_no];
+            const auto date = local::year_month(rf.entry->date());
+            const SeqdbSeq* with_sequence{nullptr}; // master lookup is done on demand and at most once
+            bool has_values{true};
+            for (size_t key_no{0}; key_no < keys_.size() && has_values; ++key_no) {
+                const auto& dim = dimensions[key_no];
+                auto& vals = values[key_no];
+                vals.clear();
+                const auto add_code = [&vals, &dim](dictionary_code_t code) {
+                    if (code != dim.empty && code != dictionary_t::not_found)
+                        vals.push_back(code);
+                };
+                switch (keys_[key_no].field) {
+                    case field_t::year:
+                        if (date.year > 0)
+                            vals.push_back(static_cast<size_t>(date.year - first_year));
+                        break;
+                    case field_t::month:
+                        if (date.month > 0)
+                            vals.push_back(static_cast<size_t>(date.year - first_year) * 12 + static_cast<size_t>(date.month - 1));
+                        break;
+                    case field_t::season:
+                        if (date.month > 0)
+                            vals.push_back(static_cast<size_t>(date.year - first_year) * 2 + (date.month < 4 ? 0 : (date.month < 10 ? 1 : 2)));
+                        break;
+                    case field_t::continent:
+                        add_code(rf.entry->continent_code);
+                        break;
+                    case field_t::country:
+                        add_code(rf.entry->country_code);
+                        break;
+                    case field_t::clade:
+                        if (!with_sequence)
+                            with_sequence = &rf.seq_with_sequence(seqdb);
+                        std::for_each(std::begin(with_sequence->clade_codes), std::end(with_sequence->clade_codes), add_code);
+                        break;
+                    case field_t::lab:
+                        std::for_each(std::begin(rf.seq().lab_codes), std::end(rf.seq().lab_codes), add_code);
+                        break;
+                    case field_t::aa:
+                        if (!with_sequence)
+                            with_sequence = &rf.seq_with_sequence(seqdb);
+                        vals.push_back(static_cast<unsigned char>(with_sequence->aa_at_pos_master(keys_[key_no].pos)));
+                        break;
+                }
+                has_values = !vals.empty();
+            }
+            if (!has_values) {
+                ++part.skipped;
+                continue;
+            }
+
+            ++part.total;
+            // count every combination of values
+            std::fill(std::begin(index), std::end(index), 0);
+            for (bool more{true}; more;) {
+                size_t code{0};
+                for (size_t key_no{0}; key_no < keys_.size(); ++key_no)
+                    code += values[key_no][index[key_no]] * dimensions[key_no].stride;
+                if (dense)
+                    ++part.counters[code];
+                else
+                    part.codes.push_back(code);
+                more = false;
+                for (size_t key_no = keys_.size(); key_no > 0 && !more; --key_no) {
+                    if (++index[key_no - 1] < values[key_no - 1].size())
+                        more = true;
+                    else
+                        index[key_no - 1] = 0;
+                }
+            }
+        }
+    }
+
+    // merge parts
+    std::vector<std::pair<size_t, size_t>> counts; // combined code, count
+    for (const auto& part : parts) {
+        table.total += part.total;
+        table.skipped += part.skipped;
+    }
+    if (dense) {
+        auto& counters = parts.front().counters;
+        for (auto part = std::next(std::begin(parts)); part != std::end(parts); ++part)
+            std::transform(std::begin(part->counters), std::end(part->counters), std::begin(counters), std::begin(counters), std::plus<uint32_t>{});
+        for (size_t code{0}; code < counters.size(); ++code) {
+            if (counters[code] > 0)
+                counts.emplace_back(code, counters[code]);
+        }
+    }
+    else {
+        auto& codes = parts.front().codes;
+        for (auto part = std::next(std::begin(parts)); part != std::end(parts); ++part)
+            codes.insert(std::end(codes), std::begin(part->codes), std::end(part->codes));
+        std::sort(std::begin(codes), std::end(codes));
+        for (auto first = std::begin(codes); first != std::end(codes);) {
+            const auto last = std::find_if(first, std::end(codes), [code = *first](size_t another) { return another != code; });
+            counts.emplace_back(*first, static_cast<size_t>(last - first));
+            first = last;
+        }
+    }
+
+    // decode combined codes into values
+    table.rows.reserve(counts.size());
+    for (const auto& [combined_code, count] : counts) {
+        auto& row = table.rows.emplace_back(aggregate_table_t::row_t{{}, count});
+        for (size_t key_no{0}; key_no < keys_.size(); ++key_no) {
+            const auto& dim = dimensions[key_no];
+            const auto code = combined_code / dim.stride % dim.size;
+            switch (keys_[key_no].field) {
+                case field_t::year:
+                    row.values.push_back(fmt::format("{}", first_year + static_cast<int>(code)));
+                    break;
+                case field_t::month:
+                    row.values.push_back(fmt::format("{}-{:02d}", first_year + static_cast<int>(code / 12), code % 12 + 1));
+                    break;
+                case field_t::season:
+                    if (code % 2)
+                        row.values.push_back(fmt::format("{}-04", first_year + static_cast<int>(code / 2)));
+                    else
+                        row.values.push_back(fmt::format("{}-10", first_year + static_cast<int>(code / 2) - 1));
+                    break;
+                case field_t::continent:
+                case field_t::country:
+                case field_t::clade:
+                case field_t::lab:
+                    row.values.emplace_back((*dim.dictionary)[static_cast<dictionary_code_t>(code)]);
+                    break;
+                case field_t::aa:
+                    row.values.emplace_back(1, static_cast<char>(code));
+                    break;
+            }
+        }
+    }
+    std::sort(std::begin(table.rows), std::end(table.rows), [](const auto& r1, const auto& r2) { return r1.values < r2.values; });
+    return table;
+
+} // acmacs::seqdb::v3::aggregate_t::aggregate
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::aggregate_table_t::count(const std::vector<std::string_view>& values) const
+{
+    const auto less = [](const std::vector<std::string>& v1, const std::vector<std::string_view>& v2) {
+        return std::lexicographical_compare(std::begin(v1), std::end(v1), std::begin(v2), std::end(v2), [](std::string_view s1, std::string_view s2) { return s1 < s2; });
+    };
+    if (const auto found = std::lower_bound(std::begin(rows), std::end(rows), values, [less](const auto& row, const auto& vals) { return less(row.values, vals); });
+        found != std::end(rows) && std::equal(std::begin(found->values), std::end(found->values), std::begin(values), std::end(values)))
+        return found->count;
+    return 0;
+
+} // acmacs::seqdb::v3::aggregate_table_t::count
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::aggregate_table_t::json() const
+{
+    to_json::array data;
+    for (const auto& row : rows) {
+        to_json::object obj;
+        for (size_t column_no{0}; column_no < columns.size(); ++column_no)
+            obj << to_json::key_val(columns[column_no], row.values[column_no]);
+        obj << to_json::key_val("count", row.count);
+        obj.make_compact();
+        data << std::move(obj);
+    }
+    return fmt::format("{}\n", to_json::object(to_json::key_val("group_by", to_json::array(std::begin(columns), std::end(columns), to_json::json::compact_output::yes)),
+                                               to_json::key_val("total", total), to_json::key_val("skipped", skipped), to_json::key_val("data", std::move(data))));
+
+} // acmacs::seqdb::v3::aggregate_table_t::json
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::aggregate_table_t::csv() const
+{
+    fmt::memory_buffer out;
+    for (const auto& column : columns)
+        fmt::format_to_mb(out, "{},", local::csv_field(column));
+    fmt::format_to_mb(out, "count\n");
+    for (const auto& row : rows) {
+        for (const auto& value : row.values)
+            fmt::format_to_mb(out, "{},", local::csv_field(value));
+        fmt::format_to_mb(out, "{}\n", row.count);
+    }
+    return fmt::to_string(out);
+
+} // acmacs::seqdb::v3::aggregate_table_t::csv
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
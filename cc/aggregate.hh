@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "seqdb-3/sequence.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    class Seqdb;
+    class subset;
+
+    // result of aggregate_t::aggregate(): number of sequences per group, groups with zero count are not listed
+    class aggregate_table_t
+    {
+      public:
+        struct row_t
+        {
+            std::vector<std::string> values; // one per column
+            size_t count{0};
+        };
+
+        std::vector<std::string> columns; // names of the group-by keys, e.g. "year", "clade", "aa142"
+        std::vector<row_t> rows;          // sorted by values
+        size_t total{0};                  // sequences counted, a sequence with several clades (labs) is counted in each of them, but once here
+        size_t skipped{0};                // sequences having no value for one of the keys (no date, no month, no continent, no clades, etc.)
+
+        size_t count(const std::vector<std::string_view>& values) const; // 0 if there is no such group
+
+        std::string json() const;
+        std::string csv() const;
+    };
+
+    // group-by keys (e.g. "year,clade,aa142") compiled once into dense codes:
+    //   year, month ("2020-04"), season ("2020-04" for Apr-Sep, "2020-10" for Oct-Mar),
+    //   continent, country, clade, lab (codes in Seqdb::dictionaries()), aaNNN (amino acid at pos1 NNN)
+    // aggregate() makes one parallel pass over the subset counting sequences in a dense array of counters
+    // indexed by the combination of codes (or sorting combined codes if the array would be too large)
+    class aggregate_t
+    {
+      public:
+        enum class field_t { year, month, season, continent, country, clade, lab, aa };
+
+        struct key_t
+        {
+            field_t field;
+            pos1_t pos{NoPos1}; // for aa
+        };
+
+        aggregate_t(std::string_view keys); // comma separated
+        aggregate_t(const std::vector<key_t>& keys) : keys_{keys} {}
+
+        aggregate_table_t aggregate(const Seqdb& seqdb, const subset& sub) const;
+
+      private:
+        std::vector<key_t> keys_;
+    };
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <algorithm>
+
+#include "seqdb-3/packed-sequence.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    // Storage for many small lists (passages, hi_names, etc. of all sequences) in a few large blocks instead of one heap vector per list.
+    // Elements are never moved after a list is closed (by opening the next one), spans to closed lists stay valid for the lifetime of the arena.
+    // The list being filled is kept contiguous: if it does not fit into the current block, it is moved to the new block.
+    template <typename T> class arena_t
+    {
+      public:
+        using span_t = std::span<const T>;
+
+        arena_t() = default;
+        arena_t(const arena_t&) = delete;
+        arena_t(arena_t&&) = default;
+        arena_t& operator=(const arena_t&) = delete;
+        arena_t& operator=(arena_t&&) = default;
+
+        // starts a new list, the previous one is closed
+        void open() { first_ = used_; }
+
+        // appends to the open list, returns the whole open list (its previous span becomes invalid if the list was moved to a new block)
+        span_t push_back(const T& value)
+        {
+            if (used_ == capacity_)
+                new_block();
+            blocks_.back()[used_++] = value;
+            return span_t{blocks_.back().get() + first_, used_ - first_};
+        }
+
+        size_t number_of_blocks() const { return blocks_.size(); }
+        size_t allocated() const { return allocated_; } // number of elements in all blocks
+
+      private:
+        static constexpr size_t block_size{0x10000};
+
+        std::vector<std::unique_ptr<T[]>> blocks_;
+        size_t capacity_{0}, first_{0}, used_{0}; // of the last block
+        size_t allocated_{0};
+
+        void new_block()
+        {
+            const size_t open_size = used_ - first_;
+            const size_t capacity = std::max(block_size, open_size * 2);
+            auto block = std::make_unique<T[]>(capacity);
+            if (open_size > 0)
+                std::copy(blocks_.back().get() + first_, blocks_.back().get() + used_, block.get());
+            blocks_.push_back(std::move(block));
+            capacity_ = capacity;
+            first_ = 0;
+            used_ = open_size;
+            allocated_ += capacity;
+        }
+    };
+
+    // ----------------------------------------------------------------------
+
+    // Storage for strings (names, dates, passages, etc.) copied from the source text, the source can be released after parsing.
+    // Strings are never moved, views to them stay valid for the lifetime of the arena.
+    class text_arena_t
+    {
+      public:
+        text_arena_t() = default;
+        text_arena_t(const text_arena_t&) = delete;
+        text_arena_t(text_arena_t&&) = default;
+        text_arena_t& operator=(const text_arena_t&) = delete;
+        text_arena_t& operator=(text_arena_t&&) = default;
+
+        std::string_view store(std::string_view text)
+        {
+            if (text.empty())
+                return {};
+            if ((used_ + text.size()) > capacity_)
+                new_block(text.size());
+            char* target = blocks_.back().get() + used_;
+            std::copy(std::begin(text), std::end(text), target);
+            used_ += text.size();
+            return std::string_view{target, text.size()};
+        }
+
+        size_t number_of_blocks() const { return blocks_.size(); }
+        size_t allocated() const { return allocated_; } // number of chars in all blocks
+
+      private:
+        static constexpr size_t block_size{0x100000};
+
+        std::vector<std::unique_ptr<char[]>> blocks_;
+        size_t capacity_{0}, used_{0}; // of the last block
+        size_t allocated_{0};
+
+        void new_block(size_t size)
+        {
+            capacity_ = std::max(block_size, size);
+            blocks_.push_back(std::make_unique<char[]>(capacity_));
+            used_ = 0;
+            allocated_ += capacity_;
+        }
+    };
+
+    // ----------------------------------------------------------------------
+
+    using lab_ids_t = std::span<const std::string_view>;
+    using lab_t = std::pair<std::string_view, lab_ids_t>;
+
+    // data of SeqdbEntry and SeqdbSeq of the whole database (or seqdb-4 shard), filled by parse(), the parsed text is not referenced
+    struct seqdb_arena_t
+    {
+        arena_t<std::string_view> strings; // reassortants, passages, clades, hi_names, lab ids, gisaid isolate and sample ids
+        arena_t<lab_t> labs;
+        text_arena_t text;                                                      // strings of entries and seqs, parts of sequences before the alignment start
+        packed_sequences_t amino_acids{packed_sequences_t::alphabet::amino_acids}; // aligned parts of amino acid sequences of masters
+        packed_sequences_t nucs{packed_sequences_t::alphabet::nucleotides};         // aligned parts of nucleotide sequences of masters
+    };
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
@@ -0,0 +1,156 @@
+#include "acmacs-base/filesystem.hh"
+#include "acmacs-base/acmacsd.hh"
+#include "acmacs-base/settings-v3.hh"
+#include "acmacs-base/rjson-v3.hh"
+#include "seqdb-3/clades.hh"
+
+// ----------------------------------------------------------------------
+
+namespace local
+{
+    struct clade_definition_t
+    {
+        std::string name;
+        acmacs::seqdb::amino_acid_at_pos1_eq_list_t aa;
+        acmacs::seqdb::nucleotide_at_pos1_eq_list_t nuc;
+    };
+
+    using clade_definitions_t = std::map<std::string, std::vector<clade_definition_t>, std::less<>>;
+
+    class CladesJson : public acmacs::settings::v3::Data
+    {
+      public:
+        CladesJson(std::string_view filename)
+        {
+            using namespace std::string_literals;
+            using namespace std::string_view_literals;
+
+            if (fs::exists(filename))
+                acmacs::settings::v3::Data::load(filename);
+            else
+                throw std::runtime_error{fmt::format("WARNING: cannot load \"{}\": file not found\n", filename)};
+
+            using pp = std::pair<std::string, std::string_view>;
+            for (const auto& [virus_type, tag] : {pp{"H1"s, "clades-A(H1N1)2009pdm"sv}, pp{"H3"s, "clades-A(H3N2)"sv}, pp{"BVICTORIA"s, "clades-B/Vic"sv}, pp{"BYAMAGATA"s, "clades-B/Yam"sv}}) {
+                current_virus_type_ = virus_type;
+                apply(tag);
+            }
+        }
+
+        bool apply_built_in(std::string_view name) override // returns true if built-in command with that name found and applied
+        {
+            using namespace std::string_view_literals;
+            if (name == "clade"sv) {
+                const auto& aa_field = getenv("aa"sv);
+                auto aa = aa_field.is_null() ? acmacs::seqdb::amino_acid_at_pos1_eq_list_t{} : acmacs::seqdb::extract_aa_at_pos1_eq_list(aa_field);
+                const auto& nuc_field = getenv("nuc"sv);
+                auto nuc = nuc_field.is_null() ? acmacs::seqdb::nucleotide_at_pos1_eq_list_t{} : acmacs::seqdb::extract_nuc_at_pos1_eq_list(nuc_field);
+                definitions_[current_virus_type_].push_back(clade_definition_t{std::string{getenv_or("name"sv, ""sv)}, std::move(aa), std::move(nuc)});
+            }
+            else
+                return acmacs::settings::v3::Data::apply_built_in(name);
+            return true;
+        }
+
+        const clade_definitions_t& definitions() const { return definitions_; }
+
+      private:
+        std::string current_virus_type_;
+        clade_definitions_t definitions_;
+    };
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::CladeDefinitions::CladeDefinitions()
+{
+    load(fmt::format("{}/share/conf/clades.json", acmacs::acmacsd_root()));
+
+} // acmacs::seqdb::v3::CladeDefinitions::CladeDefinitions
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::CladeDefinitions::CladeDefinitions(std::string_view filename)
+{
+    load(filename);
+
+} // acmacs::seqdb::v3::CladeDefinitions::CladeDefinitions
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::CladeDefinitions::load(std::string_view filename)
+{
+    struct condition_t
+    {
+        size_t definition_no;
+        char symbol;
+        bool equal;
+    };
+
+    const local::CladesJson clades_json{filename};
+    for (const auto& [virus_type, definitions] : clades_json.definitions()) {
+        auto& compiled = data_[virus_type];
+        compiled.words = std::max(size_t{1}, (definitions.size() + 63) / 64);
+
+        // conditions grouped by position, nucs (true) after aas (false)
+        std::map<std::pair<bool, size_t>, std::vector<condition_t>> conditions;
+        for (size_t definition_no = 0; definition_no < definitions.size(); ++definition_no) {
+            const auto& definition = definitions[definition_no];
+            if (const auto found = std::find(std::begin(compiled.names), std::end(compiled.names), definition.name); found != std::end(compiled.names))
+                compiled.definition_name.push_back(static_cast<size_t>(found - std::begin(compiled.names)));
+            else {
+                compiled.definition_name.push_back(compiled.names.size());
+                compiled.names.push_back(definition.name);
+            }
+            for (const auto& pos1_aa : definition.aa)
+                conditions[{false, *pos0_t{std::get<pos1_t>(pos1_aa)}}].push_back(condition_t{definition_no, std::get<char>(pos1_aa), std::get<bool>(pos1_aa)});
+            for (const auto& pos1_nuc : definition.nuc)
+                conditions[{true, *pos0_t{std::get<pos1_t>(pos1_nuc)}}].push_back(condition_t{definition_no, std::get<char>(pos1_nuc), std::get<bool>(pos1_nuc)});
+        }
+
+        const auto add_mask = [&compiled](const std::vector<condition_t>& at_pos, char symbol, bool listed) {
+            const auto offset = compiled.masks.size();
+            compiled.masks.resize(offset + compiled.words, 0);
+            for (const auto& condition : at_pos) {
+                if (((listed && condition.symbol == symbol) != condition.equal))
+                    compiled.masks[offset + condition.definition_no / 64] |= uint64_t{1} << (condition.definition_no % 64);
+            }
+            return offset;
+        };
+
+        for (const auto& [key, at_pos] : conditions) {
+            auto& position = compiled.positions.emplace_back(position_t{pos0_t{key.second}, key.first, compiled.symbols.size(), compiled.symbols.size(), 0});
+            for (const auto& condition : at_pos) {
+                if (std::none_of(std::next(std::begin(compiled.symbols), static_cast<ssize_t>(position.first_symbol)), std::end(compiled.symbols),
+                                 [&condition](const auto& en) { return en.first == condition.symbol; }))
+                    compiled.symbols.emplace_back(condition.symbol, add_mask(at_pos, condition.symbol, true));
+            }
+            position.last_symbol = compiled.symbols.size();
+            position.other_mask = add_mask(at_pos, ' ', false);
+        }
+    }
+
+} // acmacs::seqdb::v3::CladeDefinitions::load
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::CladeDefinitions::virus_type_key(std::string_view virus_type, std::string_view lineage)
+{
+    if (virus_type.empty())
+        return {};
+    else if (virus_type[0] == 'B')
+        return fmt::format("B{}", lineage);
+    else if (virus_type.substr(0, 4) == "A(H1")
+        return "H1";
+    else if (virus_type.substr(0, 4) == "A(H3")
+        return "H3";
+    else
+        return std::string{virus_type};
+
+} // acmacs::seqdb::v3::CladeDefinitions::virus_type_key
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
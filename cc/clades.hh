@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "seqdb-3/aa-at-pos.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    // Clade definitions from clades.json compiled per virus type ("H1", "H3", "BVICTORIA", "BYAMAGATA").
+    // Every aa/nuc position used by definitions of a virus type is read once,
+    // definitions failing at the read symbol are accumulated in a bitmask.
+    class CladeDefinitions
+    {
+      public:
+        using clade_names_t = std::vector<std::string_view>; // views into CladeDefinitions
+
+        CladeDefinitions(); // $ACMACSD_ROOT/share/conf/clades.json
+        CladeDefinitions(std::string_view filename);
+
+        bool has(std::string_view virus_type) const { return data_.find(virus_type) != data_.end(); }
+
+        // aa_at(pos0_t) and nuc_at(pos0_t) return symbol at the aligned position (with deletions applied)
+        // clades are returned in the order of definitions, without duplicates
+        template <typename AaAt, typename NucAt> clade_names_t clades(std::string_view virus_type, AaAt&& aa_at, NucAt&& nuc_at) const;
+
+        clade_names_t clades(std::string_view virus_type, sequence_aligned_ref_t aa, sequence_aligned_ref_t nuc) const
+        {
+            return clades(
+                virus_type, [aa](pos0_t pos0) { return aa.at(pos0); }, [nuc](pos0_t pos0) { return nuc.at(pos0); });
+        }
+
+        // "A(H1N1)" -> "H1", "A(H3N2)" -> "H3", "B" -> "BVICTORIA" or "BYAMAGATA" (empty lineage -> "B", no definitions)
+        static std::string virus_type_key(std::string_view virus_type, std::string_view lineage);
+
+      private:
+        struct position_t
+        {
+            pos0_t pos;
+            bool nuc;
+            size_t first_symbol, last_symbol; // range in symbols
+            size_t other_mask;                // offset in masks for symbols not listed in the range
+        };
+
+        struct compiled_t
+        {
+            std::vector<std::string> names;      // unique clade names in the order of first definition
+            std::vector<size_t> definition_name; // definition no -> index in names
+            size_t words{1};                     // number of uint64_t in a mask
+            std::vector<position_t> positions;
+            std::vector<std::pair<char, size_t>> symbols; // symbol -> offset in masks
+            std::vector<uint64_t> masks;                  // bit set: definition fails
+        };
+
+        std::map<std::string, compiled_t, std::less<>> data_;
+
+        void load(std::string_view filename);
+    };
+
+    // ----------------------------------------------------------------------
+
+    template <typename AaAt, typename NucAt> CladeDefinitions::clade_names_t CladeDefinitions::clades(std::string_view virus_type, AaAt&& aa_at, NucAt&& nuc_at) const
+    {
+        clade_names_t result;
+        if (const auto found = data_.find(virus_type); found != data_.end()) {
+            const auto& compiled = found->second;
+            std::vector<uint64_t> failed(compiled.words, 0);
+            for (const auto& position : compiled.positions) {
+                const char symbol = position.nuc ? nuc_at(position.pos) : aa_at(position.pos);
+                size_t mask = position.other_mask;
+                for (size_t symbol_no = position.first_symbol; symbol_no < position.last_symbol; ++symbol_no) {
+                    if (compiled.symbols[symbol_no].first == symbol) {
+                        mask = compiled.symbols[symbol_no].second;
+                        break;
+                    }
+                }
+                for (size_t word = 0; word < compiled.words; ++word)
+                    failed[word] |= compiled.masks[mask + word];
+            }
+            for (size_t definition_no = 0; definition_no < compiled.definition_name.size(); ++definition_no) {
+                if ((failed[definition_no / 64] & (uint64_t{1} << (definition_no % 64))) == 0) {
+                    if (const std::string_view name{compiled.names[compiled.definition_name[definition_no]]}; std::find(std::begin(result), std::end(result), name) == std::end(result))
+                        result.push_back(name);
+                }
+            }
+        }
+        return result;
+    }
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
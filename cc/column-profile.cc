@@ -0,0 +1,189 @@
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#include "acmacs-base/fmt.hh"
+#include "seqdb-3/column-profile.hh"
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::column_profile_t::resize(pos0_t number_of_positions)
+{
+    if (number_of_positions > size()) {
+        counts_.resize(*number_of_positions * number_of_slots, 0);
+        if (weighted())
+            weights_.resize(counts_.size(), 0.0);
+    }
+
+} // acmacs::seqdb::v3::column_profile_t::resize
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::column_profile_t::make_weighted()
+{
+    if (!weighted())
+        weights_.assign(std::begin(counts_), std::end(counts_));
+
+} // acmacs::seqdb::v3::column_profile_t::make_weighted
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::column_profile_t::add(std::string_view sequence, double weight)
+{
+    resize(pos0_t{sequence.size()});
+    if (weight != 1.0)
+        make_weighted();
+    for (size_t pos{0}; pos < sequence.size(); ++pos)
+        ++counts_[pos * number_of_slots + slot(sequence[pos])];
+    if (weighted()) {
+        for (size_t pos{0}; pos < sequence.size(); ++pos)
+            weights_[pos * number_of_slots + slot(sequence[pos])] += weight;
+    }
+
+} // acmacs::seqdb::v3::column_profile_t::add
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::column_profile_t::add(const std::vector<std::string_view>& sequences, const std::vector<double>& weights)
+{
+    if (!weights.empty() && weights.size() != sequences.size())
+        throw std::runtime_error{fmt::format("column_profile_t::add: invalid number of weights: {}, number of sequences: {}", weights.size(), sequences.size())};
+
+    const auto max_length = std::accumulate(std::begin(sequences), std::end(sequences), size_t{0}, [](size_t max, std::string_view seq) { return std::max(max, seq.size()); });
+    resize(pos0_t{max_length});
+    if (!weights.empty())
+        make_weighted();
+
+    // positions are split into blocks, each block is processed by one thread for all sequences,
+    // i.e. counters of a block stay in the cache of that thread and no synchronization is needed
+    constexpr size_t positions_per_block{64};
+    const size_t number_of_blocks = (max_length + positions_per_block - 1) / positions_per_block;
+    const bool parallel = sequences.size() * max_length > 0x10000;
+
+#pragma omp parallel for default(shared) schedule(static) if (parallel)
+    for (size_t block_no = 0; block_no < number_of_blocks; ++block_no) {
+        const size_t block_first = block_no * positions_per_block;
+        const size_t block_last = std::min(block_first + positions_per_block, max_length);
+        for (size_t seq_no{0}; seq_no < sequences.size(); ++seq_no) {
+            const auto& seq = sequences[seq_no];
+            const size_t last = std::min(block_last, seq.size());
+            count_t* counts = counts_.data();
+            for (size_t pos{block_first}; pos < last; ++pos)
+                ++counts[pos * number_of_slots + slot(seq[pos])];
+            if (weighted()) {
+                const double weight = weights.empty() ? 1.0 : weights[seq_no];
+                for (size_t pos{block_first}; pos < last; ++pos)
+                    weights_[pos * number_of_slots + slot(seq[pos])] += weight;
+            }
+        }
+    }
+
+} // acmacs::seqdb::v3::column_profile_t::add
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::column_profile_t::merge(const column_profile_t& another)
+{
+    resize(another.size());
+    if (another.weighted())
+        make_weighted();
+    std::transform(std::begin(another.counts_), std::end(another.counts_), std::begin(counts_), std::begin(counts_), std::plus<count_t>{});
+    if (another.weighted())
+        std::transform(std::begin(another.weights_), std::end(another.weights_), std::begin(weights_), std::begin(weights_), std::plus<double>{});
+    else if (weighted())
+        std::transform(std::begin(another.counts_), std::end(another.counts_), std::begin(weights_), std::begin(weights_), [](count_t count, double weight) { return weight + count; });
+
+} // acmacs::seqdb::v3::column_profile_t::merge
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::column_profile_t::number_of_residues(pos0_t pos) const
+{
+    if (pos >= size())
+        return 0;
+    const auto first = std::next(std::begin(counts_), static_cast<ssize_t>(*pos * number_of_slots));
+    return static_cast<size_t>(std::count_if(first, std::next(first, static_cast<ssize_t>(number_of_slots)), [](count_t count) { return count > 0; }));
+
+} // acmacs::seqdb::v3::column_profile_t::number_of_residues
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::column_profile_t::max_number_of_residues() const
+{
+    size_t result{0};
+    for (pos0_t pos{0}; pos < size(); ++pos)
+        result = std::max(result, number_of_residues(pos));
+    return result;
+
+} // acmacs::seqdb::v3::column_profile_t::max_number_of_residues
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::column_profile_t::summary_t acmacs::seqdb::v3::column_profile_t::summary(pos0_t pos) const
+{
+    summary_t result;
+    if (pos >= size())
+        return result;
+
+    // entropy = -sum(w/W * log(w/W)) = log(W) - sum(w * log(w)) / W
+    double max_weight{-1.0}, total_weight{0.0}, sum_w_log_w{0.0};
+    const size_t offset = *pos * number_of_slots;
+    for (size_t slt{0}; slt < number_of_slots; ++slt) {
+        if (const auto count = counts_[offset + slt]; count > 0) {
+            ++result.number_of_residues;
+            result.total += count;
+            const double weight = weighted() ? weights_[offset + slt] : static_cast<double>(count);
+            total_weight += weight;
+            if (weight > 0.0)
+                sum_w_log_w += weight * std::log(weight);
+            if (weight > max_weight || (weight == max_weight && residue(slt) < result.majority)) {
+                max_weight = weight;
+                result.majority = residue(slt);
+            }
+        }
+    }
+    if (total_weight > 0.0)
+        result.entropy = std::log(total_weight) - sum_w_log_w / total_weight;
+    return result;
+
+} // acmacs::seqdb::v3::column_profile_t::summary
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::column_profile_t::frequencies_t acmacs::seqdb::v3::column_profile_t::frequencies(pos0_t pos, sorted srt) const
+{
+    frequencies_t result;
+    if (pos < size()) {
+        const size_t offset = *pos * number_of_slots;
+        for (size_t slt{0}; slt < number_of_slots; ++slt) {
+            if (const auto count = counts_[offset + slt]; count > 0)
+                result.emplace_back(residue(slt), count);
+        }
+        switch (srt) {
+            case sorted::no:
+                std::sort(std::begin(result), std::end(result), [](const auto& e1, const auto& e2) { return e1.first < e2.first; });
+                break;
+            case sorted::yes:
+                std::sort(std::begin(result), std::end(result), [](const auto& e1, const auto& e2) { return e1.second == e2.second ? e1.first < e2.first : e1.second > e2.second; });
+                break;
+        }
+    }
+    return result;
+
+} // acmacs::seqdb::v3::column_profile_t::frequencies
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::column_profile_t::residues(pos0_t pos) const
+{
+    const auto freq = frequencies(pos, sorted::yes);
+    std::string result(freq.size(), ' ');
+    std::transform(std::begin(freq), std::end(freq), std::begin(result), [](const auto& en) { return en.first; });
+    return result;
+
+} // acmacs::seqdb::v3::column_profile_t::residues
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
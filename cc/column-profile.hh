@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "seqdb-3/sequence.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    namespace detail
+    {
+        inline constexpr std::array<char, 32> profile_residues{'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+                                                               'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', '-', '*', '.', '~', ' ', '?'};
+
+        inline constexpr std::array<uint8_t, 256> profile_slots = [] {
+            std::array<uint8_t, 256> result{};
+            result.fill(static_cast<uint8_t>(profile_residues.size() - 1));
+            for (size_t slot{0}; slot < profile_residues.size(); ++slot)
+                result[static_cast<unsigned char>(profile_residues[slot])] = static_cast<uint8_t>(slot);
+            return result;
+        }();
+
+    } // namespace detail
+
+    // Residue counts per aligned position (aa or nuc) kept in a dense array of 32 slots per position:
+    // 'A'..'Z' -> 0..25, '-', '*', '.', '~', ' ', any other symbol is counted as '?'
+    // Entropy and majority use weights if sequences were added with weights, frequency tables always report counts.
+    class column_profile_t
+    {
+      public:
+        using count_t = uint32_t;
+        using frequencies_t = std::vector<std::pair<char, count_t>>;
+        enum class sorted { no /* by residue */, yes /* most frequent first, equal by residue */ };
+
+        static constexpr size_t number_of_slots{detail::profile_residues.size()};
+
+        struct summary_t
+        {
+            char majority{' '};         // most frequent (by weight) residue, ' ' if nothing counted at the position
+            size_t number_of_residues{0}; // distinct residues at the position
+            size_t total{0};
+            double entropy{0.0};        // Shannon index (natural log), https://en.wikipedia.org/wiki/Diversity_index
+        };
+
+        column_profile_t() = default;
+        column_profile_t(pos0_t number_of_positions) { resize(number_of_positions); }
+
+        // sequences are processed in blocks, positions of a block are split between threads for large input
+        // weights (if not empty) must have the same size as sequences
+        void add(const std::vector<std::string_view>& sequences, const std::vector<double>& weights = {});
+        void add(std::string_view sequence, double weight = 1.0);
+        void merge(const column_profile_t& another);
+
+        pos0_t size() const { return pos0_t{counts_.size() / number_of_slots}; }
+        bool empty() const { return counts_.empty(); }
+        void resize(pos0_t number_of_positions);
+
+        count_t count(pos0_t pos, char residue) const { return pos < size() ? counts_[*pos * number_of_slots + slot(residue)] : 0; }
+        size_t number_of_residues(pos0_t pos) const;
+        size_t max_number_of_residues() const; // max over all positions
+        char majority(pos0_t pos) const { return summary(pos).majority; }
+        double entropy(pos0_t pos) const { return summary(pos).entropy; }
+        summary_t summary(pos0_t pos) const; // entropy, majority and totals in one pass over the slots of pos
+
+        frequencies_t frequencies(pos0_t pos, sorted srt = sorted::yes) const;
+        std::string residues(pos0_t pos) const; // most frequent first
+
+        static constexpr size_t slot(char residue) { return detail::profile_slots[static_cast<unsigned char>(residue)]; }
+        static constexpr char residue(size_t slot) { return detail::profile_residues[slot]; }
+
+      private:
+        std::vector<count_t> counts_;  // number_of_slots per position
+        std::vector<double> weights_;  // number_of_slots per position, empty if no weights used
+
+        bool weighted() const { return !weights_.empty(); }
+        void make_weighted();
+    };
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
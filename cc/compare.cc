@@ -23,12 +23,53 @@ namespace local
 
 // ----------------------------------------------------------------------
 
+void acmacs::seqdb::v3::subset_to_compare_base_t::make_profile()
+{
+    profile = column_profile_t{};
+    profile.add(sequences);
+    frequencies.resize(*profile.size());
+#pragma omp parallel for default(shared) schedule(static, 64)
+    for (size_t pos = 0; pos < frequencies.size(); ++pos)
+        frequencies[pos] = profile.frequencies(pos0_t{pos}, column_profile_t::sorted::yes);
+
+} // acmacs::seqdb::v3::subset_to_compare_base_t::make_profile
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::subset_to_compare_base_t::set_sequences(std::vector<sequence_aligned_t>&& owned)
+{
+    auto shared = std::make_shared<const std::vector<sequence_aligned_t>>(std::move(owned));
+    sequences.resize(shared->size());
+    std::transform(std::begin(*shared), std::end(*shared), std::begin(sequences), [](const auto& seq) -> std::string_view { return *seq; });
+    owned_sequences_ = std::move(shared);
+    make_profile();
+
+} // acmacs::seqdb::v3::subset_to_compare_base_t::set_sequences
+
+// ----------------------------------------------------------------------
+
+const acmacs::seqdb::v3::column_profile_t::frequencies_t& acmacs::seqdb::v3::subset_to_compare_base_t::frequencies_at(pos0_t pos) const
+{
+    static const column_profile_t::frequencies_t empty;
+    return *pos < frequencies.size() ? frequencies[*pos] : empty;
+
+} // acmacs::seqdb::v3::subset_to_compare_base_t::frequencies_at
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::subset_to_compare_base_t::max_counter_size() const
+{
+    return std::accumulate(std::begin(frequencies), std::end(frequencies), size_t{0}, [](size_t max, const auto& freq) { return std::max(max, freq.size()); });
+
+} // acmacs::seqdb::v3::subset_to_compare_base_t::max_counter_size
+
+// ----------------------------------------------------------------------
+
 std::vector<acmacs::seqdb::v3::pos0_t> acmacs::seqdb::v3::subset_to_compare_base_t::positions_to_report() const
 {
     std::vector<pos0_t> positions;
-    for (size_t pos{0}; pos < counters.size(); ++pos) {
-        // AD_DEBUG("pos:{:3d} {:2d} {}", pos + 1, counters[pos].size(), counters[pos].report_sorted_max_first());
-        if (counters[pos].size() > 1)
+    for (size_t pos{0}; pos < frequencies.size(); ++pos) {
+        if (frequencies[pos].size() > 1)
             positions.push_back(pos0_t{pos});
     }
     return positions;
@@ -41,7 +82,8 @@ std::string acmacs::seqdb::v3::subset_to_compare_base_t::most_frequent(const std
 {
     std::string result(positions.size(), '/');
     for (size_t pp{0}; pp < positions.size(); ++pp)
-        result[pp] = counters[*positions[pp]].max().first;
+        if (const auto& freq = frequencies_at(positions[pp]); !freq.empty())
+            result[pp] = freq.front().first;
     return result;
 
 } // acmacs::seqdb::v3::subset_to_compare_base_t::most_frequent
@@ -58,17 +100,13 @@ std::string acmacs::seqdb::v3::subset_to_compare_base_t::format_summary(const st
         else
             fmt::format_to_mb(output, "{}{:{}c}", prefix, ' ', name_width);
         for (size_t pp{0}; pp < positions.size(); ++pp) {
-            const auto pos{positions[pp]};
-            if (row_no == 0 && most_frequent) {
-                if (const auto aa{counters[*pos].sorted()[row_no]}; aa != (*most_frequent)[pp])
-                    fmt::format_to_mb(output, "{:^{}c}", aa, column_width);
-                else
-                    fmt::format_to_mb(output, "{:^{}c}", '.', column_width);
-            }
-            else if (const auto aa{counters[*pos].sorted()}; row_no < aa.size())
-                fmt::format_to_mb(output, "{:^{}c}", aa[row_no], column_width);
-            else
+            const auto& freq{frequencies_at(positions[pp])};
+            if (row_no >= freq.size())
                 fmt::format_to_mb(output, "{:^{}c}", ' ', column_width);
+            else if (row_no == 0 && most_frequent && freq[row_no].first == (*most_frequent)[pp])
+                fmt::format_to_mb(output, "{:^{}c}", '.', column_width);
+            else
+                fmt::format_to_mb(output, "{:^{}c}", freq[row_no].first, column_width);
         }
         fmt::format_to_mb(output, "\n");
     }
@@ -83,13 +121,16 @@ std::string acmacs::seqdb::v3::subset_to_compare_base_t::format_summary(const st
     fmt::memory_buffer output;
     fmt::format_to_mb(output, "{}{:{}s}", prefix, name, name_width);
     for (size_t pp{0}; pp < positions.size(); ++pp) {
-        const auto pos{positions[pp]};
-        const auto aa_pairs{counters[*pos].pairs(counter_t::sorted::yes)};
+        const auto& aa_pairs{frequencies_at(positions[pp])};
+        if (aa_pairs.empty()) {
+            fmt::format_to_mb(output, "{:^{}c}", ' ', column_width);
+            continue;
+        }
         const auto total{static_cast<double>(std::accumulate(std::begin(aa_pairs), std::end(aa_pairs), 0ul, [](size_t sum, const auto& ap) { return sum + ap.second; }))};
         std::string aas{aa_pairs.front().first, ' ', ' '};
         size_t offset{1};
         for (auto aapp{std::next(std::begin(aa_pairs))}; aapp != std::end(aa_pairs); ++aapp) {
-            if ((static_cast<double>(aapp->second) / total) > threshold)
+            if ((static_cast<double>(aapp->second) / total) > threshold && offset < aas.size())
                 aas[offset++] = aapp->first;
         }
         if (most_frequent)
@@ -105,13 +146,9 @@ std::string acmacs::seqdb::v3::subset_to_compare_base_t::format_summary(const st
 
 void acmacs::seqdb::v3::subset_to_compare_t::make_counters(enum compare cmp_nuc_aa)
 {
-    for (const auto& ref : subset) {
-        const auto seq{aligned(ref, cmp_nuc_aa)};
-        if (counters.size() < *seq.size())
-            counters.resize(*seq.size());
-        for (pos0_t pos{0}; pos < seq.size(); ++pos)
-            counters[*pos].count(seq.at(pos));
-    }
+    std::vector<sequence_aligned_t> owned(subset.size());
+    std::transform(std::begin(subset), std::end(subset), std::begin(owned), [cmp_nuc_aa](const auto& ref) { return aligned(ref, cmp_nuc_aa); });
+    set_sequences(std::move(owned));
 
 } // acmacs::seqdb::v3::subset_to_compare_t::make_counters
 
@@ -135,11 +172,12 @@ acmacs::seqdb::sequence_aligned_t acmacs::seqdb::v3::subset_to_compare_t::aligne
 {
     if (!ref)
         throw local::sequence_no_found{};
+    static const auto& seqdb = acmacs::seqdb::get();
     switch (cmp_nuc_aa) {
         case acmacs::seqdb::compare::nuc:
-            return acmacs::seqdb::sequence_aligned_t{ref.nuc_aligned(acmacs::seqdb::get())};
+            return ref.nuc_aligned(seqdb);
         case acmacs::seqdb::compare::aa:
-            return acmacs::seqdb::sequence_aligned_t{ref.aa_aligned(acmacs::seqdb::get())};
+            return ref.aa_aligned(seqdb);
     }
     AD_ERROR("unreachable code");
     throw std::runtime_error{"unreachable code"}; // hey g++9
@@ -150,13 +188,10 @@ acmacs::seqdb::sequence_aligned_t acmacs::seqdb::v3::subset_to_compare_t::aligne
 
 void acmacs::seqdb::v3::subset_to_compare_selected_t::make_counters(enum compare cmp_nuc_aa)
 {
-    for (const auto [ag_no, ag] : selected) {
-        acmacs::seqdb::sequence_aligned_t seq{cmp_nuc_aa == acmacs::seqdb::compare::nuc ? ag->sequence_nuc() : ag->sequence_aa()};
-        if (counters.size() < *seq.size())
-            counters.resize(*seq.size());
-        for (pos0_t pos{0}; pos < seq.size(); ++pos)
-            counters[*pos].count(seq.at(pos));
-    }
+    std::vector<sequence_aligned_t> owned;
+    for (const auto [ag_no, ag] : selected)
+        owned.push_back(aligned(*ag, cmp_nuc_aa));
+    set_sequences(std::move(owned));
 
 } // acmacs::seqdb::v3::subset_to_compare_selected_t::make_counters
 
@@ -1,9 +1,9 @@
 #pragma once
 
-#include "acmacs-base/counter.hh"
-#include "acmacs-base/to-json.hh"
 #include "acmacs-base/read-file.hh"
 #include "seqdb-3/seqdb.hh"
+#include "seqdb-3/output-stream.hh"
+#include "seqdb-3/column-profile.hh"
 #include "acmacs-chart-2/selected-antigens-sera.hh"
 
 // ----------------------------------------------------------------------
@@ -14,11 +14,10 @@ namespace acmacs::seqdb::inline v3
 
     struct subset_to_compare_base_t
     {
-        using counter_t = acmacs::CounterCharSome<' ', '['>;
-        using counters_t = std::vector<counter_t>;
-
         std::string name;
-        counters_t counters;
+        column_profile_t profile;
+        std::vector<std::string_view> sequences;                  // aligned, in the order of elements of the subset, set by make_counters
+        std::vector<column_profile_t::frequencies_t> frequencies; // per position, most frequent first, set by make_counters
 
         subset_to_compare_base_t(std::string_view a_name) : name{a_name} {}
         subset_to_compare_base_t(const subset_to_compare_base_t&) = default;
@@ -26,14 +25,18 @@ namespace acmacs::seqdb::inline v3
         subset_to_compare_base_t& operator=(const subset_to_compare_base_t&) = default;
 
         virtual void make_counters(enum compare cmp_nuc_aa) = 0;
-        size_t max_counter_size() const
-        {
-            return std::accumulate(std::begin(counters), std::end(counters), size_t{0}, [](size_t max, const auto& counter) { return std::max(max, counter.size()); });
-        }
+        size_t max_counter_size() const;
+        const column_profile_t::frequencies_t& frequencies_at(pos0_t pos) const;
         std::vector<pos0_t> positions_to_report() const;
         std::string most_frequent(const std::vector<pos0_t>& positions) const;
         std::string format_summary(const std::vector<pos0_t>& positions, std::string_view prefix, size_t name_width, size_t column_width, const std::string* most_frequent = nullptr) const;
         std::string format_summary(const std::vector<pos0_t>& positions, std::string_view prefix, size_t name_width, size_t column_width, const std::string* most_frequent, double threshold) const;
+
+      protected:
+        std::shared_ptr<const std::vector<sequence_aligned_t>> owned_sequences_; // sequences (views) point into it, shared by copies
+
+        void make_profile(); // from sequences
+        void set_sequences(std::vector<sequence_aligned_t>&& owned); // and make profile
     };
 
     struct subset_to_compare_t : public subset_to_compare_base_t
@@ -50,7 +53,7 @@ namespace acmacs::seqdb::inline v3
         auto end() const { return subset.end(); }
         bool empty() const { return subset.empty(); }
 
-        static acmacs::seqdb::sequence_aligned_t aligned(const acmacs::seqdb::ref& ref, enum acmacs::seqdb::compare cmp_nuc_aa);
+        static acmacs::seqdb::sequence_aligned_t aligned(const acmacs::seqdb::ref& ref, enum acmacs::seqdb::compare cmp_nuc_aa); // decoded from seqdb
         static std::string seq_id(const acmacs::seqdb::ref& ref) { return *ref.seq_id(); }
     };
 
@@ -92,22 +95,18 @@ namespace acmacs::seqdb::inline v3
 
         std::vector<pos0_t> positions_to_report() const
         {
-            subset_to_compare_base_t::counters_t merged_counters; // (subsets.front().counters.size());
+            column_profile_t merged;
             for (const auto& ssc : subsets) {
-                if (!ssc.empty()) {
-                    if (merged_counters.size() < ssc.counters.size())
-                        merged_counters.resize(ssc.counters.size());
-                    for (size_t pos{0}; pos < ssc.counters.size(); ++pos)
-                        merged_counters[pos] = merge_CounterCharSome(merged_counters[pos], ssc.counters[pos]);
-                }
+                if (!ssc.empty())
+                    merged.merge(ssc.profile);
                 else
                     AD_WARNING("subset empty: {}", ssc.name);
             }
 
             std::vector<pos0_t> positions;
-            for (size_t pos{0}; pos < merged_counters.size(); ++pos) {
-                if (merged_counters[pos].size() > 1)
-                    positions.push_back(pos0_t{pos});
+            for (pos0_t pos{0}; pos < merged.size(); ++pos) {
+                if (merged.number_of_residues(pos) > 1)
+                    positions.push_back(pos);
             }
             return positions;
         }
@@ -148,39 +147,46 @@ namespace acmacs::seqdb::inline v3
             return fmt::to_string(output);
         }
 
-        std::string format_json(size_t indent) const
+        // json is streamed to filename while being generated, prefix (e.g. "const data =\n") is written before json
+        void write_json(std::string_view filename, std::string_view prefix = {}) const
         {
-            using namespace to_json;
-            using namespace std::string_view_literals;
-
             const auto positions{positions_to_report()};
-
-            const auto make_group_pos = [&positions](const subset_to_compare_base_t& group) {
-                const auto make_aa_counter = [](const auto& aap) { return object{key_val{"a"sv, std::string(1, aap.first)}, key_val{"c", aap.second}}; };
-                object result;
+            output_stream_t output{filename};
+            output.format("{}{{\n  \"pos1\": [", prefix);
+            for (auto pos = std::begin(positions); pos != std::end(positions); ++pos)
+                output.format("{}{}", pos == std::begin(positions) ? "" : ", ", **pos + 1);
+            output.format("],\n  \"groups\": [");
+            bool first_group{true};
+            for (const auto& group : subsets) {
+                output.format("{}\n    {{\n      \"name\": ", first_group ? "" : ",");
+                output.json_string(group.name);
+                output.format(",\n      \"pos1\": {{");
+                bool first_pos{true};
                 for (const auto pos : positions) {
-                    const auto aa_pairs{group.counters[*pos].pairs(subset_to_compare_base_t::counter_t::sorted::yes)};
-                    result << key_val{fmt::format("{}", pos), array{std::begin(aa_pairs), std::end(aa_pairs), make_aa_counter, array::compact_output::yes}};
+                    output.format("{}\"{}\": [", first_pos ? "" : ", ", pos);
+                    bool first_aa{true};
+                    for (const auto& [aa, count] : group.frequencies_at(pos)) {
+                        output.format("{}{{\"a\": \"{}\", \"c\": {}}}", first_aa ? "" : ", ", aa, count);
+                        first_aa = false;
+                    }
+                    output.format("]");
+                    first_pos = false;
                 }
-                return result;
-            };
-
-            const auto make_group = [this, make_group_pos](const Subset& group) {
-                const auto make_sequence = [this](const auto& ref) {
-                    return object{key_val{"id"sv, Subset::seq_id(ref)}, key_val{"seq"sv, fmt::format("{}", Subset::aligned(ref, cmp_nuc_aa))}};
-                };
-                return object{
-                    key_val{"name"sv, group.name},                                      //
-                    key_val{"pos1"sv, make_group_pos(group)},                           //
-                    key_val{"seq"sv, array{group.begin(), group.end(), make_sequence}}, //
-                };
-            };
-
-            const object data{
-                key_val{"pos1"sv, array{std::begin(positions), std::end(positions), [](pos0_t pos) { return *pos + 1; }, array::compact_output::yes}}, //
-                key_val{"groups"sv, array{subsets.begin(), subsets.end(), make_group}}                                                                 //
-            };
-            return fmt::format(fmt::runtime(fmt::format("{{:{}}}", indent)), data);
+                output.format("}},\n      \"seq\": [");
+                size_t seq_no{0};
+                for (const auto& ref : group) {
+                    output.format("{}\n        {{\"id\": ", seq_no == 0 ? "" : ",");
+                    output.json_string(Subset::seq_id(ref));
+                    output.format(", \"seq\": ");
+                    output.json_string(group.sequences[seq_no]);
+                    output.format("}}");
+                    ++seq_no;
+                }
+                output.format("\n      ]\n    }}");
+                first_group = false;
+            }
+            output.format("\n  ]\n}}\n");
+            output.close();
         }
     };
 
@@ -196,7 +202,7 @@ namespace acmacs::seqdb::inline v3
         const auto prefix{html_filename.substr(0, html_filename.size() - 5)};
         const auto data_filename{fmt::format("{}.data.js", prefix)};
         const auto data_var_name{fmt::format("compare_sequences_{}", ::string::replace(prefix, "/"sv, "_"sv, "-"sv, "_"sv, "."sv, "_"sv))};
-        acmacs::file::write(data_filename, fmt::format("const {} =\n{}", data_var_name, data.format_json(2)));
+        data.write_json(data_filename, fmt::format("const {} =\n", data_var_name));
 
         std::string data_filename_name{data_filename};
         if (const auto pos = std::string_view{data_filename}.find_last_of('/'); pos != std::string_view::npos)
@@ -1,10 +1,14 @@
 #include <memory>
+#include <map>
+#include <span>
 
 #include "acmacs-base/to-json.hh"
 #include "acmacs-base/read-file.hh"
 #include "acmacs-base/range-v3.hh"
 #include "seqdb-3/create.hh"
 #include "seqdb-3/scan-fasta.hh"
+#include "seqdb-3/seqdb.hh"
+#include "seqdb-3/output-stream.hh"
 
 // ----------------------------------------------------------------------
 
@@ -212,6 +216,207 @@ void generate(std::string_view filename, const std::vector<acmacs::seqdb::scan::
 
 } // generate
 
+// ----------------------------------------------------------------------
+
+namespace local::seqdb4
+{
+    // writes json object, values are views into the json text of seqdb, i.e. already escaped
+    class object_t
+    {
+      public:
+        object_t(acmacs::seqdb::output_stream_t& output) : output_{output} { output_.write("{"); }
+        void close() { output_.write("}"); }
+
+        void key(std::string_view key)
+        {
+            output_.write(first_ ? "\"" : ",\"");
+            output_.write(key);
+            output_.write("\":");
+            first_ = false;
+        }
+
+        void string(std::string_view key, std::string_view value)
+        {
+            if (!value.empty()) {
+                this->key(key);
+                quoted(value);
+            }
+        }
+
+        void array(std::string_view key, std::span<const std::string_view> values) // written even if empty
+        {
+            this->key(key);
+            output_.write("[");
+            for (auto it = std::begin(values); it != std::end(values); ++it) {
+                if (it != std::begin(values))
+                    output_.write(",");
+                quoted(*it);
+            }
+            output_.write("]");
+        }
+
+        void strings(std::string_view key, std::span<const std::string_view> values)
+        {
+            if (!values.empty())
+                array(key, values);
+        }
+
+        void integer(std::string_view key, long value)
+        {
+            if (value != 0) {
+                this->key(key);
+                output_.format("{}", value);
+            }
+        }
+
+      private:
+        acmacs::seqdb::output_stream_t& output_;
+        bool first_{true};
+
+        void quoted(std::string_view value)
+        {
+            output_.write("\"");
+            output_.write(value);
+            output_.write("\"");
+        }
+    };
+
+    inline bool has_subtype_prefix(std::string_view name) { return name.size() > 1 && (name[0] == 'A' || name[0] == 'a' || name[0] == 'B' || name[0] == 'b') && (name[1] == '/' || name[1] == '('); }
+
+    inline std::string issues(const acmacs::seqdb::sequence::issues_t& source)
+    {
+        std::string result;
+        for (size_t iss{0}; iss < acmacs::seqdb::sequence::number_of_issues; ++iss) {
+            if (source.test(iss))
+                result.push_back(acmacs::seqdb::sequence::issue_name_char[iss]);
+        }
+        return result;
+    }
+
+    inline void sequence(object_t& target, const acmacs::seqdb::SeqdbSeq& seq)
+    {
+        target.string("H", seq.hash);
+        target.string("a", seq.amino_acids.text());
+        target.integer("s", seq.amino_acids.shift.as_number());
+        target.string("n", seq.nucs.text());
+        target.integer("t", seq.nucs.shift.as_number());
+        target.strings("c", seq.clades);
+        target.string("i", issues(seq.issues));
+    }
+
+    // entries are put into shards by their virus type
+    inline std::string master_shard(const acmacs::seqdb::SeqdbEntry& entry, const acmacs::seqdb::SeqdbSeq& seq, const acmacs::seqdb::Seqdb& seqdb)
+    {
+        for (auto [first, last] = seqdb.hash_index().find(seq.master.hash_value); first != last; ++first) {
+            if (first->entry->name == seq.master.name)
+                return acmacs::seqdb::seqdb4_shard(first->entry->virus_type);
+        }
+        throw std::runtime_error{fmt::format("seqdb-4: master of a sequence of {} not found: {} {}", entry.name, seq.master.name, seq.master.hash)};
+    }
+
+    void write(std::string_view filename, std::string_view shard, const std::vector<const acmacs::seqdb::SeqdbEntry*>& entries, const acmacs::seqdb::Seqdb& seqdb)
+    {
+        // the most common virus type is the subtype of the shard, it is not stored in names and entries
+        std::map<std::string_view, size_t> virus_types;
+        for (const auto* entry : entries)
+            ++virus_types[entry->virus_type];
+        const std::string_view subtype = std::max_element(std::begin(virus_types), std::end(virus_types), [](const auto& e1, const auto& e2) { return e1.second < e2.second; })->first;
+        const std::string name_prefix = fmt::format("{}/", subtype);
+
+        acmacs::seqdb::output_stream_t output{filename, 0};
+        output.format("{{\"_\": \"-*- js-indent-level: 1 -*-\",\n \"  version\": \"sequence-database-v4\",\n \"  date\": \"{}\",\n \"size\": {},\n \"subtype\": \"{}\",\n \"data\": [\n", date::current_date_time(),
+                      entries.size(), subtype);
+        size_t num_sequences{0};
+        for (auto entry_it = std::begin(entries); entry_it != std::end(entries); ++entry_it) {
+            const auto& entry = **entry_it;
+            if (entry_it != std::begin(entries))
+                output.write(",\n");
+            object_t target{output};
+            if (entry.name.starts_with(name_prefix) && !has_subtype_prefix(entry.name.substr(name_prefix.size())))
+                target.string("N", entry.name.substr(name_prefix.size()));
+            else
+                target.string("N", entry.name); // with its own subtype prefix
+            if (entry.virus_type != subtype)
+                target.string("v", entry.virus_type);
+            target.strings("d", entry.dates);
+            target.string("C", entry.continent);
+            target.string("c", entry.country);
+            if (entry.lineage == "VICTORIA")
+                target.string("l", "V");
+            else if (entry.lineage == "YAMAGATA")
+                target.string("l", "Y");
+            else
+                target.string("l", entry.lineage);
+
+            target.key("s");
+            output.write("[");
+            for (auto seq_it = std::begin(entry.seqs); seq_it != std::end(entry.seqs); ++seq_it) {
+                const auto& seq = *seq_it;
+                if (seq_it != std::begin(entry.seqs))
+                    output.write(",");
+                object_t target_seq{output};
+                if (seq.is_master()) {
+                    sequence(target_seq, seq);
+                }
+                else {
+                    target_seq.key("R");
+                    object_t reference{output};
+                    reference.string("N", seq.master.name);
+                    reference.string("H", seq.master.hash);
+                    // master is in another shard, reader loads that shard too
+                    if (const auto shard_of_master = master_shard(entry, seq, seqdb); shard_of_master != shard)
+                        reference.string("S", shard_of_master);
+                    reference.close();
+                }
+                target_seq.string("A", seq.annotations);
+                target_seq.strings("r", seq.reassortants);
+                target_seq.strings("p", seq.passages);
+                target_seq.strings("h", seq.hi_names);
+                if (!seq.lab_ids.empty()) {
+                    target_seq.key("l");
+                    object_t labs{output};
+                    for (const auto& [lab, lab_ids] : seq.lab_ids)
+                        labs.array(lab, lab_ids);
+                    labs.close();
+                }
+                if (!seq.gisaid.isolate_ids.empty() || !seq.gisaid.sample_ids_by_sample_provider.empty()) {
+                    target_seq.key("G");
+                    object_t gisaid{output};
+                    gisaid.strings("i", seq.gisaid.isolate_ids);
+                    gisaid.strings("s", seq.gisaid.sample_ids_by_sample_provider);
+                    gisaid.close();
+                }
+                target_seq.close();
+                ++num_sequences;
+            }
+            output.write("]");
+            target.close();
+        }
+        output.write("\n ]\n}\n");
+        output.close();
+        fmt::print("INFO: {} sequences ({} entries) written to {}\n", num_sequences, entries.size(), filename);
+    }
+
+} // namespace local::seqdb4
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::create_seqdb4(std::string_view directory, const Seqdb& seqdb)
+{
+    std::map<std::string, std::vector<const SeqdbEntry*>> shards; // entries in the seqdb order (sorted by name)
+    for (const auto& ref : seqdb.all()) {
+        if (ref.seq_index != 0)
+            continue;
+        if (local::seqdb4::has_subtype_prefix(ref.entry->name))
+            shards[seqdb4_shard(ref.entry->virus_type)].push_back(ref.entry);
+        else // reader restores subtype prefix of names without it
+            AD_WARNING("seqdb-4: \"{}\" has no subtype prefix, not written", ref.entry->name);
+    }
+    for (const auto& [shard, entries] : shards)
+        local::seqdb4::write(seqdb4_filename(directory, shard), shard, entries, seqdb);
+
+} // acmacs::seqdb::v3::create_seqdb4
+
 // ----------------------------------------------------------------------
 /// Local Variables:
 /// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
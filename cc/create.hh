@@ -10,11 +10,15 @@ namespace acmacs::seqdb
     inline namespace v3
     {
         namespace scan::fasta { struct scan_result_t; }
+        class Seqdb;
 
         enum class create_dbs { all, whocc_only };
 
         void create(std::string_view prefix, std::vector<scan::fasta::scan_result_t>& sequences, create_dbs cdb = create_dbs::all);
 
+        // writes seqdb-4 (doc/seqdb4-format.json) into directory, one file per HA subtype (see seqdb4_shard())
+        void create_seqdb4(std::string_view directory, const Seqdb& seqdb);
+
     } // namespace v3
 } // namespace acmacs::seqdb
 
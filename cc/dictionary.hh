@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    using dictionary_code_t = uint32_t;
+
+    // Distinct values of a categorical field (country, lab, clade, etc.) with dense codes in the order of first occurrence.
+    // Values are copied, views returned by operator[] stay valid for the lifetime of the dictionary.
+    class dictionary_t
+    {
+      public:
+        static constexpr dictionary_code_t not_found{std::numeric_limits<dictionary_code_t>::max()};
+
+        dictionary_code_t intern(std::string_view value)
+        {
+            if (const auto found = codes_.find(value); found != codes_.end())
+                return found->second;
+            const auto code = static_cast<dictionary_code_t>(values_.size());
+            codes_.emplace(values_.emplace_back(value), code);
+            return code;
+        }
+
+        dictionary_code_t find(std::string_view value) const
+        {
+            if (const auto found = codes_.find(value); found != codes_.end())
+                return found->second;
+            return not_found;
+        }
+
+        std::string_view operator[](dictionary_code_t code) const { return values_[code]; }
+        size_t size() const { return values_.size(); }
+
+      private:
+        std::deque<std::string> values_;                              // deque: elements are not moved on insertion, codes_ keys are views into them
+        std::unordered_map<std::string_view, dictionary_code_t> codes_;
+    };
+
+    // dictionaries of the fields of SeqdbEntry and SeqdbSeq, built on loading seqdb
+    struct dictionaries_t
+    {
+        dictionary_t virus_types;
+        dictionary_t lineages;
+        dictionary_t continents;
+        dictionary_t countries;
+        dictionary_t labs;
+        dictionary_t clades;
+    };
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
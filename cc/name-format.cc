@@ -0,0 +1,220 @@
+#include <array>
+#include <algorithm>
+
+#include "acmacs-base/string.hh"
+#include "acmacs-base/string-join.hh"
+#include "seqdb-3/name-format.hh"
+#include "seqdb-3/seqdb.hh"
+
+// ----------------------------------------------------------------------
+
+namespace local
+{
+    using field_t = acmacs::seqdb::name_format_t::field_t;
+    using namespace std::string_view_literals;
+
+    constexpr std::array fields{
+        std::pair{"seq_id"sv, field_t::seq_id},
+        std::pair{"hash"sv, field_t::hash},
+        std::pair{"full_name"sv, field_t::full_name},
+        std::pair{"hi_name_or_full_name"sv, field_t::hi_name_or_full_name},
+        std::pair{"hi_names"sv, field_t::hi_names},
+        std::pair{"hi_name"sv, field_t::hi_name},
+        std::pair{"lineage"sv, field_t::lineage},
+        std::pair{"name"sv, field_t::name},
+        std::pair{"date"sv, field_t::date},
+        std::pair{"dates"sv, field_t::dates},
+        std::pair{"lab_id"sv, field_t::lab_id},
+        std::pair{"passage"sv, field_t::passage},
+        std::pair{"clades"sv, field_t::clades},
+        std::pair{"lab"sv, field_t::lab},
+        std::pair{"country"sv, field_t::country},
+        std::pair{"continent"sv, field_t::continent},
+        std::pair{"group_no"sv, field_t::group_no},
+        std::pair{"hamming_distance"sv, field_t::hamming_distance},
+        std::pair{"nuc_length"sv, field_t::nuc_length},
+        std::pair{"aa_length"sv, field_t::aa_length},
+        std::pair{"gisaid_accession_numbers"sv, field_t::gisaid_accession_numbers},
+        std::pair{"ncbi_accession_numbers"sv, field_t::ncbi_accession_numbers},
+        std::pair{"issues"sv, field_t::issues},
+        std::pair{"nuc"sv, field_t::nuc},
+        std::pair{"aa"sv, field_t::aa},
+    };
+
+    template <typename Value> inline void put(fmt::memory_buffer& out, const std::string& spec, const Value& value)
+    {
+        if (spec.empty())
+            fmt::format_to(std::back_inserter(out), "{}", value);
+        else
+            fmt::format_to(std::back_inserter(out), fmt::runtime(spec), value);
+    }
+
+    inline void put(fmt::memory_buffer& out, const std::string& spec, std::string_view value)
+    {
+        if (spec.empty())
+            out.append(value);
+        else
+            fmt::format_to(std::back_inserter(out), fmt::runtime(spec), value);
+    }
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::name_format_t::name_format_t(std::string_view format)
+{
+    const auto nf = ::string::replace(::string::replace(format, "\\t", "\t"), "\\n", "\n");
+    const std::string_view source{nf};
+    for (size_t pos{0}; pos < source.size();) {
+        if (source.substr(pos, 2) == "{{" || source.substr(pos, 2) == "}}") {
+            add_literal(source.substr(pos, 1));
+            pos += 2;
+        }
+        else if (source[pos] == '{') {
+            if (const auto end = source.find('}', pos); end != std::string_view::npos) {
+                const auto inside = source.substr(pos + 1, end - pos - 1);
+                const auto name = inside.substr(0, inside.find(':'));
+                if (const auto found = std::find_if(std::begin(local::fields), std::end(local::fields), [name](const auto& en) { return en.first == name; }); found != std::end(local::fields))
+                    ops_.push_back(op_t{found->second, name.size() < inside.size() ? fmt::format("{{{}}}", inside.substr(name.size())) : std::string{}});
+                else
+                    add_literal(source.substr(pos, end - pos + 1));
+                pos = end + 1;
+            }
+            else {
+                add_literal(source.substr(pos));
+                pos = source.size();
+            }
+        }
+        else {
+            const auto end = std::min(source.find_first_of("{}", pos + 1), source.size());
+            add_literal(source.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+
+} // acmacs::seqdb::v3::name_format_t::name_format_t
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::name_format_t::add_literal(std::string_view text)
+{
+    if (!ops_.empty() && ops_.back().field == field_t::literal)
+        ops_.back().text.append(text);
+    else
+        ops_.push_back(op_t{field_t::literal, std::string{text}});
+
+} // acmacs::seqdb::v3::name_format_t::add_literal
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::name_format_t::format_to(fmt::memory_buffer& out, const Seqdb& seqdb, const subset& sub, const ref& entry) const
+{
+    const SeqdbSeq* with_sequence{nullptr}; // master lookup is done on demand and at most once
+    const auto seq_with_sequence = [&with_sequence, &seqdb, &entry]() -> const SeqdbSeq& {
+        if (!with_sequence)
+            with_sequence = &entry.seq_with_sequence(seqdb);
+        return *with_sequence;
+    };
+
+    for (const auto& op : ops_) {
+        switch (op.field) {
+            case field_t::literal:
+                out.append(op.text);
+                break;
+            case field_t::seq_id:
+                local::put(out, op.text, entry.seq_id());
+                break;
+            case field_t::hash:
+                local::put(out, op.text, seq_with_sequence().hash);
+                break;
+            case field_t::full_name:
+                local::put(out, op.text, entry.full_name());
+                break;
+            case field_t::hi_name_or_full_name:
+                local::put(out, op.text, entry.hi_name_or_full_name());
+                break;
+            case field_t::hi_names:
+                local::put(out, op.text, entry.seq().hi_names);
+                break;
+            case field_t::hi_name:
+                local::put(out, op.text, !entry.seq().hi_names.empty() ? entry.seq().hi_names.front() : std::string_view{});
+                break;
+            case field_t::lineage:
+                local::put(out, op.text, entry.entry->lineage);
+                break;
+            case field_t::name:
+                local::put(out, op.text, entry.entry->name);
+                break;
+            case field_t::date:
+                local::put(out, op.text, entry.entry->date());
+                break;
+            case field_t::dates:
+                local::put(out, op.text, entry.entry->dates);
+                break;
+            case field_t::lab_id:
+                local::put(out, op.text, entry.seq().lab_id());
+                break;
+            case field_t::passage:
+                local::put(out, op.text, entry.seq().passage());
+                break;
+            case field_t::clades:
+                local::put(out, op.text, seq_with_sequence().clades);
+                break;
+            case field_t::lab:
+                local::put(out, op.text, entry.seq().lab());
+                break;
+            case field_t::country:
+                local::put(out, op.text, entry.entry->country);
+                break;
+            case field_t::continent:
+                local::put(out, op.text, entry.entry->continent);
+                break;
+            case field_t::group_no:
+                if (const auto group_no = sub.group_no_of(entry); group_no)
+                    local::put(out, op.text, fmt::format("group:{}", group_no));
+                else
+                    local::put(out, op.text, std::string_view{});
+                break;
+            case field_t::hamming_distance:
+                local::put(out, op.text, sub.hamming_distance_of(entry));
+                break;
+            case field_t::nuc_length:
+                local::put(out, op.text, seq_with_sequence().nuc_aligned_length_master());
+                break;
+            case field_t::aa_length:
+                local::put(out, op.text, seq_with_sequence().aa_aligned_length_master());
+                break;
+            case field_t::gisaid_accession_numbers:
+                local::put(out, op.text, acmacs::string::join(acmacs::string::join_sep_t{"|"}, entry.seq().gisaid.isolate_ids));
+                break;
+            case field_t::ncbi_accession_numbers:
+                local::put(out, op.text, acmacs::string::join(acmacs::string::join_sep_t{"|"}, entry.seq().gisaid.sample_ids_by_sample_provider));
+                break;
+            case field_t::issues:
+                local::put(out, op.text, fmt::format("{}", seq_with_sequence().issues));
+                break;
+            case field_t::nuc:
+                local::put(out, op.text, seq_with_sequence().nuc_aligned_master());
+                break;
+            case field_t::aa:
+                local::put(out, op.text, seq_with_sequence().aa_aligned_master());
+                break;
+        }
+    }
+
+} // acmacs::seqdb::v3::name_format_t::format_to
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::name_format_t::format(const Seqdb& seqdb, const subset& sub, const ref& entry) const
+{
+    fmt::memory_buffer out;
+    format_to(out, seqdb, sub, entry);
+    return fmt::to_string(out);
+
+} // acmacs::seqdb::v3::name_format_t::format
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
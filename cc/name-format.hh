@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "acmacs-base/fmt.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    class Seqdb;
+    class subset;
+    struct ref;
+
+    // name format (e.g. "{seq_id}\t{aa:193:6}") compiled once into a list of literal and field-fetch ops,
+    // formatting a ref evaluates just the fields referenced in the format
+    // unknown fields are kept in the output as is, "\t" and "\n" in the format are replaced with tab and newline
+    class name_format_t
+    {
+      public:
+        name_format_t(std::string_view format);
+
+        void format_to(fmt::memory_buffer& out, const Seqdb& seqdb, const subset& sub, const ref& entry) const;
+        std::string format(const Seqdb& seqdb, const subset& sub, const ref& entry) const;
+
+        enum class field_t {
+            literal,
+            seq_id,
+            hash,
+            full_name,
+            hi_name_or_full_name,
+            hi_names,
+            hi_name,
+            lineage,
+            name,
+            date,
+            dates,
+            lab_id,
+            passage,
+            clades,
+            lab,
+            country,
+            continent,
+            group_no,
+            hamming_distance,
+            nuc_length,
+            aa_length,
+            gisaid_accession_numbers,
+            ncbi_accession_numbers,
+            issues,
+            nuc,
+            aa
+        };
+
+      private:
+        struct op_t
+        {
+            field_t field;
+            std::string text; // literal: text to output, field: fmt format with the spec from the name format (e.g. "{:193:6}"), empty if there is no spec
+        };
+
+        std::vector<op_t> ops_;
+
+        void add_literal(std::string_view text);
+    };
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
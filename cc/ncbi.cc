@@ -1,4 +1,8 @@
 #include <map>
+#include <unordered_map>
+#include <numeric>
+#include <limits>
+#include <exception>
 #include "acmacs-base/regex.hh"
 #include "acmacs-base/timeit.hh"
 #include "acmacs-base/read-file.hh"
@@ -7,6 +11,7 @@
 #include "acmacs-base/string-compare.hh"
 #include "acmacs-base/bits.hh"
 #include "acmacs-virus/defines.hh"
+#include "locationdb/locdb.hh"
 #include "seqdb-3/scan-fasta.hh"
 
 // ----------------------------------------------------------------------
@@ -40,6 +45,16 @@ static void read_influenza_fna(acmacs::seqdb::v3::scan::fasta::scan_results_t& r
 static date::year_month_day parse_date(std::string_view source, std::string_view filename, size_t line_no);
 static void merge_dat_fna_names(acmacs::seqdb::v3::scan::fasta::scan_result_t& dat_result, acmacs::messages::messages_t& messages, std::string_view fna_name, const acmacs::messages::position_t& fna_pos);
 
+// decompressed influenza_na.dat and influenza.fna are split into chunks parsed in parallel, results are merged in the chunk order
+struct chunk_t
+{
+    size_t first;
+    size_t last;
+    size_t line_no; // of the first line in the chunk
+};
+
+static std::vector<chunk_t> split_into_chunks(std::string_view source, std::string_view record_separator);
+
 // ----------------------------------------------------------------------
 
 acmacs::seqdb::v3::scan::fasta::scan_results_t acmacs::seqdb::v3::scan::fasta::scan_ncbi(const std::string_view directory, const scan_options_t& options)
@@ -290,29 +305,79 @@ date::year_month_day parse_date(std::string_view source, std::string_view filena
 
 // ----------------------------------------------------------------------
 
+std::vector<chunk_t> split_into_chunks(std::string_view source, std::string_view record_separator)
+{
+    constexpr size_t chunk_size = 4 * 1024 * 1024;
+
+    std::vector<chunk_t> chunks;
+    for (size_t first = 0; first < source.size();) {
+        size_t last = source.size();
+        if ((first + chunk_size) < source.size()) {
+            if (const auto separator = source.find(record_separator, first + chunk_size); separator != std::string_view::npos)
+                last = separator + 1; // chunk ends with '\n'
+        }
+        chunks.push_back(chunk_t{first, last, 1});
+        first = last;
+    }
+
+    std::vector<size_t> lines_in_chunk(chunks.size());
+#pragma omp parallel for default(shared) schedule(static, 1)
+    for (size_t chunk_no = 0; chunk_no < chunks.size(); ++chunk_no)
+        lines_in_chunk[chunk_no] = static_cast<size_t>(std::count(std::next(source.begin(), static_cast<ssize_t>(chunks[chunk_no].first)), std::next(source.begin(), static_cast<ssize_t>(chunks[chunk_no].last)), '\n'));
+    for (size_t chunk_no = 1; chunk_no < chunks.size(); ++chunk_no)
+        chunks[chunk_no].line_no = chunks[chunk_no - 1].line_no + lines_in_chunk[chunk_no - 1];
+
+    return chunks;
+
+} // split_into_chunks
+
+// ----------------------------------------------------------------------
+
 acmacs::seqdb::v3::scan::fasta::scan_results_t read_influenza_na_dat(const std::string_view directory, const acmacs::seqdb::v3::scan::fasta::scan_options_t& options)
 {
     using namespace acmacs::seqdb::v3::scan::fasta;
 
-    scan_results_t results;
+    acmacs::locationdb::get(); // load locbd outside of threading code, it is not thread safe
 
     const auto filename_dat = fmt::format("{}/influenza_na.dat.xz", directory);
     const std::string influenza_na_dat = acmacs::file::read(filename_dat);
     // AD_DEBUG("influenza_na_dat: {}", influenza_na_dat.size());
 
-    auto cur = std::begin(influenza_na_dat);
-    const auto end = std::end(influenza_na_dat);
-    for (size_t line_no = 1; cur != end; ++line_no) {
-        if (auto scan_result = read_influenza_na_dat_entry(cur, end, results.messages, filename_dat, line_no); scan_result.has_value()) {
-            auto messages = normalize_name(*scan_result, options.dbg, scan_name_adjustments::ncbi, options.prnt_names);
-            // fmt::print("{:4d} {:8s} \"{}\" {} {}\n", line_no, *res->fasta.type_subtype, res->fasta.name, res->fasta.country, res->sequence.sample_id_by_sample_provider());
-            if (scan_result->fasta.type_subtype.empty() && !scan_result->sequence.name().empty())
-                scan_result->fasta.type_subtype = acmacs::virus::v2::type_subtype_t{std::string(1, scan_result->sequence.name()->front())};
-
-            results.results.push_back(std::move(*scan_result));
-            acmacs::messages::move_and_add_source(results.messages, std::move(messages), acmacs::messages::position_t{filename_dat, line_no});
+    // one line per entry
+    const auto chunks = split_into_chunks(influenza_na_dat, "\n");
+    std::vector<scan_results_t> results_per_chunk(chunks.size());
+    std::vector<std::exception_ptr> errors(chunks.size()); // exceptions cannot leave parallel region, re-thrown after it
+#pragma omp parallel for default(shared) schedule(dynamic, 1)
+    for (size_t chunk_no = 0; chunk_no < chunks.size(); ++chunk_no) try {
+        auto& results = results_per_chunk[chunk_no];
+        auto cur = std::next(std::begin(influenza_na_dat), static_cast<ssize_t>(chunks[chunk_no].first));
+        const auto end = std::next(std::begin(influenza_na_dat), static_cast<ssize_t>(chunks[chunk_no].last));
+        for (size_t line_no = chunks[chunk_no].line_no; cur != end; ++line_no) {
+            if (auto scan_result = read_influenza_na_dat_entry(cur, end, results.messages, filename_dat, line_no); scan_result.has_value()) {
+                auto messages = normalize_name(*scan_result, options.dbg, scan_name_adjustments::ncbi, options.prnt_names);
+                // fmt::print("{:4d} {:8s} \"{}\" {} {}\n", line_no, *res->fasta.type_subtype, res->fasta.name, res->fasta.country, res->sequence.sample_id_by_sample_provider());
+                if (scan_result->fasta.type_subtype.empty() && !scan_result->sequence.name().empty())
+                    scan_result->fasta.type_subtype = acmacs::virus::v2::type_subtype_t{std::string(1, scan_result->sequence.name()->front())};
+
+                results.results.push_back(std::move(*scan_result));
+                acmacs::messages::move_and_add_source(results.messages, std::move(messages), acmacs::messages::position_t{filename_dat, line_no});
+            }
         }
     }
+    catch (...) {
+        errors[chunk_no] = std::current_exception();
+    }
+    for (const auto& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    scan_results_t results;
+    results.results.reserve(std::accumulate(std::begin(results_per_chunk), std::end(results_per_chunk), size_t{0}, [](size_t sum, const auto& en) { return sum + en.results.size(); }));
+    for (auto& chunk_results : results_per_chunk) {
+        std::move(std::begin(chunk_results.results), std::end(chunk_results.results), std::back_inserter(results.results));
+        acmacs::messages::move(results.messages, std::move(chunk_results.messages));
+    }
     AD_INFO("{} HA entries found in \"{}\"", results.results.size(), filename_dat);
 
     return results;
@@ -504,27 +569,103 @@ void read_influenza_fna(acmacs::seqdb::v3::scan::fasta::scan_results_t& results,
 {
     using namespace acmacs::seqdb::v3::scan::fasta;
 
-    std::map<std::string, scan_result_t*, std::less<>> ncbi_id_to_entry;
-    for (auto& en : results.results)
-        ncbi_id_to_entry[en.sequence.sample_id_by_sample_provider().front()] = &en;
+    acmacs::locationdb::get(); // load locbd outside of threading code, it is not thread safe
+
+    // ncbi id -> index in results.results, the last entry wins for duplicating ids
+    // entries are bucketed by partition (in the entry order), then each thread fills its own partition
+    constexpr size_t number_of_partitions = 64;
+    std::vector<size_t> partition_of_entry(results.results.size());
+#pragma omp parallel for default(shared) schedule(static, 4096)
+    for (size_t entry_no = 0; entry_no < results.results.size(); ++entry_no)
+        partition_of_entry[entry_no] = std::hash<std::string_view>{}(results.results[entry_no].sequence.sample_id_by_sample_provider().front()) % number_of_partitions;
+    std::vector<std::vector<size_t>> entries_of_partition(number_of_partitions);
+    for (size_t entry_no = 0; entry_no < results.results.size(); ++entry_no)
+        entries_of_partition[partition_of_entry[entry_no]].push_back(entry_no);
+    std::vector<std::unordered_map<std::string_view, size_t>> ncbi_id_to_entry(number_of_partitions);
+#pragma omp parallel for default(shared) schedule(dynamic, 1)
+    for (size_t partition_no = 0; partition_no < number_of_partitions; ++partition_no) {
+        auto& partition = ncbi_id_to_entry[partition_no];
+        partition.reserve(entries_of_partition[partition_no].size());
+        for (const auto entry_no : entries_of_partition[partition_no])
+            partition[results.results[entry_no].sequence.sample_id_by_sample_provider().front()] = entry_no;
+    }
+    const auto find_entry = [&ncbi_id_to_entry](std::string_view ncbi_id) -> size_t {
+        const auto& partition = ncbi_id_to_entry[std::hash<std::string_view>{}(ncbi_id) % number_of_partitions];
+        if (const auto found = partition.find(ncbi_id); found != partition.end())
+            return found->second;
+        return std::numeric_limits<size_t>::max();
+    };
 
     const auto filename_fna = fmt::format("{}/influenza.fna.xz", directory);
     const std::string influenza_fna_s = acmacs::file::read(filename_fna);
     const std::string_view influenza_fna(influenza_fna_s);
     // AD_DEBUG("influenza_fna: {}", influenza_fna.size());
 
-    scan_input_t file_input{influenza_fna.begin(), influenza_fna.end()};
-    while (!file_input.done()) {
-        scan_output_t sequence_ref;
-        std::tie(file_input, sequence_ref) = scan(file_input);
-        const acmacs::messages::position_t fna_pos{filename_fna, file_input.name_line_no};
-        if (const auto fields_fna = acmacs::string::split(sequence_ref.name, "|"); fields_fna.size() == 5) {
-            if (const auto found = ncbi_id_to_entry.find(fields_fna[3]); found != ncbi_id_to_entry.end() && import_sequence(sequence_ref.sequence, found->second->sequence, options))
-                merge_dat_fna_names(*found->second, results.messages, fields_fna[4], fna_pos);
+    struct fna_record_t
+    {
+        std::string_view sequence;
+        std::string_view name;
+        size_t name_line_no;
+        size_t entry_no;
+        acmacs::messages::messages_t messages;
+    };
+
+    const auto chunks = split_into_chunks(influenza_fna, "\n>");
+    std::vector<std::vector<fna_record_t>> records_per_chunk(chunks.size());
+    std::vector<std::exception_ptr> errors(chunks.size()); // exceptions cannot leave parallel region, re-thrown after it
+#pragma omp parallel for default(shared) schedule(dynamic, 1)
+    for (size_t chunk_no = 0; chunk_no < chunks.size(); ++chunk_no) try {
+        scan_input_t file_input{std::next(influenza_fna.begin(), static_cast<ssize_t>(chunks[chunk_no].first)), std::next(influenza_fna.begin(), static_cast<ssize_t>(chunks[chunk_no].last)),
+                                chunks[chunk_no].line_no};
+        while (!file_input.done()) {
+            scan_output_t sequence_ref;
+            std::tie(file_input, sequence_ref) = scan(file_input);
+            auto& record = records_per_chunk[chunk_no].emplace_back(fna_record_t{sequence_ref.sequence, {}, file_input.name_line_no, std::numeric_limits<size_t>::max(), {}});
+            if (const auto fields_fna = acmacs::string::split(sequence_ref.name, "|"); fields_fna.size() == 5) {
+                record.name = fields_fna[4];
+                record.entry_no = find_entry(fields_fna[3]);
+            }
+            else
+                record.messages.emplace_back(acmacs::messages::key::ncbi_unrecognized_fna_name, sequence_ref.name, acmacs::messages::position_t{filename_fna, record.name_line_no}, MESSAGE_CODE_POSITION);
+        }
+    }
+    catch (...) {
+        errors[chunk_no] = std::current_exception();
+    }
+    for (const auto& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    std::vector<fna_record_t> records;
+    for (auto& chunk_records : records_per_chunk)
+        std::move(std::begin(chunk_records), std::end(chunk_records), std::back_inserter(records));
+
+    // records referring to the same dat entry are applied in the file order by the same thread
+    std::vector<size_t> by_entry(records.size());
+    std::iota(std::begin(by_entry), std::end(by_entry), 0);
+    std::stable_sort(std::begin(by_entry), std::end(by_entry), [&records](size_t r1, size_t r2) { return records[r1].entry_no < records[r2].entry_no; });
+    const auto matched_end = static_cast<size_t>(
+        std::partition_point(std::begin(by_entry), std::end(by_entry), [&records](size_t record_no) { return records[record_no].entry_no != std::numeric_limits<size_t>::max(); }) -
+        std::begin(by_entry));
+    std::vector<size_t> entry_starts;
+    for (size_t no = 0; no < matched_end; ++no) {
+        if (no == 0 || records[by_entry[no]].entry_no != records[by_entry[no - 1]].entry_no)
+            entry_starts.push_back(no);
+    }
+    entry_starts.push_back(matched_end);
+
+#pragma omp parallel for default(shared) schedule(dynamic, 256)
+    for (size_t start_no = 0; start_no < (entry_starts.size() - 1); ++start_no) {
+        for (size_t no = entry_starts[start_no]; no < entry_starts[start_no + 1]; ++no) {
+            auto& record = records[by_entry[no]];
+            if (auto& dat_result = results.results[record.entry_no]; import_sequence(record.sequence, dat_result.sequence, options))
+                merge_dat_fna_names(dat_result, record.messages, record.name, acmacs::messages::position_t{filename_fna, record.name_line_no});
         }
-        else
-            results.messages.emplace_back(acmacs::messages::key::ncbi_unrecognized_fna_name, sequence_ref.name, fna_pos, MESSAGE_CODE_POSITION);
     }
+
+    for (auto& record : records)
+        acmacs::messages::move(results.messages, std::move(record.messages));
 }
 
 // ----------------------------------------------------------------------
@@ -0,0 +1,234 @@
+#include <cstring>
+#include <cerrno>
+#include <array>
+#include <algorithm>
+#include <lzma.h>
+#include <zlib.h>
+#include <bzlib.h>
+
+#include "seqdb-3/output-stream.hh"
+
+// ----------------------------------------------------------------------
+
+struct acmacs::seqdb::v3::output_stream_t::compressor_t
+{
+    compressor_t() = default;
+    compressor_t(const compressor_t&) = delete;
+    virtual ~compressor_t() = default;
+    compressor_t& operator=(const compressor_t&) = delete;
+
+    // compresses input and writes compressed data to the output file, finish: input is the last chunk, compressed stream is completed
+    virtual void compress(output_stream_t& output, std::string_view input, bool finish) = 0;
+
+  protected:
+    std::array<uint8_t, 0x10000> buffer;
+
+    void write(output_stream_t& output, size_t size) { output.write_file(reinterpret_cast<const char*>(buffer.data()), size); }
+    [[noreturn]] static void failed(const output_stream_t& output, std::string_view what, int code) { throw std::runtime_error{fmt::format("cannot write {}: {} ({})", output.filename_, what, code)}; }
+};
+
+// ----------------------------------------------------------------------
+
+struct acmacs::seqdb::v3::output_stream_t::xz_t : public compressor_t
+{
+    xz_t(const output_stream_t& output, size_t threads)
+    {
+        // multi-block encoder with the fixed block size for any number of threads (including 1), compressed output does not depend on threads
+        lzma_mt options{};
+        options.threads = threads == 0 ? std::max(lzma_cputhreads(), 1U) : static_cast<uint32_t>(threads);
+        options.block_size = block_size;
+        options.preset = preset;
+        options.check = LZMA_CHECK_CRC64;
+        if (const auto ret = lzma_stream_encoder_mt(&stream_, &options); ret != LZMA_OK)
+            failed(output, "lzma encoder initialization failed", static_cast<int>(ret));
+    }
+    ~xz_t() override { lzma_end(&stream_); }
+
+    void compress(output_stream_t& output, std::string_view input, bool finish) override
+    {
+        stream_.next_in = reinterpret_cast<const uint8_t*>(input.data());
+        stream_.avail_in = input.size();
+        for (auto ret = LZMA_OK; stream_.avail_in > 0 || (finish && ret != LZMA_STREAM_END);) {
+            stream_.next_out = buffer.data();
+            stream_.avail_out = buffer.size();
+            if (ret = lzma_code(&stream_, finish ? LZMA_FINISH : LZMA_RUN); ret != LZMA_OK && ret != LZMA_STREAM_END)
+                failed(output, "lzma compression failed", static_cast<int>(ret));
+            write(output, buffer.size() - stream_.avail_out);
+        }
+    }
+
+  private:
+    static constexpr uint32_t preset{6};
+    static constexpr uint64_t block_size{3 * 0x800000}; // 3 * dictionary size of preset 6 (liblzma default for the multi-block encoder)
+    lzma_stream stream_ = LZMA_STREAM_INIT;
+};
+
+// ----------------------------------------------------------------------
+
+struct acmacs::seqdb::v3::output_stream_t::gz_t : public compressor_t
+{
+    gz_t(const output_stream_t& output)
+    {
+        // windowBits 15 + 16: gzip header and trailer, header has no file name and zero time, i.e. output depends on the data only
+        if (const auto ret = deflateInit2(&stream_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY); ret != Z_OK)
+            failed(output, "zlib deflate initialization failed", ret);
+    }
+    ~gz_t() override { deflateEnd(&stream_); }
+
+    void compress(output_stream_t& output, std::string_view input, bool finish) override
+    {
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream_.avail_in = static_cast<uInt>(input.size());
+        for (int ret = Z_OK; stream_.avail_in > 0 || (finish && ret != Z_STREAM_END);) {
+            stream_.next_out = buffer.data();
+            stream_.avail_out = static_cast<uInt>(buffer.size());
+            if (ret = deflate(&stream_, finish ? Z_FINISH : Z_NO_FLUSH); ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                failed(output, "zlib compression failed", ret);
+            write(output, buffer.size() - stream_.avail_out);
+        }
+    }
+
+  private:
+    z_stream stream_{};
+};
+
+// ----------------------------------------------------------------------
+
+struct acmacs::seqdb::v3::output_stream_t::bz2_t : public compressor_t
+{
+    bz2_t(const output_stream_t& output)
+    {
+        if (const auto ret = BZ2_bzCompressInit(&stream_, 9, 0, 0); ret != BZ_OK)
+            failed(output, "bzip2 compressor initialization failed", ret);
+    }
+    ~bz2_t() override { BZ2_bzCompressEnd(&stream_); }
+
+    void compress(output_stream_t& output, std::string_view input, bool finish) override
+    {
+        stream_.next_in = const_cast<char*>(input.data());
+        stream_.avail_in = static_cast<unsigned>(input.size());
+        for (int ret = BZ_RUN_OK; stream_.avail_in > 0 || (finish && ret != BZ_STREAM_END);) {
+            stream_.next_out = reinterpret_cast<char*>(buffer.data());
+            stream_.avail_out = static_cast<unsigned>(buffer.size());
+            if (ret = BZ2_bzCompress(&stream_, finish ? BZ_FINISH : BZ_RUN); ret != BZ_RUN_OK && ret != BZ_FINISH_OK && ret != BZ_STREAM_END)
+                failed(output, "bzip2 compression failed", ret);
+            write(output, buffer.size() - stream_.avail_out);
+        }
+    }
+
+  private:
+    bz_stream stream_{};
+};
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::output_stream_t::output_stream_t(std::string_view filename, size_t threads) : filename_{filename}
+{
+    using namespace std::string_view_literals;
+    if (filename_ == "-"sv)
+        file_ = stdout;
+    else if (filename_ == "="sv)
+        file_ = stderr;
+    else {
+        if (file_ = std::fopen(filename_.c_str(), "w"); !file_)
+            throw std::runtime_error{fmt::format("cannot write {}: {}", filename_, std::strerror(errno))};
+        if (filename_.ends_with(".xz"sv))
+            compressor_ = std::make_unique<xz_t>(*this, threads);
+        else if (filename_.ends_with(".gz"sv))
+            compressor_ = std::make_unique<gz_t>(*this);
+        else if (filename_.ends_with(".bz2"sv))
+            compressor_ = std::make_unique<bz2_t>(*this);
+    }
+
+} // acmacs::seqdb::v3::output_stream_t::output_stream_t
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::output_stream_t::~output_stream_t()
+{
+    if (file_ && file_ != stdout && file_ != stderr)
+        std::fclose(file_);
+
+} // acmacs::seqdb::v3::output_stream_t::~output_stream_t
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::output_stream_t::write(size_t count, char symbol)
+{
+    for (; count > 0; --count)
+        buffer_.push_back(symbol);
+    flush_if_full();
+
+} // acmacs::seqdb::v3::output_stream_t::write
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::output_stream_t::json_string(std::string_view source)
+{
+    buffer_.push_back('"');
+    for (const char cc : source) {
+        switch (cc) {
+            case '"':
+                buffer_.append(std::string_view{"\\\""});
+                break;
+            case '\\':
+                buffer_.append(std::string_view{"\\\\"});
+                break;
+            default:
+                if (static_cast<unsigned char>(cc) < 0x20)
+                    fmt::format_to_mb(buffer_, "\\u{:04x}", static_cast<unsigned>(cc));
+                else
+                    buffer_.push_back(cc);
+                break;
+        }
+    }
+    buffer_.push_back('"');
+    flush_if_full();
+
+} // acmacs::seqdb::v3::output_stream_t::json_string
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::output_stream_t::write_file(const char* data, size_t size)
+{
+    if (std::fwrite(data, 1, size, file_) != size)
+        throw std::runtime_error{fmt::format("cannot write {}: {}", filename_, std::strerror(errno))};
+
+} // acmacs::seqdb::v3::output_stream_t::write_file
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::output_stream_t::flush()
+{
+    if (compressor_)
+        compressor_->compress(*this, std::string_view{buffer_.data(), buffer_.size()}, false);
+    else
+        write_file(buffer_.data(), buffer_.size());
+    buffer_.clear();
+
+} // acmacs::seqdb::v3::output_stream_t::flush
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::output_stream_t::close()
+{
+    if (file_) {
+        if (compressor_) {
+            compressor_->compress(*this, std::string_view{buffer_.data(), buffer_.size()}, true);
+            compressor_.reset();
+        }
+        else
+            write_file(buffer_.data(), buffer_.size());
+        buffer_.clear();
+        std::fflush(file_);
+        if (file_ != stdout && file_ != stderr)
+            std::fclose(file_);
+        file_ = nullptr;
+    }
+
+} // acmacs::seqdb::v3::output_stream_t::close
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
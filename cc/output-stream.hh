@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "acmacs-base/fmt.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    // writes output to a file ("-" stdout, "=" stderr) in chunks while it is being generated, memory use does not depend on the output size
+    // .xz, .gz and .bz2 output is compressed chunk by chunk
+    // .xz is compressed by threads (0 - number of cores) using multi-block xz encoder with the fixed block size, compressed output does not depend on the number of threads
+    // compressed bytes differ from acmacs::file::write output for the same data (.xz here is a multi-block stream of preset 6), decompressed data is the same
+    class output_stream_t
+    {
+      public:
+        output_stream_t(std::string_view filename, size_t threads = 1);
+        output_stream_t(const output_stream_t&) = delete;
+        ~output_stream_t();
+        output_stream_t& operator=(const output_stream_t&) = delete;
+
+        template <typename... Args> void format(fmt::format_string<Args...> format, Args&&... args)
+        {
+            fmt::format_to_mb(buffer_, format, std::forward<Args>(args)...);
+            flush_if_full();
+        }
+        void write(std::string_view data)
+        {
+            buffer_.append(data);
+            flush_if_full();
+        }
+        void write(size_t count, char symbol); // count copies of symbol
+        void json_string(std::string_view source); // quoted and escaped
+        void close();
+
+      private:
+        struct compressor_t;
+        struct xz_t;
+        struct gz_t;
+        struct bz2_t;
+
+        static constexpr size_t chunk_size{0x100000};
+        std::string filename_;
+        std::FILE* file_{nullptr};
+        std::unique_ptr<compressor_t> compressor_;
+        fmt::memory_buffer buffer_;
+
+        void flush_if_full()
+        {
+            if (file_ && buffer_.size() > chunk_size)
+                flush();
+        }
+        void flush();
+        void write_file(const char* data, size_t size);
+    };
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
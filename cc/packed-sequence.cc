@@ -0,0 +1,245 @@
+#include <bit>
+#include <algorithm>
+
+#include "acmacs-base/omp.hh"
+#include "seqdb-3/packed-sequence.hh"
+#include "seqdb-3/column-profile.hh"
+
+// ----------------------------------------------------------------------
+
+namespace local
+{
+    using alphabet = acmacs::seqdb::packed_sequences_t::alphabet;
+
+    constexpr std::array<char, 4> nucleotides{'A', 'C', 'G', 'T'};
+
+    constexpr std::array<uint8_t, 256> nucleotide_codes = [] {
+        std::array<uint8_t, 256> result{};
+        result.fill(0xFF);
+        for (size_t code{0}; code < nucleotides.size(); ++code)
+            result[static_cast<unsigned char>(nucleotides[code])] = static_cast<uint8_t>(code);
+        return result;
+    }();
+
+    // returns {code, packed}, packed is false if symbol has to be stored in the exception list
+    inline std::pair<uint64_t, bool> encode(alphabet abc, char symbol)
+    {
+        switch (abc) {
+            case alphabet::nucleotides:
+                if (const auto code = nucleotide_codes[static_cast<unsigned char>(symbol)]; code != 0xFF)
+                    return {code, true};
+                return {0, false};
+            case alphabet::amino_acids:
+                if (const auto slot = acmacs::seqdb::column_profile_t::slot(symbol); acmacs::seqdb::column_profile_t::residue(slot) == symbol)
+                    return {slot, true};
+                return {acmacs::seqdb::column_profile_t::slot('?'), false};
+        }
+        return {0, false};
+    }
+
+    // bit 0 of every symbol of a word
+    template <size_t bits> constexpr uint64_t low_bits()
+    {
+        uint64_t result{0};
+        for (size_t symbol{0}; symbol < 64 / bits; ++symbol)
+            result |= uint64_t{1} << (symbol * bits);
+        return result;
+    }
+
+    // number of symbols that differ in the first number_of_symbols of two packed sequences
+    template <size_t bits> size_t mismatches(const uint64_t* words1, const uint64_t* words2, size_t number_of_symbols)
+    {
+        constexpr size_t symbols_per_word{64 / bits};
+        constexpr uint64_t low{low_bits<bits>()};
+        const auto mismatch = [](uint64_t word1, uint64_t word2) {
+            const uint64_t diff = word1 ^ word2;
+            uint64_t any = diff;
+            for (size_t bit{1}; bit < bits; ++bit)
+                any |= diff >> bit;
+            return any & low; // bit 0 of every differing symbol
+        };
+
+        size_t result{0};
+        const size_t full_words = number_of_symbols / symbols_per_word;
+        for (size_t word{0}; word < full_words; ++word)
+            result += static_cast<size_t>(std::popcount(mismatch(words1[word], words2[word])));
+        if (const size_t rest = number_of_symbols % symbols_per_word; rest > 0)
+            result += static_cast<size_t>(std::popcount(mismatch(words1[full_words], words2[full_words]) & ((uint64_t{1} << (rest * bits)) - 1)));
+        return result;
+    }
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::packed_sequences_t::reserve(size_t number_of_sequences, size_t total_length)
+{
+    slots_.reserve(number_of_sequences);
+    words_.reserve(total_length / symbols_per_word(alphabet_) + number_of_sequences);
+
+} // acmacs::seqdb::v3::packed_sequences_t::reserve
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::packed_sequences_t::add(std::string_view sequence)
+{
+    add(std::span<const std::string_view>{&sequence, 1});
+    return slots_.size() - 1;
+
+} // acmacs::seqdb::v3::packed_sequences_t::add
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::packed_sequences_t::add(std::span<const std::string_view> sequences)
+{
+    // slots (word and exception ranges) are allocated first, then sequences are encoded in parallel, each one into its own words and exceptions
+    std::vector<uint32_t> number_of_exceptions(sequences.size());
+#pragma omp parallel for default(shared) schedule(static, 256)
+    for (size_t seq_no = 0; seq_no < sequences.size(); ++seq_no)
+        number_of_exceptions[seq_no] = static_cast<uint32_t>(std::count_if(std::begin(sequences[seq_no]), std::end(sequences[seq_no]), [this](char symbol) { return !local::encode(alphabet_, symbol).second; }));
+
+    const size_t per_word = symbols_per_word(alphabet_);
+    const size_t first_slot = slots_.size();
+    size_t words = words_.size(), exceptions = exceptions_.size();
+    for (size_t seq_no = 0; seq_no < sequences.size(); ++seq_no) {
+        slots_.push_back(slot_t{words, static_cast<uint32_t>(sequences[seq_no].size()), static_cast<uint32_t>(exceptions), static_cast<uint32_t>(exceptions + number_of_exceptions[seq_no])});
+        words += (sequences[seq_no].size() + per_word - 1) / per_word;
+        exceptions += number_of_exceptions[seq_no];
+    }
+    words_.resize(words, 0);
+    exceptions_.resize(exceptions);
+
+#pragma omp parallel for default(shared) schedule(static, 256)
+    for (size_t seq_no = 0; seq_no < sequences.size(); ++seq_no)
+        encode(sequences[seq_no], slots_[first_slot + seq_no]);
+
+} // acmacs::seqdb::v3::packed_sequences_t::add
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::packed_sequences_t::encode(std::string_view sequence, const slot_t& slot)
+{
+    const size_t bits_per_symbol = bits(alphabet_);
+    const size_t per_word = symbols_per_word(alphabet_);
+    uint64_t* words = words_.data() + slot.first_word;
+    exception_t* exception = exceptions_.data() + slot.first_exception;
+    for (size_t pos{0}; pos < sequence.size(); ++pos) {
+        const auto [code, packed] = local::encode(alphabet_, sequence[pos]);
+        words[pos / per_word] |= code << ((pos % per_word) * bits_per_symbol);
+        if (!packed)
+            *exception++ = exception_t{static_cast<uint32_t>(pos), sequence[pos]};
+    }
+
+} // acmacs::seqdb::v3::packed_sequences_t::encode
+
+// ----------------------------------------------------------------------
+
+uint64_t acmacs::seqdb::v3::packed_sequences_t::sequence_t::code(size_t pos) const
+{
+    const size_t bits_per_symbol = bits(alphabet_);
+    const size_t per_word = symbols_per_word(alphabet_);
+    return (words_[pos / per_word] >> ((pos % per_word) * bits_per_symbol)) & ((uint64_t{1} << bits_per_symbol) - 1);
+
+} // acmacs::seqdb::v3::packed_sequences_t::sequence_t::code
+
+// ----------------------------------------------------------------------
+
+char acmacs::seqdb::v3::packed_sequences_t::sequence_t::symbol(uint64_t code) const
+{
+    switch (alphabet_) {
+        case alphabet::nucleotides:
+            return local::nucleotides[code];
+        case alphabet::amino_acids:
+            return column_profile_t::residue(code);
+    }
+    return ' ';
+
+} // acmacs::seqdb::v3::packed_sequences_t::sequence_t::symbol
+
+// ----------------------------------------------------------------------
+
+char acmacs::seqdb::v3::packed_sequences_t::sequence_t::at(size_t pos) const
+{
+    if (pos >= size_)
+        return ' ';
+    if (const auto found = std::lower_bound(std::begin(exceptions_), std::end(exceptions_), pos, [](const auto& exc, size_t ps) { return exc.pos < ps; });
+        found != std::end(exceptions_) && found->pos == pos)
+        return found->symbol;
+    return symbol(code(pos));
+
+} // acmacs::seqdb::v3::packed_sequences_t::sequence_t::at
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::packed_sequences_t::sequence_t::decode(size_t length) const
+{
+    std::string result;
+    decode(result, length);
+    return result;
+
+} // acmacs::seqdb::v3::packed_sequences_t::sequence_t::decode
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::packed_sequences_t::sequence_t::decode(std::string& target, size_t length) const
+{
+    const size_t size = std::min(length, size_);
+    const size_t start = target.size();
+    target.resize(start + size);
+    char* result = target.data() + start;
+    for (size_t pos{0}; pos < size; ++pos)
+        result[pos] = symbol(code(pos));
+    for (const auto& exc : exceptions_) {
+        if (exc.pos >= size)
+            break;
+        result[exc.pos] = exc.symbol;
+    }
+
+} // acmacs::seqdb::v3::packed_sequences_t::sequence_t::decode
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::hamming_distance(packed_sequences_t::sequence_t s1, packed_sequences_t::sequence_t s2, hamming_distance_by_shortest shortest)
+{
+    const size_t common = std::min(s1.size(), s2.size());
+    size_t dist = s1.alphabet_ == packed_sequences_t::alphabet::nucleotides ? local::mismatches<packed_sequences_t::bits(packed_sequences_t::alphabet::nucleotides)>(s1.words_, s2.words_, common)
+                                                                            : local::mismatches<packed_sequences_t::bits(packed_sequences_t::alphabet::amino_acids)>(s1.words_, s2.words_, common);
+
+    // symbols at exception positions were compared by their placeholder codes, correct the distance there
+    const auto correct = [&dist, &s1, &s2](size_t pos, char symbol1, char symbol2) {
+        const bool codes_equal = s1.code(pos) == s2.code(pos);
+        if (codes_equal && symbol1 != symbol2)
+            ++dist;
+        else if (!codes_equal && symbol1 == symbol2)
+            --dist;
+    };
+    auto exc1 = std::begin(s1.exceptions_), exc2 = std::begin(s2.exceptions_);
+    const auto last1 = std::end(s1.exceptions_), last2 = std::end(s2.exceptions_);
+    while ((exc1 != last1 && exc1->pos < common) || (exc2 != last2 && exc2->pos < common)) {
+        const size_t pos1 = (exc1 != last1 && exc1->pos < common) ? exc1->pos : common;
+        const size_t pos2 = (exc2 != last2 && exc2->pos < common) ? exc2->pos : common;
+        if (pos1 == pos2) {
+            correct(pos1, exc1->symbol, exc2->symbol);
+            ++exc1;
+            ++exc2;
+        }
+        else if (pos1 < pos2) {
+            correct(pos1, exc1->symbol, s2.symbol(s2.code(pos1)));
+            ++exc1;
+        }
+        else {
+            correct(pos2, s1.symbol(s1.code(pos2)), exc2->symbol);
+            ++exc2;
+        }
+    }
+
+    if (shortest == hamming_distance_by_shortest::no)
+        dist += std::max(s1.size(), s2.size()) - common;
+    return dist;
+
+} // acmacs::seqdb::v3::hamming_distance
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
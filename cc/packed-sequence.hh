@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <span>
+
+#include "seqdb-3/hamming-distance.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::seqdb::inline v3
+{
+    // Sequences packed into 64-bit words: nucleotides A, C, G, T in 2 bits, amino acids in 5 bits (alphabet of column_profile_t).
+    // Symbols that cannot be packed (ambiguity codes and deletions in nucleotides, unknown symbols in amino acids) are kept in the exception list of the sequence.
+    // Hamming distance is computed on the packed words with xor and popcount, text is decoded only when requested.
+    // Seqdb keeps sequences of masters packed (seqdb_arena_t), aa_aligned() and nuc_aligned() decode them.
+    class packed_sequences_t
+    {
+      public:
+        enum class alphabet { nucleotides, amino_acids };
+
+        struct exception_t
+        {
+            uint32_t pos;
+            char symbol;
+        };
+
+        class sequence_t
+        {
+          public:
+            sequence_t() = default;
+
+            size_t size() const { return size_; }
+            bool empty() const { return size_ == 0; }
+            char at(size_t pos) const; // ' ' if pos is out of range
+            std::string decode(size_t length = std::string_view::npos) const;
+            void decode(std::string& target, size_t length = std::string_view::npos) const; // appends first length symbols to target
+
+          private:
+            alphabet alphabet_{alphabet::nucleotides};
+            const uint64_t* words_{nullptr};
+            size_t size_{0};
+            std::span<const exception_t> exceptions_; // sorted by pos
+
+            sequence_t(alphabet abc, const uint64_t* words, size_t size, std::span<const exception_t> exceptions) : alphabet_{abc}, words_{words}, size_{size}, exceptions_{exceptions} {}
+            uint64_t code(size_t pos) const;
+            char symbol(uint64_t code) const;
+
+            friend class packed_sequences_t;
+            friend size_t hamming_distance(sequence_t s1, sequence_t s2, hamming_distance_by_shortest shortest);
+        };
+
+        packed_sequences_t(alphabet abc) : alphabet_{abc} {}
+
+        size_t add(std::string_view sequence); // returns index of the added sequence
+        void add(std::span<const std::string_view> sequences); // sequences are packed in parallel, indexes are consecutive starting with size() before adding
+        void reserve(size_t number_of_sequences, size_t total_length);
+
+        sequence_t operator[](size_t index) const
+        {
+            const auto& slot = slots_[index];
+            return sequence_t{alphabet_, words_.data() + slot.first_word, slot.size, std::span<const exception_t>{exceptions_.data() + slot.first_exception, slot.last_exception - slot.first_exception}};
+        }
+
+        size_t size() const { return slots_.size(); }
+        bool empty() const { return slots_.empty(); }
+        alphabet abc() const { return alphabet_; }
+
+        static constexpr size_t bits(alphabet abc) { return abc == alphabet::nucleotides ? 2 : 5; }
+        static constexpr size_t symbols_per_word(alphabet abc) { return 64 / bits(abc); }
+
+      private:
+        struct slot_t
+        {
+            size_t first_word;
+            uint32_t size;
+            uint32_t first_exception, last_exception;
+        };
+
+        alphabet alphabet_;
+        std::vector<uint64_t> words_;
+        std::vector<exception_t> exceptions_;
+        std::vector<slot_t> slots_;
+
+        void encode(std::string_view sequence, const slot_t& slot);
+    };
+
+    // both sequences must be packed with the same alphabet
+    size_t hamming_distance(packed_sequences_t::sequence_t s1, packed_sequences_t::sequence_t s2, hamming_distance_by_shortest shortest = hamming_distance_by_shortest::no);
+
+    inline char at_pos(packed_sequences_t::sequence_t seq, pos0_t pos0) { return seq.at(*pos0); }
+    inline char at_pos(packed_sequences_t::sequence_t seq, pos1_t pos1) { return seq.at(*pos0_t{pos1}); }
+
+    // ----------------------------------------------------------------------
+
+    // sequence of a master in seqdb: the aligned part is packed, the part before the alignment start (abs(shift) symbols, usually none) is kept as text
+    struct packed_sequence_with_alignment_t
+    {
+        std::string_view before_aligned; // in seqdb_arena_t::text
+        packed_sequences_t::sequence_t aligned;
+        alignment_t shift{0}; // as stored in seqdb, negative for historical reasons
+
+        bool empty() const { return before_aligned.empty() && aligned.empty(); }
+        size_t size() const { return before_aligned.size() + aligned.size(); }
+
+        std::string text(size_t length = std::string_view::npos) const // as stored in seqdb
+        {
+            std::string result;
+            text(result, length);
+            return result;
+        }
+
+        void text(std::string& target, size_t length = std::string_view::npos) const // appends first length symbols to target
+        {
+            target.append(before_aligned.substr(0, length));
+            if (length > before_aligned.size())
+                aligned.decode(target, length == std::string_view::npos ? length : length - before_aligned.size());
+        }
+    };
+
+} // namespace acmacs::seqdb::inline v3
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
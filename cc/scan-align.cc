@@ -2,6 +2,7 @@
 // #include <array>
 // #include <map>
 // #include <tuple>
+#include <bit>
 
 #include "acmacs-base/named-type.hh"
 #include "acmacs-base/range-v3.hh"
@@ -31,16 +32,6 @@ namespace local
         return source.substr(pos, match.size()) == match;
     }
 
-    inline std::string::size_type find_in_sequence(std::string_view sequence, size_t limit, std::initializer_list<const char*> look_for)
-    {
-        const auto source = sequence.substr(0, limit);
-        for (const char* str : look_for) {
-            if (const auto pos = source.find(str); pos != std::string::npos)
-                return pos;
-        }
-        return std::string::npos;
-    }
-
     struct start_aa_t
     {
         const char* type_subtype_h_or_b;
@@ -107,25 +98,28 @@ namespace local
       private:
         constexpr static size_t max_sequence_length{1000};
         constexpr static size_t number_of_symbols{128};
-        constexpr static size_t table_size{number_of_symbols * max_sequence_length};
+        constexpr static size_t bits_per_word{64};
+        constexpr static size_t number_of_words{(max_sequence_length + bits_per_word - 1) / bits_per_word};
 
+        // for each symbol a bitset of positions where the symbol was seen in good sequences
         struct table_t
         {
-            using contribution_t = int;
+            using positions_t = std::array<uint64_t, number_of_words>;
 
             table_t()
             {
-                ranges::fill(data, 1);
-                for (auto pos : ranges::views::iota(0UL, max_sequence_length)) { // X and - do not contribute at any position
-                    data[number_of_symbols * pos + static_cast<size_t>('X')] = 0;
-                    data[number_of_symbols * pos + static_cast<size_t>('-')] = 0;
+                for (auto& positions : allowed)
+                    positions.fill(0);
+                for (auto pos : ranges::views::iota(0UL, max_sequence_length)) { // X and - are allowed at any position
+                    set(allowed[symbol('X')], pos);
+                    set(allowed[symbol('-')], pos);
                 }
             }
 
             void update(std::string_view amino_acids, size_t prefix_size)
             {
-                for (char aa : amino_acids) {
-                    data[number_of_symbols * prefix_size + static_cast<size_t>(aa)] = 0;
+                for (char aa : amino_acids.substr(0, max_sequence_length - std::min(prefix_size, max_sequence_length))) {
+                    set(allowed[symbol(aa)], prefix_size);
                     ++prefix_size;
                 }
             }
@@ -133,7 +127,11 @@ namespace local
             std::optional<int> align(char start_aa, std::string_view amino_acids) const;
             void report(std::string prefix) const;
 
-            std::array<contribution_t, table_size> data;
+            static constexpr size_t symbol(char aa) { return static_cast<unsigned char>(aa) % number_of_symbols; }
+            static constexpr void set(positions_t& positions, size_t pos) { positions[pos / bits_per_word] |= uint64_t{1} << (pos % bits_per_word); }
+            static constexpr bool test(const positions_t& positions, size_t pos) { return (positions[pos / bits_per_word] >> (pos % bits_per_word)) & 1; }
+
+            std::array<positions_t, number_of_symbols> allowed;
         };
 
         std::map<std::string, table_t, std::less<>> tables_;
@@ -195,271 +193,265 @@ bool local::align(acmacs::seqdb::v3::scan::sequence_t& sequence, const acmacs::v
 
 // ----------------------------------------------------------------------
 
-std::optional<std::tuple<int, acmacs::virus::type_subtype_t>> local::align(std::string_view amino_acids, const acmacs::virus::type_subtype_t& type_subtype_hint)
+// Subtype detection rules (motif, search window, shift) in priority order. All motifs are compiled into a
+// single Aho-Corasick automaton, the sequence prefix is scanned once to find the first occurrence of every
+// motif, then rules are checked in order.
+
+namespace local
 {
-    const auto make_type_subtype = [&type_subtype_hint](const char* detected_type_subtype) -> acmacs::virus::type_subtype_t {
-        const auto dts = acmacs::virus::type_subtype_t{detected_type_subtype};
-        if (type_subtype_hint.h_or_b() == dts.h_or_b())
-            return type_subtype_hint;
-        else
-            return dts;
+    struct motif_rule_t
+    {
+        const char* type_subtype;
+        size_t limit;                         // motif must be found within the first limit aas
+        std::vector<std::string_view> motifs; // the first found motif (in this order) is used
+        int shift;                            // added to motif position
+        bool (*check)(std::string_view amino_acids, size_t pos){nullptr};
     };
 
-    // --------------------------------------------------
-    // first stage
-
-    // H3
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MKTII"});
-        pos != std::string::npos &&
-        (amino_acids[pos + 16] == 'Q' || amino_acids[pos + 15] == 'A')) // amino_acids.substr(pos + 15, 2) != "DR") { // DR[ISV]C - start of the B sequence (signal peptide is 15 aas!)
-        return std::tuple{static_cast<int>(pos) + 16, make_type_subtype("A(H3)")};
-
-    // H1
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MKV", "MKA", "MEA", "MEV"});
-        pos != std::string::npos && (has_infix(amino_acids, pos + 17, "DTLC") || has_infix(amino_acids, pos + 17, "DTIC")))
-        return std::tuple{static_cast<int>(pos) + 17, make_type_subtype("A(H1)")};
-
-    // B
+    static const std::vector<motif_rule_t>& motif_rules()
     {
-        // Only B has CTDL at first 100 AAs
-        if (const auto pos = find_in_sequence(amino_acids, 100, {"CTDL"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 59, make_type_subtype("B")};
-        // Only B has NSPHVV at first 100 AAs
-        if (const auto pos = find_in_sequence(amino_acids, 100, {"NSPHVV"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 10, make_type_subtype("B")};
-        // B specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"EHIRL"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 114, make_type_subtype("B")};
-        // Only B (YAMAGATA?) has CPNATS in whole AA sequence
-        if (const auto pos = find_in_sequence(amino_acids, 250, {"CPNATS"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 142, make_type_subtype("B")};
-        if (const auto pos = find_in_sequence(amino_acids, 250, {"PNATSK"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 143, make_type_subtype("B")};
-        // B specific (VICTORIA?)
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"NVTNG"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 144, make_type_subtype("B")};
-        // --- below are redundant 2019-06-01
-        // Only B has DRICT
-        // if (const auto pos = find_in_sequence(amino_acids, 50, {"DRICT"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos), make_type_subtype("B")};
-        // Only B has MKAIIVL at first 100 AAs
-        // if (const auto pos = find_in_sequence(amino_acids, 50, {"MKAIIVL"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) + 15, make_type_subtype("B")};
-        // // Only B has NVTGV at first 100 AAs
-        // if (const auto pos = find_in_sequence(amino_acids, 50, {"NVTGV"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) - 24, make_type_subtype("B")};
+#pragma GCC diagnostic push
+#ifdef __clang__
+#pragma GCC diagnostic ignored "-Wexit-time-destructors"
+#endif
+        static const std::vector<motif_rule_t> rules{
+            // --------------------------------------------------
+            // first stage
+
+            // H3, DR[ISV]C - start of the B sequence (signal peptide is 15 aas!)
+            {"A(H3)", 20, {"MKTII"}, 16, [](std::string_view amino_acids, size_t pos) { return amino_acids[pos + 16] == 'Q' || amino_acids[pos + 15] == 'A'; }},
+            // H1
+            {"A(H1)", 20, {"MKV", "MKA", "MEA", "MEV"}, 17, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 17, "DTLC") || has_infix(amino_acids, pos + 17, "DTIC"); }},
+            // B
+            {"B", 100, {"CTDL"}, -59},    // Only B has CTDL at first 100 AAs
+            {"B", 100, {"NSPHVV"}, -10},  // Only B has NSPHVV at first 100 AAs
+            {"B", 150, {"EHIRL"}, -114},  // B specific
+            {"B", 250, {"CPNATS"}, -142}, // Only B (YAMAGATA?) has CPNATS in whole AA sequence
+            {"B", 250, {"PNATSK"}, -143},
+            {"B", 150, {"NVTNG"}, -144}, // B specific (VICTORIA?)
+            // H2
+            {"A(H2)", 20, {"MTIT", "MAII"}, 15, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 14, "GDQIC"); }},
+            // H4
+            {"A(H4)", 20, {"MLS"}, 16, [](std::string_view amino_acids, size_t pos) { return amino_acids[pos + 16] == 'Q' || has_infix(amino_acids, pos + 16, "SQNY"); }},
+            // H5
+            {"A(H5)", 20, {"MEKIV", "MERIV"}, 16},
+            // H6
+            {"A(H6)", 20, {"MIAIIV", "MIAIII"}, 16},
+            // H7, SDKIC is H15 most probably
+            {"A(H7)", 20, {"MNIQ", "MNNQ", "MNTQ"}, 18, [](std::string_view amino_acids, size_t pos) { return amino_acids[pos + 17] != 'S' && has_infix(amino_acids, pos + 18, "DKIC"); }},
+            // H8
+            {"A(H8)", 20, {"MEKFIA"}, 17, [](std::string_view amino_acids, size_t pos) { return amino_acids[pos + 17] == 'D'; }},
+            // H9
+            {"A(H9)", 20, {"METIS", "MEIIS", "MEV"}, 18, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 17, "ADKIC"); }},
+            // H10
+            {"A(H10)", 20, {"MYK"}, 17},
+            // H11
+            {"A(H11)", 20, {"MK"}, 16, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 16, "DEIC"); }},
+            // H12
+            {"A(H12)", 20, {"MEK"}, 17, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 15, "AYDKIC"); }},
+            // H13
+            {"A(H13)", 20, {"MDI", "MAL", "MEV"}, 18, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 17, "ADRIC"); }},
+            // H14
+            {"A(H14)", 20, {"MIA"}, 17, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 14, "AYSQITN"); }},
+            // H15 - second stage only
+            // H16
+            {"A(H16)", 20, {"MMVK", "MMIK"}, 19, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 19, "DKIC"); }},
+            // H17
+            {"A(H17)", 20, {"MEL"}, 18, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 17, "GDRICI"); }},
+
+            // --------------------------------------------------
+            // second stage
+
+            // H4
+            {"A(H4)", 100, {"QNYT"}, 0, [](std::string_view amino_acids, size_t pos) { return has_infix(amino_acids, pos + 11, "GHHA"); }},
+            // H11 (DEICIGYL is specific)
+            {"A(H11)", 50, {"DEICIGYL"}, 0},
+            // H15
+            {"A(H15)", 100, {"KSDKICLGHHA"}, 2},
+
+            // --------------------------------------------------
+            // third stage
+
+            // H3
+            {"A(H3)", 150, {"CTLID", "CTLMDALL", "CTLVD"}, -63}, // Only H3 (and H0N0) has CTLID in the whole AA sequence
+            {"A(H3)", 100, {"PNGTIVKTI"}, -20},                  // Only H3 (and H0N0) has PNGTIVKTI in the whole AA sequence
+            {"A(H3)", 200, {"DKLYIWG"}, -174},                   // Only H3 (and H0N0) has DKLYIWG in the whole AA sequence
+            {"A(H3)", 150, {"SNCYPYDV"}, -94},                   // specific
+            // H1
+            {"A(H1)", 50, {"VLEKN"}, -18},             // VLEKN is H1 specific (whole AA sequence)
+            {"A(H1)", 150, {"SSWSYI", "ESWSYI"}, -73}, // SSWSYI and ESWSYI are H1 specific (whole AA sequence)
+            {"A(H1)", 150, {"FERFEI"}, -110},          // specific
+            {"A(H1)", 200, {"IWLVKKG"}, -148},         // specific
+            {"A(H1)", 200, {"SSVSSF"}, -105},          // specific
+            // H5
+            {"A(H5)", 100, {"GVKPLIL", "GVRPLIL"}, -45}, // specific
+            {"A(H5)", 100, {"GWLLGNPMCDE"}, -58},        // specific
+            {"A(H5)", 150, {"NHFE"}, -108},              // specific at first 150
+            // H6
+            {"A(H6)", 100, {"QKEER"}, -35}, // QKEER is H6 specific
+            {"A(H6)", 150, {"EELKA"}, -98}, // EELKA is H6 specific
+            // H7
+            {"A(H7)", 100, {"GQCGL"}, -51}, // specific
+            // H8
+            {"A(H8)", 200, {"FYRSINWL"}, -141}, // specific
+            // H9
+            {"A(H9)", 50, {"QSTN"}, -7},                  // QSTN is H9 specific
+            {"A(H9)", 150, {"CDLLLGG", "CDLLLEG"}, -66},  // CDLLLGG, CDLLLEG are H9 specific
+            {"A(H9)", 150, {"LEELRS"}, -97},              // LEELRS is H9 specific
+            {"A(H9)", 150, {"SARSYQ"}, -106},             // SARSYQ is H9 specific
+            {"A(H9)", 150, {"SSYQRIQ"}, -108},            // SSYQRIQ is H9 specific
+            // H10
+            {"A(H10)", 50, {"NGTIVKTLTNE"}, -11}, // specific
+            {"A(H10)", 150, {"QKIMESG"}, -99},    // specific
+            // H11 (SSVEL is specific)
+            {"A(H11)", 100, {"SSVEL"}, -27},
+            // H13 (specific)
+            {"A(H13)", 50, {"VGYLSTN"}, -4},
+            // H16 (specific)
+            {"A(H16)", 70, {"DTLTENGVP", "DTLIENGVP"}, -16},
+        };
+#pragma GCC diagnostic pop
+        return rules;
     }
 
-    // H2
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MTIT", "MAII"}); pos != std::string::npos && has_infix(amino_acids, pos + 14, "GDQIC"))
-        return std::tuple{static_cast<int>(pos) + 15, make_type_subtype("A(H2)")};
-
-    // H4
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MLS"}); pos != std::string::npos && (amino_acids[pos + 16] == 'Q' || has_infix(amino_acids, pos + 16, "SQNY")))
-        return std::tuple{static_cast<int>(pos) + 16, make_type_subtype("A(H4)")};
-
-    // H5
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MEKIV", "MERIV"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos) + 16, make_type_subtype("A(H5)")};
-
-    // H6
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MIAIIV", "MIAIII"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos) + 16, make_type_subtype("A(H6)")};
-
-    // H7
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MNIQ", "MNNQ", "MNTQ"});
-        pos != std::string::npos && amino_acids[pos + 17] != 'S' && has_infix(amino_acids, pos + 18, "DKIC")) // SDKIC is H15 most probably
-        return std::tuple{static_cast<int>(pos) + 18, make_type_subtype("A(H7)")};
-
-    // H8
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MEKFIA"}); pos != std::string::npos && amino_acids[pos + 17] == 'D')
-        return std::tuple{static_cast<int>(pos) + 17, make_type_subtype("A(H8)")};
-
-    // H9
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"METIS", "MEIIS", "MEV"}); pos != std::string::npos && has_infix(amino_acids, pos + 17, "ADKIC"))
-        return std::tuple{static_cast<int>(pos) + 18, make_type_subtype("A(H9)")};
-
-    // H10
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MYK"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos) + 17, make_type_subtype("A(H10)")};
-
-    // H11
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MK"}); pos != std::string::npos && has_infix(amino_acids, pos + 16, "DEIC"))
-        return std::tuple{static_cast<int>(pos) + 16, make_type_subtype("A(H11)")};
-
-    // H12
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MEK"}); pos != std::string::npos && has_infix(amino_acids, pos + 15, "AYDKIC"))
-        return std::tuple{static_cast<int>(pos) + 17, make_type_subtype("A(H12)")};
-
-    // H13
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MDI", "MAL", "MEV"}); pos != std::string::npos && has_infix(amino_acids, pos + 17, "ADRIC"))
-        return std::tuple{static_cast<int>(pos) + 18, make_type_subtype("A(H13)")};
-
-    // H14
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MIA"}); pos != std::string::npos && has_infix(amino_acids, pos + 14, "AYSQITN"))
-        return std::tuple{static_cast<int>(pos) + 17, make_type_subtype("A(H14)")};
-
-    // H15 - second stage only
-
-    // H16
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MMVK", "MMIK"}); pos != std::string::npos && has_infix(amino_acids, pos + 19, "DKIC"))
-        return std::tuple{static_cast<int>(pos) + 19, make_type_subtype("A(H16)")};
-
-    // H17
-    if (const auto pos = find_in_sequence(amino_acids, 20, {"MEL"}); pos != std::string::npos && has_infix(amino_acids, pos + 17, "GDRICI"))
-        return std::tuple{static_cast<int>(pos) + 18, make_type_subtype("A(H17)")};
+    // ----------------------------------------------------------------------
 
-    // --------------------------------------------------
-    // second stage
+    class MotifScanner
+    {
+      public:
+        MotifScanner(const std::vector<motif_rule_t>& rules) : rules_{rules}
+        {
+            transitions_.emplace_back();
+            transitions_.back().fill(0);
+            outputs_.emplace_back();
+            for (const auto& rule : rules_) {
+                scan_limit_ = std::max(scan_limit_, rule.limit);
+                for (const auto motif : rule.motifs)
+                    add(motif);
+            }
+            build_links();
 
-    // H4
-    if (const auto pos = find_in_sequence(amino_acids, 100, {"QNYT"}); pos != std::string::npos && has_infix(amino_acids, pos + 11, "GHHA"))
-        return std::tuple{static_cast<int>(pos), make_type_subtype("A(H4)")};
+            rule_motifs_.resize(rules_.size());
+            for (size_t rule_no = 0; rule_no < rules_.size(); ++rule_no) {
+                for (const auto motif : rules_[rule_no].motifs)
+                    rule_motifs_[rule_no].push_back(static_cast<size_t>(std::find(std::begin(motifs_), std::end(motifs_), motif) - std::begin(motifs_)));
+            }
+        }
 
-    // H11 (DEICIGYL is specific)
-    if (const auto pos = find_in_sequence(amino_acids, 50, {"DEICIGYL"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos), make_type_subtype("A(H11)")};
+        // returns {shift, type_subtype} of the first matching rule
+        std::optional<std::tuple<int, const char*>> find(std::string_view amino_acids) const
+        {
+            const auto scan_size = std::min(amino_acids.size(), scan_limit_);
+            std::vector<size_t> first_pos(motifs_.size(), std::string_view::npos);
+            for (size_t pos = 0, state = 0; pos < scan_size; ++pos) {
+                state = transitions_[state][symbol(amino_acids[pos])];
+                for (const auto motif_no : outputs_[state]) {
+                    if (first_pos[motif_no] == std::string_view::npos)
+                        first_pos[motif_no] = pos + 1 - motifs_[motif_no].size();
+                }
+            }
 
-    // H15
-    if (const auto pos = find_in_sequence(amino_acids, 100, {"KSDKICLGHHA"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos) + 2, make_type_subtype("A(H15)")};
+            for (size_t rule_no = 0; rule_no < rules_.size(); ++rule_no) {
+                const auto& rule = rules_[rule_no];
+                const auto limit = std::min(rule.limit, amino_acids.size());
+                // the first motif in the list found within limit, motif position is its first occurrence
+                const auto found = std::find_if(std::begin(rule_motifs_[rule_no]), std::end(rule_motifs_[rule_no]),
+                                                [&](size_t motif_no) { return first_pos[motif_no] != std::string_view::npos && (first_pos[motif_no] + motifs_[motif_no].size()) <= limit; });
+                if (found != std::end(rule_motifs_[rule_no])) {
+                    if (const auto pos = first_pos[*found]; !rule.check || rule.check(amino_acids, pos))
+                        return std::tuple{static_cast<int>(pos) + rule.shift, rule.type_subtype};
+                }
+            }
+            return std::nullopt;
+        }
 
-    // --------------------------------------------------
-    // third stage
+      private:
+        constexpr static size_t number_of_symbols{27}; // A-Z and everything else
+        using transition_t = std::array<size_t, number_of_symbols>;
 
-    // H3
-    {
-        // Only H3 (and H0N0) has CTLID in the whole AA sequence
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"CTLID", "CTLMDALL", "CTLVD"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 63, make_type_subtype("A(H3)")};
-        // Only H3 (and H0N0) has PNGTIVKTI in the whole AA sequence
-        if (const auto pos = find_in_sequence(amino_acids, 100, {"PNGTIVKTI"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 20, make_type_subtype("A(H3)")};
-        // Only H3 (and H0N0) has DKLYIWG in the whole AA sequence
-        if (const auto pos = find_in_sequence(amino_acids, 200, {"DKLYIWG"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 174, make_type_subtype("A(H3)")};
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"SNCYPYDV"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 94, make_type_subtype("A(H3)")};
-        // -- below is redundant
-        // // Only H3 (and H0N0) has SNCY in the whole AA sequence
-        // if (const auto pos = find_in_sequence(amino_acids, 150, {"SNCY"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) - 94, make_type_subtype("A(H3)")};
-        // // Only H3 (and H0N0) has WTGVT in the whole AA sequence
-        // if (const auto pos = find_in_sequence(amino_acids, 200, {"WTGVT"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) - 126, make_type_subtype("A(H3)")};
-        // // Only H3 (and H0N0) has NWLTH in the whole AA sequence
-        // if (const auto pos = find_in_sequence(amino_acids, 200, {"NWLTH"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) - 151, make_type_subtype("A(H3)")};
-    }
+        const std::vector<motif_rule_t>& rules_;
+        size_t scan_limit_{0};
+        std::vector<std::string_view> motifs_;      // unique motifs
+        std::vector<transition_t> transitions_;     // full DFA after build_links()
+        std::vector<std::vector<size_t>> outputs_;  // motifs ending at state (including suffix links)
+        std::vector<std::vector<size_t>> rule_motifs_;
 
-    // H1
-    {
-        // VLEKN is H1 specific (whole AA sequence)
-        if (const auto pos = find_in_sequence(amino_acids, 50, {"VLEKN"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 18, make_type_subtype("A(H1)")};
-        // SSWSYI and ESWSYI are H1 specific (whole AA sequence)
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"SSWSYI", "ESWSYI"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 73, make_type_subtype("A(H1)")};
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"FERFEI"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 110, make_type_subtype("A(H1)")};
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 200, {"IWLVKKG"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 148, make_type_subtype("A(H1)")};
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 200, {"SSVSSF"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 105, make_type_subtype("A(H1)")};
-        // (redundant) specific
-        // if (const auto pos = find_in_sequence(amino_acids, 200, {"GVTAACPH"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) - 130, make_type_subtype("A(H1)")};
-    }
+        static constexpr size_t symbol(char aa) { return (aa >= 'A' && aa <= 'Z') ? static_cast<size_t>(aa - 'A') : number_of_symbols - 1; }
 
-    // H5
-    {
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 100, {"GVKPLIL", "GVRPLIL"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 45, make_type_subtype("A(H5)")};
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 100, {"GWLLGNPMCDE"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 58, make_type_subtype("A(H5)")};
-        // specific at first 150
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"NHFE"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 108, make_type_subtype("A(H5)")};
-        // (redundant) specific
-        // if (const auto pos = find_in_sequence(amino_acids, 50, {"GYHANNSTEQ"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) - 5, make_type_subtype("A(H5)")};
-    }
+        void add(std::string_view motif)
+        {
+            if (std::find(std::begin(motifs_), std::end(motifs_), motif) != std::end(motifs_))
+                return;
+            size_t state = 0;
+            for (const char aa : motif) {
+                if (transitions_[state][symbol(aa)] == 0) {
+                    transitions_[state][symbol(aa)] = transitions_.size();
+                    transitions_.emplace_back().fill(0); // invalidates references to transitions_
+                    outputs_.emplace_back();
+                }
+                state = transitions_[state][symbol(aa)];
+            }
+            outputs_[state].push_back(motifs_.size());
+            motifs_.push_back(motif);
+        }
 
-    // H6
-    {
-        // QKEER is H6 specific
-        if (const auto pos = find_in_sequence(amino_acids, 100, {"QKEER"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 35, make_type_subtype("A(H6)")};
-        // EELKA is H6 specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"EELKA"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 98, make_type_subtype("A(H6)")};
-    }
+        void build_links()
+        {
+            std::vector<size_t> fail(transitions_.size(), 0);
+            std::vector<size_t> queue;
+            for (const auto next : transitions_[0]) {
+                if (next != 0)
+                    queue.push_back(next);
+            }
+            for (size_t head = 0; head < queue.size(); ++head) {
+                const auto state = queue[head];
+                const auto& suffix_outputs = outputs_[fail[state]];
+                outputs_[state].insert(std::end(outputs_[state]), std::begin(suffix_outputs), std::end(suffix_outputs));
+                for (size_t sym = 0; sym < number_of_symbols; ++sym) {
+                    if (auto& next = transitions_[state][sym]; next != 0) {
+                        fail[next] = transitions_[fail[state]][sym];
+                        queue.push_back(next);
+                    }
+                    else
+                        next = transitions_[fail[state]][sym];
+                }
+            }
+        }
+    };
 
-    // H7
-    {
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 100, {"GQCGL"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 51, make_type_subtype("A(H7)")};
-    }
+} // namespace local
 
-    // H8
-    {
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 200, {"FYRSINWL"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 141, make_type_subtype("A(H8)")};
-    }
+// ----------------------------------------------------------------------
 
-    // H9
-    {
-        // QSTN is H9 specific
-        if (const auto pos = find_in_sequence(amino_acids, 50, {"QSTN"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 7, make_type_subtype("A(H9)")};
-        // CDLLLGG, CDLLLEG are H9 specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"CDLLLGG", "CDLLLEG"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 66, make_type_subtype("A(H9)")};
-        // LEELRS is H9 specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"LEELRS"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 97, make_type_subtype("A(H9)")};
-        // SARSYQ is H9 specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"SARSYQ"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 106, make_type_subtype("A(H9)")};
-        // SSYQRIQ is H9 specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"SSYQRIQ"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 108, make_type_subtype("A(H9)")};
-    }
+std::optional<std::tuple<int, const char*>> acmacs::seqdb::v3::scan::align_by_motifs(std::string_view amino_acids)
+{
+#pragma GCC diagnostic push
+#ifdef __clang__
+#pragma GCC diagnostic ignored "-Wexit-time-destructors"
+#endif
+    static const local::MotifScanner scanner{local::motif_rules()};
+#pragma GCC diagnostic pop
 
-    // H10
-    {
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 50, {"NGTIVKTLTNE"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 11, make_type_subtype("A(H10)")};
-        // specific
-        if (const auto pos = find_in_sequence(amino_acids, 150, {"QKIMESG"}); pos != std::string::npos)
-            return std::tuple{static_cast<int>(pos) - 99, make_type_subtype("A(H10)")};
-        // (redundant) specific
-        // if (const auto pos = find_in_sequence(amino_acids, 50, {"LDKICLGHHA"}); pos != std::string::npos)
-        //     return std::tuple{static_cast<int>(pos) + 1, make_type_subtype("A(H10)")};
-    }
+    return scanner.find(amino_acids);
 
-    // H11 (SSVEL is specific)
-    if (const auto pos = find_in_sequence(amino_acids, 100, {"SSVEL"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos) - 27, make_type_subtype("A(H11)")};
+} // acmacs::seqdb::v3::scan::align_by_motifs
 
-    // H13 (specific)
-    if (const auto pos = find_in_sequence(amino_acids, 50, {"VGYLSTN"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos) - 4, make_type_subtype("A(H13)")};
+// ----------------------------------------------------------------------
 
-    // H16 (specific)
-    if (const auto pos = find_in_sequence(amino_acids, 70, {"DTLTENGVP", "DTLIENGVP"}); pos != std::string::npos)
-        return std::tuple{static_cast<int>(pos) - 16, make_type_subtype("A(H16)")};
+std::optional<std::tuple<int, acmacs::virus::type_subtype_t>> local::align(std::string_view amino_acids, const acmacs::virus::type_subtype_t& type_subtype_hint)
+{
+    const auto make_type_subtype = [&type_subtype_hint](const char* detected_type_subtype) -> acmacs::virus::type_subtype_t {
+        const auto dts = acmacs::virus::type_subtype_t{detected_type_subtype};
+        if (type_subtype_hint.h_or_b() == dts.h_or_b())
+            return type_subtype_hint;
+        else
+            return dts;
+    };
 
-    return std::nullopt;
+    if (const auto found = acmacs::seqdb::scan::align_by_motifs(amino_acids); found.has_value())
+        return std::tuple{std::get<int>(*found), make_type_subtype(std::get<const char*>(*found))};
+    else
+        return std::nullopt;
 
 } // acmacs::seqdb::v3::scan::align
 
@@ -467,19 +459,36 @@ std::optional<std::tuple<int, acmacs::virus::type_subtype_t>> local::align(std::
 
 std::optional<int> local::Aligner::table_t::align(char start_aa, std::string_view amino_acids) const
 {
-    // fmt::print(stderr, "Aligner::table_t::align {}\n{}\n", debug_name, amino_acids);
-    for (auto p_start = amino_acids.find(start_aa); p_start < (amino_acids.size() / 2); p_start = amino_acids.find(start_aa, p_start + 1)) {
-        const auto all_pos = ranges::views::iota(0UL, std::min(max_sequence_length, amino_acids.size() - p_start));
-        if (const auto failed_pos = ranges::find_if(all_pos, [this,amino_acids,p_start](size_t pos) -> bool { return data[number_of_symbols * pos + static_cast<size_t>(amino_acids[p_start + pos])]; }); failed_pos != ranges::end(all_pos)) {
-            // if (*failed_pos > 10)
-            //     fmt::print(stderr, "Aligner::table_t::align FAILED: shift:{} {}:{} -- {} -- {}\n", p_start, *failed_pos, amino_acids[p_start + *failed_pos], debug_name, amino_acids.substr(0, p_start + *failed_pos + 5));
-        }
-        else {
-            // fmt::print(stderr, "Aligner::table_t::align good shift:{}\n", p_start);
-            return static_cast<int>(p_start);
+    // Shift-And matching of all candidate starts simultaneously: start is a position of start_aa in the first half of the sequence,
+    // bit j of state is set if the candidate starting at (pos - j) has all its aas at table positions 0..j allowed.
+    // Candidate succeeds if max_sequence_length positions (or the rest of the sequence) are allowed, the earliest start wins.
+
+    const auto last_start = amino_acids.size() / 2;
+    positions_t state;
+    state.fill(0);
+    for (size_t pos = 0; pos < amino_acids.size(); ++pos) {
+        const auto& allowed_at = allowed[symbol(amino_acids[pos])];
+        uint64_t carry = (pos < last_start && amino_acids[pos] == start_aa) ? 1 : 0;
+        uint64_t any{0};
+        for (size_t word = 0; word < std::min(number_of_words, pos / bits_per_word + 1); ++word) {
+            const auto shifted = (state[word] << 1) | carry;
+            carry = state[word] >> (bits_per_word - 1);
+            state[word] = shifted & allowed_at[word];
+            any |= state[word];
         }
+        if (pos >= (max_sequence_length - 1) && test(state, max_sequence_length - 1))
+            return static_cast<int>(pos - (max_sequence_length - 1));
+        if (any == 0 && pos >= last_start)
+            return std::nullopt;
     }
 
+    // candidates that reached the end of the sequence, the longest match is the earliest start
+    for (size_t word = number_of_words; word > 0; --word) {
+        if (state[word - 1] != 0) {
+            const auto bit = (word - 1) * bits_per_word + (bits_per_word - 1) - static_cast<size_t>(std::countl_zero(state[word - 1]));
+            return static_cast<int>(amino_acids.size() - 1 - bit);
+        }
+    }
     return std::nullopt;
 
 } // local::Aligner::table_t::align
@@ -488,51 +497,25 @@ std::optional<int> local::Aligner::table_t::align(char start_aa, std::string_vie
 
 void local::Aligner::table_t::report(std::string prefix) const
 {
-    using iter_t = decltype(data.begin());
-    const auto increment = [](iter_t first, iter_t last, iter_t value) -> iter_t {
-        while (value != last) {
-            ++value;
-            if (*value == 0 && (value - first) != static_cast<ssize_t>('X') /* && (value - first) != static_cast<ssize_t>('-') */)
-                break;
-        }
-        return value;
-    };
-    const auto begin = [this](size_t pos) -> iter_t { return data.begin() + number_of_symbols * pos; };
-    const auto end = [begin](size_t pos) -> iter_t { return begin(pos) + static_cast<ssize_t>('Z' + 1); };
-
-    std::array<iter_t, max_sequence_length> iters;
-    std::array<bool, max_sequence_length> completed;
+    // allowed aas (except X) at each position, printed vertically
+    std::array<std::string, max_sequence_length> aas;
     size_t last_pos = 0;
     for (auto pos : ranges::views::iota(0UL, max_sequence_length)) {
-        iters[pos] = increment(begin(pos), end(pos), begin(pos) + static_cast<ssize_t>('A') - 1);
-        if (iters[pos] == end(pos)) {
-            completed[pos] = true;
+        for (char aa = 'A'; aa <= 'Z'; ++aa) {
+            if (aa != 'X' && test(allowed[symbol(aa)], pos))
+                aas[pos].push_back(aa);
         }
-        else {
-            completed[pos] = false;
+        if (!aas[pos].empty())
             last_pos = pos + 1;
-        }
     }
+    const auto num_lines = ranges::max(aas | ranges::views::transform([](const auto& en) { return en.size(); }));
 
-    const auto print_line = [&iters, &completed, increment, begin, end, last_pos]() {
-        for (auto pos : ranges::views::iota(0UL, last_pos)) {
-            if (iters[pos] != end(pos)) {
-                fmt::print(stderr, "{}", static_cast<char>(iters[pos] - begin(pos)));
-                iters[pos] = increment(begin(pos), end(pos), iters[pos]);
-                completed[pos] = iters[pos] == end(pos);
-            }
-            else
-                fmt::print(stderr, " ");
-        }
-        fmt::print(stderr, "\n");
-    };
-
-    fmt::print(stderr, "{}", prefix);
-    print_line();
     const std::string prefix_space(prefix.size(), ' ');
-    while (!ranges::all_of(completed, [](auto val) { return val; })) {
-        fmt::print(stderr, "{}", prefix_space);
-        print_line();
+    for (size_t line = 0; line < std::max(num_lines, 1UL); ++line) {
+        fmt::print(stderr, "{}", line == 0 ? prefix : prefix_space);
+        for (auto pos : ranges::views::iota(0UL, last_pos))
+            fmt::print(stderr, "{}", line < aas[pos].size() ? aas[pos][line] : ' ');
+        fmt::print(stderr, "\n");
     }
 
 } // local::Aligner::table_t::report
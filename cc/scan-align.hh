@@ -1,6 +1,9 @@
 #pragma once
 
 #include <vector>
+#include <optional>
+#include <tuple>
+#include <string_view>
 
 // ----------------------------------------------------------------------
 
@@ -17,6 +20,9 @@ namespace acmacs::seqdb
 
             // removes not translated
             void translate_align(std::vector<fasta::scan_result_t>& sequences);
+
+            // initial alignment by subtype specific motifs: {shift, detected type_subtype} of the first matching motif rule
+            std::optional<std::tuple<int, const char*>> align_by_motifs(std::string_view amino_acids);
         } // namespace scan
 
     } // namespace v3
@@ -1,5 +1,6 @@
 #include <numeric>
 #include <optional>
+#include <limits>
 
 #include "acmacs-base/counter.hh"
 #include "acmacs-base/fmt.hh"
@@ -43,7 +44,7 @@ namespace local
 
 // ----------------------------------------------------------------------
 
-void acmacs::seqdb::v3::scan::detect_insertions_deletions(std::vector<fasta::scan_result_t>& sequence_data)
+void acmacs::seqdb::v3::scan::detect_insertions_deletions(std::vector<fasta::scan_result_t>& sequence_data, banded_alignment banded)
 {
     const auto masters = local::masters_per_subtype(sequence_data);
     // fmt::print(stderr, "masters_per_subtype {}\n", masters.size());
@@ -53,7 +54,7 @@ void acmacs::seqdb::v3::scan::detect_insertions_deletions(std::vector<fasta::sca
         if (!sc_p->reference && sc_p->sequence.aligned()) { //  && sc_p->sequence.type_subtype() == acmacs::virus::type_subtype_t{"B"}) {
             if (const auto* master = local::find_master(sc_p->sequence.type_subtype().h_or_b(), masters); master && master != &sc_p->sequence) {
                 // AD_DEBUG("dels {}", sc_p->sequence.name());
-                deletions_insertions(*master, sc_p->sequence);
+                deletions_insertions(*master, sc_p->sequence, banded);
             }
             else
                 AD_WARNING(local::is_whocc_subtype(sc_p->sequence.type_subtype()), "no master for {}", sc_p->sequence.name());
@@ -114,7 +115,7 @@ local::subtype_master_t local::masters_per_subtype(const std::vector<acmacs::seq
 
 // ----------------------------------------------------------------------
 
-void acmacs::seqdb::v3::scan::deletions_insertions(const sequence_t& master, sequence_t& to_align)
+void acmacs::seqdb::v3::scan::deletions_insertions(const sequence_t& master, sequence_t& to_align, banded_alignment banded)
 {
     const acmacs::debug dbg = acmacs::debug::no;
     // const acmacs::debug dbg = local::is_whocc_subtype(to_align.type_subtype()) ? acmacs::debug::yes : acmacs::debug::no;
@@ -122,7 +123,22 @@ void acmacs::seqdb::v3::scan::deletions_insertions(const sequence_t& master, seq
 
     auto master_aa_aligned = master.aa_aligned(), to_align_aa_aligned = to_align.aa_aligned();
     try {
-        to_align.deletions() = deletions_insertions(master_aa_aligned, to_align_aa_aligned, dbg);
+        switch (banded) {
+            case banded_alignment::no:
+                to_align.deletions() = deletions_insertions(master_aa_aligned, to_align_aa_aligned, dbg);
+                break;
+            case banded_alignment::fallback:
+                try {
+                    to_align.deletions() = deletions_insertions(master_aa_aligned, to_align_aa_aligned, dbg);
+                }
+                catch (local::not_verified&) {
+                    to_align.deletions() = deletions_insertions_banded(master_aa_aligned, to_align_aa_aligned, dbg);
+                }
+                break;
+            case banded_alignment::always:
+                to_align.deletions() = deletions_insertions_banded(master_aa_aligned, to_align_aa_aligned, dbg);
+                break;
+        }
     }
     catch (local::not_verified& err) {
         if (local::is_whocc_subtype(to_align.type_subtype())) {
@@ -287,6 +303,38 @@ namespace local
         return number_of_common(acmacs::seqdb::v3::scan::format_aa(deletions.insertions, master), acmacs::seqdb::v3::scan::format_aa(deletions.deletions, to_align));
     }
 
+    inline void verify(std::string_view master, std::string_view to_align, size_t common, const acmacs::seqdb::v3::scan::deletions_insertions_t& deletions)
+    {
+        const auto get_num_non_x = [](std::string_view seq) { return seq.size() - static_cast<size_t>(std::count(std::begin(seq), std::end(seq), 'X')); };
+        const auto num_common_threshold = static_cast<double>(master.size() < to_align.size() ? get_num_non_x(master) : get_num_non_x(to_align)) * verify_threshold;
+        if (static_cast<double>(common) < num_common_threshold) {
+            throw not_verified(fmt::format("common:{} vs size:{} num_common_threshold:{:.2f}\n{}\n{}\n{}\n{}\n",
+                                           common, to_align.size(), num_common_threshold, master, to_align,
+                                           acmacs::seqdb::v3::scan::format_aa(deletions.insertions, master, '.'), acmacs::seqdb::v3::scan::format_aa(deletions.deletions, to_align, '.')));
+        }
+    }
+
+    // ----------------------------------------------------------------------
+    // banded Gotoh alignment, master is along rows (i), to_align is along columns (j)
+
+    namespace banded
+    {
+        using score_t = int32_t;
+        constexpr const score_t match = 4, mismatch = -2, gap_open = -10 /* first gap position */, gap_extend = -1;
+        constexpr const score_t minus_infinity = std::numeric_limits<score_t>::min() / 4;
+        constexpr const ssize_t band_margin = 16; // diagonals around 0 and the length difference
+
+        // traceback byte: source of H in the lower 2 bits, gap extension flags in the upper bits
+        enum : uint8_t { from_diagonal = 0, from_deletion = 1, from_insertion = 2, source_mask = 3, deletion_extended = 4, insertion_extended = 8 };
+
+        inline score_t score(char master_aa, char to_align_aa)
+        {
+            if (master_aa == 'X' || to_align_aa == 'X' || master_aa == '-' || to_align_aa == '-')
+                return 0;
+            return master_aa == to_align_aa ? match : mismatch;
+        }
+    } // namespace banded
+
 }
 
 // ----------------------------------------------------------------------
@@ -332,18 +380,165 @@ acmacs::seqdb::v3::scan::deletions_insertions_t acmacs::seqdb::v3::scan::deletio
     // if (const auto nc = local::number_of_common(master, to_align, deletions); nc != common)
     //     fmt::print(stderr, "common diff: {} vs. number_of_common:{} {}\n{}\n{}\n", common, nc, format(deletions), acmacs::seqdb::v3::scan::format(deletions.insertions, master, '.'), acmacs::seqdb::v3::scan::format(deletions.deletions, to_align, '.'));
 
-    // verify
-    const auto get_num_non_x = [](std::string_view seq) { return seq.size() - static_cast<size_t>(std::count(std::begin(seq), std::end(seq), 'X')); };
-    const auto num_common_threshold = static_cast<double>(master.size() < to_align.size() ? get_num_non_x(master) : get_num_non_x(to_align)) * local::verify_threshold;
-    if (static_cast<double>(common) < num_common_threshold) {
-        throw local::not_verified(fmt::format("common:{} vs size:{} num_common_threshold:{:.2f}\n{}\n{}\n{}\n{}\n",
-                                              common, to_align.size(), num_common_threshold, master, to_align,
-                                              acmacs::seqdb::v3::scan::format_aa(deletions.insertions, master, '.'), acmacs::seqdb::v3::scan::format_aa(deletions.deletions, to_align, '.')));
+    local::verify(master, to_align, common, deletions);
+    return deletions;
+
+} // acmacs::seqdb::v3::scan::deletions_insertions
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::scan::deletions_insertions_t acmacs::seqdb::v3::scan::deletions_insertions_banded(std::string_view master, std::string_view to_align, acmacs::debug dbg)
+{
+    using namespace local::banded;
+
+    const auto num_rows = static_cast<ssize_t>(master.size()), num_cols = static_cast<ssize_t>(to_align.size());
+    const auto length_diff = num_cols - num_rows;
+    const auto max_dels_ins = static_cast<ssize_t>(local::max_deletions_insertions);
+    // band is diagonals d = j - i in [diag_low, diag_high]
+    const ssize_t diag_low = std::max(std::min(0L, length_diff) - band_margin, -max_dels_ins), diag_high = std::min(std::max(0L, length_diff) + band_margin, max_dels_ins);
+    const auto width = static_cast<size_t>(diag_high - diag_low + 1);
+
+    // cell (i, j) is at band index k = j - i - diag_low; rows have one padding cell on each side: (i, j) is at [k + 1]
+    // (i-1, j-1) is at the same index in the previous row, (i-1, j) at index + 1, (i, j-1) at index - 1
+    std::vector<score_t> h_prev(width + 2, minus_infinity), h_cur(width + 2, minus_infinity), f_prev(width + 2, minus_infinity), f_cur(width + 2, minus_infinity), e_cur(width + 2, minus_infinity);
+    std::vector<uint8_t> traceback(static_cast<size_t>(num_rows + 1) * width, from_diagonal);
+    const auto cell = [width, diag_low](ssize_t row, ssize_t col) { return static_cast<size_t>(row) * width + static_cast<size_t>(col - row - diag_low); };
+
+    score_t best_score{minus_infinity};
+    ssize_t best_row{0}, best_col{0};
+    const auto update_best = [&](ssize_t row, ssize_t col, score_t score) {
+        if (score > best_score) {
+            best_score = score;
+            best_row = row;
+            best_col = col;
+        }
+    };
+
+    for (ssize_t row = 0; row <= num_rows; ++row) {
+        std::fill(std::begin(h_cur), std::end(h_cur), minus_infinity);
+        std::fill(std::begin(f_cur), std::end(f_cur), minus_infinity);
+        std::fill(std::begin(e_cur), std::end(e_cur), minus_infinity);
+        // band of the row may lie entirely past the last column if to_align is much shorter than master (e.g. partial HA1)
+        const ssize_t band_first = std::max(0L, -(row + diag_low)), band_last = std::min(static_cast<ssize_t>(width) - 1, num_cols - row - diag_low);
+        if (band_last < band_first) {
+            std::swap(h_prev, h_cur);
+            std::swap(f_prev, f_cur);
+            continue;
+        }
+        const auto k_first = static_cast<size_t>(band_first), k_last = static_cast<size_t>(band_last);
+        uint8_t* const tb = traceback.data() + static_cast<size_t>(row) * width;
+
+        if (row == 0) {
+            h_cur[k_first + 1] = 0; // cell (0, 0), k_first = -diag_low
+        }
+        else {
+            // diagonal and vertical (deletion) moves depend on the previous row only, loop is branch free
+            const auto master_aa = master[static_cast<size_t>(row - 1)];
+            for (size_t k = k_first; k <= k_last; ++k) {
+                const auto col = row + diag_low + static_cast<ssize_t>(k);
+                const score_t diagonal = col > 0 ? h_prev[k + 1] + score(master_aa, to_align[static_cast<size_t>(col - 1)]) : minus_infinity;
+                const score_t open = h_prev[k + 2] + gap_open, extend = f_prev[k + 2] + gap_extend;
+                f_cur[k + 1] = std::max(open, extend);
+                h_cur[k + 1] = std::max(diagonal, f_cur[k + 1]);
+                tb[k] = static_cast<uint8_t>((f_cur[k + 1] > diagonal ? from_deletion : from_diagonal) | (extend > open ? deletion_extended : 0));
+            }
+        }
+
+        // horizontal (insertion) moves depend on the cell to the left
+        for (size_t k = k_first; k <= k_last; ++k) {
+            if (const auto col = row + diag_low + static_cast<ssize_t>(k); col > 0) {
+                const score_t open = h_cur[k] + gap_open, extend = e_cur[k] + gap_extend;
+                e_cur[k + 1] = std::max(open, extend);
+                if (extend > open)
+                    tb[k] |= insertion_extended;
+                if (e_cur[k + 1] > h_cur[k + 1]) {
+                    h_cur[k + 1] = e_cur[k + 1];
+                    tb[k] = static_cast<uint8_t>((tb[k] & ~source_mask) | from_insertion);
+                }
+            }
+        }
+
+        // free end gaps: alignment may end at the last row or at the last column
+        if (row == num_rows) {
+            for (size_t k = k_first; k <= k_last; ++k)
+                update_best(row, row + diag_low + static_cast<ssize_t>(k), h_cur[k + 1]);
+        }
+        else if (const auto k_last_col = num_cols - row - diag_low; k_last_col >= 0 && k_last_col < static_cast<ssize_t>(width))
+            update_best(row, num_cols, h_cur[static_cast<size_t>(k_last_col) + 1]);
+
+        std::swap(h_prev, h_cur);
+        std::swap(f_prev, f_cur);
+    }
+
+    // traceback
+    enum class state_t { h, deletion, insertion };
+    struct step_t
+    {
+        state_t move;
+        ssize_t row, col; // before the move
+    };
+    std::vector<step_t> path;
+    auto state{state_t::h};
+    for (ssize_t row = best_row, col = best_col; row > 0 || col > 0;) {
+        const auto tb = traceback[cell(row, col)];
+        switch (state) {
+            case state_t::h:
+                switch (tb & source_mask) {
+                    case from_deletion:
+                        state = state_t::deletion;
+                        break;
+                    case from_insertion:
+                        state = state_t::insertion;
+                        break;
+                    default:
+                        path.push_back({state_t::h, row, col});
+                        --row;
+                        --col;
+                        break;
+                }
+                break;
+            case state_t::deletion:
+                path.push_back({state_t::deletion, row, col});
+                state = (tb & deletion_extended) ? state_t::deletion : state_t::h;
+                --row;
+                break;
+            case state_t::insertion:
+                path.push_back({state_t::insertion, row, col});
+                state = (tb & insertion_extended) ? state_t::insertion : state_t::h;
+                --col;
+                break;
+        }
     }
 
+    deletions_insertions_t deletions;
+    size_t common{0};
+    auto previous_move{state_t::h};
+    for (auto step = path.rbegin(); step != path.rend(); previous_move = step->move, ++step) {
+        switch (step->move) {
+            case state_t::h:
+                if (local::are_common(master[static_cast<size_t>(step->row - 1)], to_align[static_cast<size_t>(step->col - 1)]))
+                    ++common;
+                break;
+            case state_t::deletion: // master aa aligned with gap in to_align
+                if (previous_move == state_t::deletion)
+                    ++deletions.deletions.back().num;
+                else
+                    deletions.deletions.push_back({pos0_t{static_cast<size_t>(step->col)}, 1});
+                break;
+            case state_t::insertion: // to_align aa aligned with gap in master
+                if (previous_move == state_t::insertion)
+                    ++deletions.insertions.back().num;
+                else
+                    deletions.insertions.push_back({pos0_t{static_cast<size_t>(step->row)}, 1});
+                break;
+        }
+    }
+
+    AD_DEBUG(dbg, "banded: diagonals {}..{} score:{} end:{}:{} common:{} {}", diag_low, diag_high, best_score, best_row, best_col, common, deletions);
+    local::verify(master, to_align, common, deletions);
     return deletions;
 
-} // acmacs::seqdb::v3::scan::deletions_insertions
+} // acmacs::seqdb::v3::scan::deletions_insertions_banded
 
 // ----------------------------------------------------------------------
 /// Local Variables:
@@ -11,12 +11,16 @@ namespace acmacs::seqdb
     {
         namespace scan
         {
-            void detect_insertions_deletions(std::vector<fasta::scan_result_t>& sequence_data);
+            enum class banded_alignment { no, fallback /* if heuristic is not verified */, always };
+
+            void detect_insertions_deletions(std::vector<fasta::scan_result_t>& sequence_data, banded_alignment banded = banded_alignment::no);
 
             // ----------------------------------------------------------------------
 
-            void deletions_insertions(const sequence_t& master, sequence_t& to_align);
+            void deletions_insertions(const sequence_t& master, sequence_t& to_align, banded_alignment banded = banded_alignment::no);
             deletions_insertions_t deletions_insertions(std::string_view master, std::string_view to_align, acmacs::debug dbg = acmacs::debug::no);
+            // affine gap global alignment (free end gaps) within the band derived from the length difference
+            deletions_insertions_t deletions_insertions_banded(std::string_view master, std::string_view to_align, acmacs::debug dbg = acmacs::debug::no);
 
         } // namespace scan
     }     // namespace v3
@@ -1,4 +1,5 @@
 #include <map>
+#include <unordered_map>
 
 #include "acmacs-base/fmt.hh"
 #include "acmacs-base/regex.hh"
@@ -143,35 +144,67 @@ void acmacs::seqdb::v3::scan::fasta::remove_without_names(std::vector<fasta::sca
 
 void acmacs::seqdb::v3::scan::fasta::merge_duplicates(std::vector<fasta::scan_result_t>& sequences)
 {
-    sort_by_name(sequences);
-
-    const auto merge = [](auto first, auto last) {
-        if ((last - first) > 1 && !first->sequence.nuc().empty()) {
-            std::vector<decltype(first)> entries(static_cast<size_t>(last - first));
-            std::generate(std::begin(entries), std::end(entries), [it = first]() mutable { return it++; });
-            std::sort(std::begin(entries), std::end(entries), [](const auto& it1, const auto& it2) { return it1->sequence.nuc() < it2->sequence.nuc(); });
-            auto master = entries.front();
-            for (auto it = std::next(entries.begin()); it != entries.end(); ++it) {
-                if (master->sequence.nuc() == (*it)->sequence.nuc()) {
-                    master->sequence.merge_from((*it)->sequence);
-                    (*it)->remove = true;
-                }
-                else
-                    master = *it;
-            }
-        }
+    // Sequences are aggregated by (designation, nuc) using hash partitions, each partition is processed by its own thread.
+    // The first sequence (in the input order) of each group becomes master, the rest are merged into it in the input order,
+    // i.e. the result does not depend on the number of threads. Sequences with empty nucs are never merged.
+
+    constexpr size_t number_of_partitions{64};
+
+    struct key_t
+    {
+        std::string designation; // precomputed, fields separated by '\0' to keep ordering of designation() tuple
+        size_t hash;
+        size_t partition;
     };
 
-    auto start = sequences.begin();
-    for (auto it = std::next(start); it != sequences.end(); ++it) {
-        if (designation(it->sequence) != designation(start->sequence)) {
-            merge(start, it);
-            start = it;
+    std::vector<key_t> keys(sequences.size());
+#pragma omp parallel for default(shared) schedule(static, 1024)
+    for (size_t seq_no = 0; seq_no < sequences.size(); ++seq_no) {
+        const auto& seq = sequences[seq_no].sequence;
+        auto& key = keys[seq_no];
+        key.designation.append(*seq.name()).append(1, '\0').append(seq.annotations()).append(1, '\0').append(*seq.reassortant());
+        key.hash = std::hash<std::string>{}(key.designation) ^ (std::hash<std::string_view>{}(seq.nuc()) * 0x9E3779B97F4A7C15UL);
+        key.partition = key.hash % number_of_partitions;
+    }
+
+    std::array<std::vector<size_t>, number_of_partitions> partitions;
+    for (size_t seq_no = 0; seq_no < sequences.size(); ++seq_no) {
+        if (!sequences[seq_no].sequence.nuc().empty())
+            partitions[keys[seq_no].partition].push_back(seq_no);
+    }
+
+#pragma omp parallel for default(shared) schedule(dynamic, 1)
+    for (size_t part_no = 0; part_no < number_of_partitions; ++part_no) {
+        std::unordered_multimap<size_t, size_t> masters; // hash -> master seq_no
+        masters.reserve(partitions[part_no].size());
+        for (const auto seq_no : partitions[part_no]) {
+            const auto& key = keys[seq_no];
+            auto& seq = sequences[seq_no].sequence;
+            const auto [first, last] = masters.equal_range(key.hash);
+            const auto master = std::find_if(first, last, [&](const auto& en) { return keys[en.second].designation == key.designation && sequences[en.second].sequence.nuc() == seq.nuc(); });
+            if (master != last) {
+                sequences[master->second].sequence.merge_from(seq);
+                sequences[seq_no].remove = true;
+            }
+            else
+                masters.emplace(key.hash, seq_no);
         }
     }
-    merge(start, sequences.end());
 
-    sequences.erase(std::remove_if(std::begin(sequences), std::end(sequences), [](const auto& sr) { return sr.remove; }), std::end(sequences));
+    // keep sequences sorted by name as before
+    std::vector<size_t> order;
+    order.reserve(sequences.size());
+    for (size_t seq_no = 0; seq_no < sequences.size(); ++seq_no) {
+        if (!sequences[seq_no].remove)
+            order.push_back(seq_no);
+    }
+    std::stable_sort(std::begin(order), std::end(order), [&keys](size_t e1, size_t e2) { return keys[e1].designation < keys[e2].designation; });
+
+    std::vector<fasta::scan_result_t> merged;
+    merged.reserve(order.size());
+    for (const auto seq_no : order)
+        merged.push_back(std::move(sequences[seq_no]));
+    sequences = std::move(merged);
 
 } // acmacs::seqdb::v3::scan::fasta::merge_duplicates
 
@@ -1,86 +1,9 @@
 #include <map>
 
-#include "acmacs-base/filesystem.hh"
-#include "acmacs-base/acmacsd.hh"
-#include "acmacs-base/settings-v3.hh"
-#include "acmacs-base/rjson-v3.hh"
 #include "acmacs-base/counter.hh"
 #include "seqdb-3/scan-lineages.hh"
 #include "seqdb-3/scan-fasta.hh"
-#include "seqdb-3/aa-at-pos.hh"
-
-// ----------------------------------------------------------------------
-
-class CladeDefinitions : public acmacs::settings::v3::Data
-{
-  public:
-    CladeDefinitions()
-    {
-        using namespace std::string_literals;
-        using namespace std::string_view_literals;
-
-        if (const auto filename = fmt::format("{}/share/conf/clades.json", acmacs::acmacsd_root()); fs::exists(filename))
-            acmacs::settings::v3::Data::load(filename);
-        else
-            throw std::runtime_error{fmt::format("WARNING: cannot load \"{}\": file not found\n", filename)};
-
-        using pp = std::pair<std::string, std::string_view>;
-        for (const auto& [virus_type, tag] : {pp{"H1"s, "clades-A(H1N1)2009pdm"sv}, pp{"H3"s, "clades-A(H3N2)"sv}, pp{"BVICTORIA"s, "clades-B/Vic"sv}, pp{"BYAMAGATA"s, "clades-B/Yam"sv}}) {
-            current_virus_type_ = virus_type;
-            apply(tag);
-        }
-    }
-
-    bool apply_built_in(std::string_view name) override // returns true if built-in command with that name found and applied
-    {
-        using namespace std::string_view_literals;
-        if (name == "clade"sv) {
-            const auto& aa_field = getenv("aa"sv);
-            auto aa = aa_field.is_null() ? acmacs::seqdb::amino_acid_at_pos1_eq_list_t{} : acmacs::seqdb::extract_aa_at_pos1_eq_list(aa_field);
-            const auto& nuc_field = getenv("nuc"sv);
-            auto nuc = nuc_field.is_null() ? acmacs::seqdb::nucleotide_at_pos1_eq_list_t{} : acmacs::seqdb::extract_nuc_at_pos1_eq_list(nuc_field);
-            add(current_virus_type_, getenv_or("name"sv, ""sv), std::move(aa), std::move(nuc));
-        }
-        else
-            return acmacs::settings::v3::Data::apply_built_in(name);
-        return true;
-    }
-
-    bool matches(const acmacs::seqdb::v3::scan::sequence_t& seq, const acmacs::seqdb::amino_acid_at_pos1_eq_list_t& aa_at_pos) const
-    {
-        return std::all_of(std::begin(aa_at_pos), std::end(aa_at_pos), [&seq](const acmacs::seqdb::amino_acid_at_pos1_eq_t& pos1_aa) {
-            return (seq.aa_at_pos(std::get<acmacs::seqdb::pos1_t>(pos1_aa)) == std::get<char>(pos1_aa)) == std::get<bool>(pos1_aa);
-        });
-    }
-
-    bool matches(const acmacs::seqdb::v3::scan::sequence_t& seq, const acmacs::seqdb::nucleotide_at_pos1_eq_list_t& nuc_at_pos) const
-    {
-        return std::all_of(std::begin(nuc_at_pos), std::end(nuc_at_pos), [&seq](const acmacs::seqdb::nucleotide_at_pos1_eq_t& pos1_nuc) {
-            return (seq.nuc_at_pos(std::get<acmacs::seqdb::pos1_t>(pos1_nuc)) == std::get<char>(pos1_nuc)) == std::get<bool>(pos1_nuc);
-        });
-    }
-
-    void add_clades(acmacs::seqdb::v3::scan::sequence_t& sequence, const std::string& virus_type)
-    {
-        if (auto found = data_.find(virus_type); found != std::end(data_)) {
-            for (const auto& [clade_name, aa_at_pos, nuc_at_pos] : found->second) {
-                if ((aa_at_pos.empty() || matches(sequence, aa_at_pos)) && (nuc_at_pos.empty() || matches(sequence, nuc_at_pos)))
-                    sequence.add_clade(clade_name);
-            }
-        }
-        else
-            AD_WARNING("no clade definitions for {} seq: {}", virus_type, sequence.name());
-    }
-
-  private:
-    std::string current_virus_type_;
-    std::map<std::string, std::vector<std::tuple<acmacs::seqdb::v3::clade_t, acmacs::seqdb::amino_acid_at_pos1_eq_list_t, acmacs::seqdb::nucleotide_at_pos1_eq_list_t>>, std::less<>> data_;
-
-    void add(const std::string& virus_type, std::string_view clade_name, acmacs::seqdb::amino_acid_at_pos1_eq_list_t&& aa_at_pos, acmacs::seqdb::nucleotide_at_pos1_eq_list_t&& nuc_at_pos)
-    {
-        data_[virus_type].emplace_back(acmacs::seqdb::v3::clade_t{clade_name}, std::move(aa_at_pos), std::move(nuc_at_pos));
-    }
-};
+#include "seqdb-3/clades.hh"
 
 // ----------------------------------------------------------------------
 
@@ -101,6 +24,8 @@ namespace local
         static void deletions(acmacs::seqdb::v3::scan::sequence_t& sequence, std::string_view fasta_ref);
     } // namespace H3
 
+    static void add_clades(const acmacs::seqdb::CladeDefinitions& clade_definitions, acmacs::seqdb::v3::scan::sequence_t& sequence, std::string_view virus_type);
+
 } // namespace local
 
 // ----------------------------------------------------------------------
@@ -108,7 +33,7 @@ namespace local
 void acmacs::seqdb::v3::scan::detect_lineages_clades(std::vector<fasta::scan_result_t>& sequences)
 {
 
-    CladeDefinitions clade_definitions;
+    const CladeDefinitions clade_definitions;
 
 #pragma omp parallel for default(shared) schedule(static, 256)
     for (size_t e_no = 0; e_no < sequences.size(); ++e_no) {
@@ -118,15 +43,15 @@ void acmacs::seqdb::v3::scan::detect_lineages_clades(std::vector<fasta::scan_res
             if (subtype == "B") {
                 local::B::lineage(entry.sequence, fasta_ref, entry.fasta.lineage);
                 if (!entry.sequence.lineage().empty()) // no clade definitions without lineage
-                    clade_definitions.add_clades(entry.sequence, fmt::format("{}{}", subtype, entry.sequence.lineage()));
+                    local::add_clades(clade_definitions, entry.sequence, fmt::format("{}{}", subtype, entry.sequence.lineage()));
             }
             else if (subtype == "H1") {
                 local::H1::deletions(entry.sequence, fasta_ref);
-                clade_definitions.add_clades(entry.sequence, std::string{subtype});
+                local::add_clades(clade_definitions, entry.sequence, subtype);
             }
             else if (subtype == "H3") {
                 local::H3::deletions(entry.sequence, fasta_ref);
-                clade_definitions.add_clades(entry.sequence, std::string{subtype});
+                local::add_clades(clade_definitions, entry.sequence, subtype);
             }
         }
     }
@@ -146,6 +71,21 @@ void acmacs::seqdb::v3::scan::detect_lineages_clades(std::vector<fasta::scan_res
 
 } // acmacs::seqdb::v3::scan::detect_lineages_clades
 
+// ----------------------------------------------------------------------
+
+void local::add_clades(const acmacs::seqdb::CladeDefinitions& clade_definitions, acmacs::seqdb::v3::scan::sequence_t& sequence, std::string_view virus_type)
+{
+    if (clade_definitions.has(virus_type)) {
+        const auto clades = clade_definitions.clades(
+            virus_type, [&sequence](acmacs::seqdb::pos0_t pos0) { return sequence.aa_at_pos(pos0); }, [&sequence](acmacs::seqdb::pos0_t pos0) { return sequence.nuc_at_pos(pos0); });
+        for (const auto& clade_name : clades)
+            sequence.add_clade(acmacs::seqdb::v3::clade_t{clade_name});
+    }
+    else
+        AD_WARNING("no clade definitions for {} seq: {}", virus_type, sequence.name());
+
+} // local::add_clades
+
 // ****************************************************************************************************
 // B
 // ****************************************************************************************************
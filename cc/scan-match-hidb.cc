@@ -1,3 +1,5 @@
+#include <unordered_map>
+
 #include "acmacs-base/string-matcher.hh"
 #include "hidb-5/hidb.hh"
 #include "seqdb-3/scan-match-hidb.hh"
@@ -26,13 +28,18 @@ namespace acmacs::seqdb::inline v3
 
 } // namespace acmacs::seqdb::inline v3
 
-using lab_id_index_entry_t = std::pair<std::string_view, const hidb::bin::Antigen*>;
+// immutable indexes built once before matching, accessed from multiple threads
+using hidb_index_t = std::unordered_map<std::string, hidb::AntigenIndexList>;
 
 struct hidb_ref_t
 {
     const hidb::HiDb& hidb;
     std::shared_ptr<hidb::Antigens> antigens;
-    std::vector<lab_id_index_entry_t> lab_id_index;
+    hidb_index_t lab_id_index; // "CDC#<id>" -> antigens
+    hidb_index_t name_index;   // name -> antigens
+    acmacs::seqdb::scan::hidb_find_by_name_t find_by_name; // used instead of name_index, if set
+
+    hidb_ref_t(const hidb::HiDb& a_hidb, const acmacs::seqdb::scan::hidb_find_by_name_t& a_find_by_name = {});
 };
 
 using Matching = std::vector<std::vector<acmacs::seqdb::v3::score_seq_found_t>>;
@@ -40,37 +47,50 @@ using Matching = std::vector<std::vector<acmacs::seqdb::v3::score_seq_found_t>>;
 using seq_iter_t = std::vector<acmacs::seqdb::scan::fasta::scan_result_t>::iterator;
 
 using seq_ptr_list_t = std::vector<acmacs::seqdb::scan::sequence_t*>;
-using hi_to_seq_t = std::map<std::pair<const hidb_ref_t*, hidb::AntigenIndex>, seq_ptr_list_t>;
+using hi_to_seq_key_t = std::pair<const hidb_ref_t*, hidb::AntigenIndex>;
+using hi_to_seq_t = std::map<hi_to_seq_key_t, seq_ptr_list_t>;
+using hi_to_seq_entries_t = std::vector<std::pair<hi_to_seq_key_t, acmacs::seqdb::scan::sequence_t*>>; // matching result for a name group
 
-static void match(const hidb_ref_t& hidb_ref, seq_iter_t first, seq_iter_t last, std::string_view subtype, hi_to_seq_t& hi_to_seq);
+static void match(const hidb_ref_t& hidb_ref, seq_iter_t first, seq_iter_t last, std::string_view subtype, hi_to_seq_entries_t& hi_to_seq);
 static void find_by_lab_id(hidb::AntigenIndexList& found, const hidb_ref_t& hidb_ref, seq_iter_t first, seq_iter_t last);
 static void find_by_name(hidb::AntigenIndexList& found, const hidb_ref_t& hidb_ref, seq_iter_t first, seq_iter_t last);
 static Matching make_matching(seq_iter_t first, seq_iter_t last, const hidb::AntigenPList& found);
-static void match_greedy(seq_iter_t first, const hidb::AntigenIndexList& found, const Matching& matching, const hidb_ref_t& hidb_ref, hi_to_seq_t& hi_to_seq);
+static void match_greedy(seq_iter_t first, const hidb::AntigenIndexList& found, const Matching& matching, const hidb_ref_t& hidb_ref, hi_to_seq_entries_t& hi_to_seq);
 // static bool match_normal(seq_iter_t first, const hidb::AntigenPList& found, const Matching& matching);
 static void update_seqdb(hi_to_seq_t& hi_to_seq);
 
 // ----------------------------------------------------------------------
 
-void acmacs::seqdb::v3::scan::match_hidb(std::vector<fasta::scan_result_t>& sequences)
+void acmacs::seqdb::v3::scan::match_hidb(std::vector<fasta::scan_result_t>& sequences, const hidb_find_by_name_t& find_by_name)
 {
     AD_INFO("INFO: matching against hidb");
     acmacs::seqdb::scan::fasta::sort_by_name(sequences); // sequences must be sorted by name!
     std::map<std::string, hidb_ref_t, std::less<>> hidbs;
-    for (const std::string_view subtype : {"B", "H1", "H3"}) {
-        const auto& hidb = hidb::get(acmacs::virus::type_subtype_t{subtype}, report_time::no);
-        auto hidb_antigens = hidb.antigens();
-        hidbs.emplace(std::string{subtype}, hidb_ref_t{hidb, hidb_antigens, hidb_antigens->sorted_by_labid()});
-    }
+    for (const std::string_view subtype : {"B", "H1", "H3"})
+        hidbs.try_emplace(std::string{subtype}, hidb::get(acmacs::virus::type_subtype_t{subtype}, report_time::no), find_by_name);
 
-    hi_to_seq_t hi_to_seq;
+    std::vector<std::pair<seq_iter_t, seq_iter_t>> name_groups;
     for (auto en_first = sequences.begin(); en_first != sequences.end();) {
         const auto en_last = std::find_if(std::next(en_first), sequences.end(), [name = en_first->sequence.name()](const auto& en) { return en.sequence.name() != name; });
-        if (const auto hb = en_first->sequence.type_subtype().h_or_b(); hb == "B" || hb == "H1" || hb == "H3")
-            match(hidbs.find(hb)->second, en_first, en_last, hb, hi_to_seq);
+        name_groups.emplace_back(en_first, en_last);
         en_first = en_last;
     }
 
+    // name groups are matched in parallel, results are merged in the order of groups, i.e. as if matched serially
+    std::vector<hi_to_seq_entries_t> hi_to_seq_per_group(name_groups.size());
+#pragma omp parallel for default(shared) schedule(dynamic, 64)
+    for (size_t group_no = 0; group_no < name_groups.size(); ++group_no) {
+        const auto [en_first, en_last] = name_groups[group_no];
+        if (const auto hb = en_first->sequence.type_subtype().h_or_b(); hb == "B" || hb == "H1" || hb == "H3")
+            match(hidbs.find(hb)->second, en_first, en_last, hb, hi_to_seq_per_group[group_no]);
+    }
+
+    hi_to_seq_t hi_to_seq;
+    for (const auto& group_entries : hi_to_seq_per_group) {
+        for (const auto& [key, seq] : group_entries)
+            hi_to_seq.try_emplace(key, seq_ptr_list_t{}).first->second.push_back(seq);
+    }
+
     update_seqdb(hi_to_seq);
 
     AD_INFO("INFO: matched against hidb: {}", hi_to_seq.size());
@@ -79,6 +99,42 @@ void acmacs::seqdb::v3::scan::match_hidb(std::vector<fasta::scan_result_t>& sequ
 
 // ----------------------------------------------------------------------
 
+hidb_ref_t::hidb_ref_t(const hidb::HiDb& a_hidb, const acmacs::seqdb::scan::hidb_find_by_name_t& a_find_by_name) : hidb{a_hidb}, antigens{a_hidb.antigens()}, find_by_name{a_find_by_name}
+{
+    for (const auto& [lab_id, antigen] : antigens->sorted_by_labid()) {
+        if (lab_id.substr(0, 4) == "CDC#")
+            lab_id_index[std::string{lab_id}].push_back(antigens->index(antigen));
+    }
+
+    // the same lookup as antigens->find(name, hidb::fix_location::no, hidb::find_fuzzy::no)
+    for (size_t antigen_no = 0; antigen_no < antigens->size(); ++antigen_no) {
+        const hidb::AntigenIndex antigen_index{antigen_no};
+        name_index[fmt::format("{}", antigens->at(antigen_index)->name())].push_back(antigen_index);
+    }
+
+} // hidb_ref_t::hidb_ref_t
+
+// ----------------------------------------------------------------------
+
+std::vector<std::string> acmacs::seqdb::v3::scan::hidb_name_index_differences(std::string_view subtype)
+{
+    const hidb_ref_t hidb_ref{hidb::get(acmacs::virus::type_subtype_t{subtype}, report_time::no)};
+    std::vector<std::string> differences;
+    for (const auto& [name, by_index] : hidb_ref.name_index) {
+        auto by_find = hidb_ref.antigens->find(name, hidb::fix_location::no, hidb::find_fuzzy::no);
+        auto by_index_sorted = by_index;
+        std::sort(std::begin(by_find), std::end(by_find));
+        std::sort(std::begin(by_index_sorted), std::end(by_index_sorted));
+        if (by_find != by_index_sorted)
+            differences.push_back(name);
+    }
+    std::sort(std::begin(differences), std::end(differences));
+    return differences;
+
+} // acmacs::seqdb::v3::scan::hidb_name_index_differences
+
+// ----------------------------------------------------------------------
+
 void update_seqdb(hi_to_seq_t& hi_to_seq)
 {
     const auto update = [](const auto& hi, acmacs::seqdb::v3::scan::sequence_t& seq) {
@@ -122,7 +178,7 @@ void update_seqdb(hi_to_seq_t& hi_to_seq)
 
 // ----------------------------------------------------------------------
 
-void match(const hidb_ref_t& hidb_ref, seq_iter_t first, seq_iter_t last, std::string_view subtype, hi_to_seq_t& hi_to_seq)
+void match(const hidb_ref_t& hidb_ref, seq_iter_t first, seq_iter_t last, std::string_view subtype, hi_to_seq_entries_t& hi_to_seq)
 {
     hidb::AntigenIndexList found_hidb_antigens;
     find_by_lab_id(found_hidb_antigens, hidb_ref, first, last);
@@ -182,7 +238,7 @@ Matching make_matching(seq_iter_t first, seq_iter_t last, const hidb::AntigenPLi
 // greedy matching: add all hi-names having matching reassortant and passage type (egg/cell) regardless of score
 // if antigen is in multiple matching entries, use the one with the highest score
 // returns if at least one seq matched
-void match_greedy(seq_iter_t first, const hidb::AntigenIndexList& found, const Matching& matching, const hidb_ref_t& hidb_ref, hi_to_seq_t& hi_to_seq)
+void match_greedy(seq_iter_t first, const hidb::AntigenIndexList& found, const Matching& matching, const hidb_ref_t& hidb_ref, hi_to_seq_entries_t& hi_to_seq)
 {
     std::map<size_t, acmacs::seqdb::v3::score_seq_found_t> antigen_to_matching; // antigen index in found to (matching index and score)
     for (const auto& mp : matching) {
@@ -198,7 +254,7 @@ void match_greedy(seq_iter_t first, const hidb::AntigenIndexList& found, const M
     // AD_DEBUG("match_greedy");
     for (const auto& en : antigen_to_matching) {
         auto& sequence = std::next(first, static_cast<ssize_t>(en.second.seq_no))->sequence;
-        hi_to_seq.try_emplace(std::make_pair(&hidb_ref, found[en.first]), seq_ptr_list_t{}).first->second.push_back(&sequence);
+        hi_to_seq.emplace_back(std::make_pair(&hidb_ref, found[en.first]), &sequence);
     }
 
 } // match_greedy
@@ -242,11 +298,8 @@ void find_by_lab_id(hidb::AntigenIndexList& found, const hidb_ref_t& hidb_ref, s
         const auto& sequence = first->sequence;
         if (const auto cdcids = sequence.lab_ids().find(acmacs::uppercase{"CDC"}); cdcids != sequence.lab_ids().end() && !cdcids->second.empty()) {
             for (const auto& cdcid_raw : cdcids->second) {
-                const auto cdcid = fmt::format("CDC#{}", cdcid_raw);
-                auto [hidb_first, hidb_last] = std::equal_range(std::begin(hidb_ref.lab_id_index), std::end(hidb_ref.lab_id_index), lab_id_index_entry_t{std::string_view(cdcid), nullptr},
-                                                                [](const auto& e1, const auto& e2) { return e1.first < e2.first; });
-                for (; hidb_first != hidb_last; ++hidb_first)
-                    found.push_back(hidb_ref.antigens->index(hidb_first->second));
+                if (const auto hidb_found = hidb_ref.lab_id_index.find(fmt::format("CDC#{}", cdcid_raw)); hidb_found != hidb_ref.lab_id_index.end())
+                    std::copy(hidb_found->second.begin(), hidb_found->second.end(), std::back_inserter(found));
             }
         }
     }
@@ -260,8 +313,12 @@ void find_by_name(hidb::AntigenIndexList& found, const hidb_ref_t& hidb_ref, seq
     for (; first != last; ++first) {
         const auto& sequence = first->sequence;
         // AD_DEBUG("find antigen in hidb: \"{}\"", *sequence.name());
-        const auto antigen_index_list = hidb_ref.antigens->find(*sequence.name(), hidb::fix_location::no, hidb::find_fuzzy::no);
-        std::copy(antigen_index_list.begin(), antigen_index_list.end(), std::back_inserter(found));
+        if (hidb_ref.find_by_name) {
+            const auto antigen_index_list = hidb_ref.find_by_name(*hidb_ref.antigens, *sequence.name());
+            std::copy(antigen_index_list.begin(), antigen_index_list.end(), std::back_inserter(found));
+        }
+        else if (const auto hidb_found = hidb_ref.name_index.find(*sequence.name()); hidb_found != hidb_ref.name_index.end())
+            std::copy(hidb_found->second.begin(), hidb_found->second.end(), std::back_inserter(found));
     }
 
 } // find_by_name
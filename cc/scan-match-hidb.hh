@@ -1,6 +1,11 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <string_view>
+#include <functional>
+
+#include "hidb-5/hidb.hh"
 
 // ----------------------------------------------------------------------
 
@@ -13,8 +18,17 @@ namespace acmacs::seqdb::inline v3
             struct scan_result_t;
         }
 
+        // antigens of the hidb having the name, called by match_hidb for each sequence
+        using hidb_find_by_name_t = std::function<hidb::AntigenIndexList(const hidb::Antigens& antigens, std::string_view name)>;
+
         // sequences msut be sorted by name!
-        void match_hidb(std::vector<fasta::scan_result_t>& sequences);
+        // find_by_name: empty - the name index built from hidb (exact name), otherwise it is called instead of the index
+        // (test-match-hidb passes hidb::Antigens::find as a reference, it is not thread safe, match_hidb is then run in one thread)
+        void match_hidb(std::vector<fasta::scan_result_t>& sequences, const hidb_find_by_name_t& find_by_name = {});
+
+        // names of antigens of the subtype ("B", "H1", "H3") hidb for which the name index used by match_hidb
+        // finds antigens different from hidb::Antigens::find(name, fix_location::no, find_fuzzy::no), used by test-match-hidb
+        std::vector<std::string> hidb_name_index_differences(std::string_view subtype);
 
     } // namespace scan
 } // namespace acmacs::seqdb::inline v3
@@ -1,8 +1,11 @@
+#include <numeric>
+
 #include "acmacs-base/counter.hh"
 #include "acmacs-base/enumerate.hh"
 #include "acmacs-base/omp.hh"
 #include "seqdb-3/seqdb.hh"
 #include "seqdb-3/hamming-distance.hh"
+#include "seqdb-3/packed-sequence.hh"
 #include "seqdb-3/log.hh"
 
 // ----------------------------------------------------------------------
@@ -12,14 +15,14 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::nuc_hamming_distance_mean(
     if (threshold > 0 && size_threshold > 0 && !refs_.empty()) {
         struct Entry
         {
-            sequence_aligned_ref_t nucs;
+            packed_sequences_t::sequence_t nucs;
             size_t hamming_distance_sum{0};
             size_t ref_index{static_cast<size_t>(-1)};
             std::string_view date;
 
             void assign(size_t index, const ref& ref)
             {
-                nucs = ref.seq().nuc_aligned_master();
+                nucs = ref.seq().nucs.aligned;
                 date = ref.entry->date();
                 hamming_distance_sum = 0;
                 ref_index = index;
@@ -66,9 +69,10 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::nuc_hamming_distance_to(si
             throw std::runtime_error{fmt::format("no sequences with seq-id \"{}\" found (seqdb::v3::subset::nuc_hamming_distance_to)", seq_id)};
         const auto before{refs_.size()};
         refs_.erase(std::remove_if(std::next(std::begin(refs_)), std::end(refs_),
-                                   [threshold, &seqdb, comapre_to_seq = compare_to.front().nuc_aligned(seqdb)](auto& en) {
-                                       en.hamming_distance = hamming_distance(en.nuc_aligned(seqdb), comapre_to_seq, hamming_distance_by_shortest::no);
-                                       return en.hamming_distance >= threshold;
+                                   [this, threshold, &seqdb, comapre_to_seq = compare_to.front().seq_with_sequence(seqdb).nucs.aligned](const auto& en) {
+                                       const auto distance = hamming_distance(en.seq_with_sequence(seqdb).nucs.aligned, comapre_to_seq, hamming_distance_by_shortest::no);
+                                       annotations_[en].hamming_distance = distance;
+                                       return distance >= threshold;
                                    }),
                     std::end(refs_));
         const auto after{refs_.size()};
@@ -91,9 +95,10 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::nuc_hamming_distance_to_ba
         const auto& seqdb = acmacs::seqdb::get();
         const auto before{refs_.size()};
         refs_.erase(std::remove_if(std::next(std::begin(refs_)), std::end(refs_),
-                                   [threshold, &seqdb, base_seq = refs_.front().nuc_aligned(seqdb)](auto& en) {
-                                       en.hamming_distance = hamming_distance(en.nuc_aligned(seqdb), base_seq, hamming_distance_by_shortest::no);
-                                       return en.hamming_distance >= threshold;
+                                   [this, threshold, &seqdb, base_seq = refs_.front().seq_with_sequence(seqdb).nucs.aligned](const auto& en) {
+                                       const auto distance = hamming_distance(en.seq_with_sequence(seqdb).nucs.aligned, base_seq, hamming_distance_by_shortest::no);
+                                       annotations_[en].hamming_distance = distance;
+                                       return distance >= threshold;
                                    }),
                     std::end(refs_));
         const auto after{refs_.size()};
@@ -110,11 +115,11 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::nuc_hamming_distance_to_ba
 acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::report_hamming_distance(bool do_report)
 {
     if (do_report) {
-        std::vector<const ref*> refs(refs_.size());
-        std::transform(std::begin(refs_), std::end(refs_), std::begin(refs), [](const auto& rr) { return &rr; });
-        std::sort(std::begin(refs), std::end(refs), [](const ref* r1, const ref* r2) { return r1->hamming_distance > r2->hamming_distance; });
-        for (const auto& en : refs)
-            fmt::print("{:4d}  {}\n", en->hamming_distance, en->seq_id());
+        std::vector<std::pair<size_t, const ref*>> refs(refs_.size());
+        std::transform(std::begin(refs_), std::end(refs_), std::begin(refs), [this](const auto& rr) { return std::pair{hamming_distance_of(rr), &rr}; });
+        std::sort(std::begin(refs), std::end(refs), [](const auto& r1, const auto& r2) { return r1.first > r2.first; });
+        for (const auto& [distance, en] : refs)
+            fmt::print("{:4d}  {}\n", distance, en->seq_id());
     }
     return *this;
 
@@ -122,6 +127,40 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::report_hamming_distance(bo
 
 // ----------------------------------------------------------------------
 
+size_t acmacs::seqdb::v3::subset::hamming_distance_of(const ref& rf) const
+{
+    if (const auto found = annotations_.find(rf); found != annotations_.end())
+        return found->second.hamming_distance;
+    else
+        return 0;
+
+} // acmacs::seqdb::v3::subset::hamming_distance_of
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::subset::sort_by_hamming_distance()
+{
+    // distances are looked up in annotations_ once, not on every comparison
+    std::vector<std::pair<size_t, ref>> keyed(refs_.size());
+    std::transform(std::begin(refs_), std::end(refs_), std::begin(keyed), [this](const auto& rr) { return std::pair{hamming_distance_of(rr), rr}; });
+    std::sort(std::begin(keyed), std::end(keyed), [](const auto& e1, const auto& e2) { return e1.first < e2.first; });
+    std::transform(std::begin(keyed), std::end(keyed), std::begin(refs_), [](const auto& en) { return en.second; });
+
+} // acmacs::seqdb::v3::subset::sort_by_hamming_distance
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::subset::group_no_of(const ref& rf) const
+{
+    if (const auto found = annotations_.find(rf); found != annotations_.end())
+        return found->second.group_no;
+    else
+        return 0;
+
+} // acmacs::seqdb::v3::subset::group_no_of
+
+// ----------------------------------------------------------------------
+
 // Eu's algortihm of subsseting 2019-07-23
 
 // 1. Find first group master sequence. I think good starting sequence
@@ -149,8 +188,17 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::report_hamming_distance(bo
 acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::group_by_hamming_distance(const Seqdb& seqdb, size_t dist_threshold, size_t output_size)
 {
     if (dist_threshold > 0) {
-        const auto compute_hamming_distance = [&seqdb](std::string_view master_aa, auto first, auto last) {
-            std::for_each(first, last, [&seqdb,master_aa](auto& ref) { ref.hamming_distance = hamming_distance(master_aa, ref.aa_aligned(seqdb)); });
+        // algorithm works on refs annotated with distance and group, annotations are stored in annotations_ at the end
+        struct grouped_t
+        {
+            ref rf;
+            packed_sequences_t::sequence_t aa; // packed in seqdb
+            size_t hamming_distance{0};
+            size_t group_no{0};
+        };
+
+        const auto compute_hamming_distance = [](packed_sequences_t::sequence_t master_aa, auto first, auto last) {
+            std::for_each(first, last, [master_aa](auto& en) { en.hamming_distance = hamming_distance(master_aa, en.aa); });
         };
 
         const auto sort_by_hamming_distance = [](auto first, auto last) { std::sort(first, last, [](const auto& e1, const auto& e2) { return e1.hamming_distance < e2.hamming_distance; }); };
@@ -161,38 +209,45 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::group_by_hamming_distance(
 
         const auto sort_by_hi_names = [](auto first, auto last) {
             std::sort(first, last, [](const auto& e1, const auto& e2) {
-                return e1.seq().hi_names.size() == e2.seq().hi_names.size() ? e1.entry->date() > e2.entry->date() : e1.seq().hi_names.size() > e2.seq().hi_names.size();
+                return e1.rf.seq().hi_names.size() == e2.rf.seq().hi_names.size() ? e1.rf.entry->date() > e2.rf.entry->date() : e1.rf.seq().hi_names.size() > e2.rf.seq().hi_names.size();
             });
         };
 
         // ----------------------------------------------------------------------
 
         std::iter_swap(std::begin(refs_), most_recent_with_hi_name());
-        auto group_first = std::begin(refs_);
+        std::vector<grouped_t> data(refs_.size());
+        std::transform(std::begin(refs_), std::end(refs_), std::begin(data), [&seqdb](const auto& rf) { return grouped_t{rf, rf.seq_with_sequence(seqdb).amino_acids.aligned}; });
+        auto group_first = std::begin(data);
         acmacs::Counter<ssize_t> counter_group_size;
-        for (size_t group_no = 1; group_first != std::end(refs_); ++group_no) {
-            const auto group_master_aa_aligned = group_first->aa_aligned(seqdb);
+        for (size_t group_no = 1; group_first != std::end(data); ++group_no) {
+            const auto group_master_aa_aligned = group_first->aa;
             const auto group_second = std::next(group_first);
-            // fmt::print("DEBUG: group {} master: {} {} rest size: {}\n", group_no, group_first->seq_id(), group_first->entry->date(), std::end(refs_) - group_first);
-            compute_hamming_distance(group_master_aa_aligned, group_second, std::end(refs_));
-            sort_by_hamming_distance(group_second, std::end(refs_));
-            const auto group_last = find_group_end(group_second, std::end(refs_));
+            // fmt::print("DEBUG: group {} master: {} {} rest size: {}\n", group_no, group_first->rf.seq_id(), group_first->rf.entry->date(), std::end(data) - group_first);
+            compute_hamming_distance(group_master_aa_aligned, group_second, std::end(data));
+            sort_by_hamming_distance(group_second, std::end(data));
+            const auto group_last = find_group_end(group_second, std::end(data));
             assign_group_no(group_first, group_last, group_no);
             sort_by_hi_names(group_no == 1 ? group_second : group_first, group_last);
             counter_group_size.count(group_last - group_first);
             group_first = group_last;
         }
         // fmt::print(stderr, "DEBUG: (num-groups:group-size): {}\n", counter_group_size.report_sorted_max_first(" {second}:{first}"));
-        // fmt::print(stderr, "DEBUG: total groups: {}\n", refs_.back().group_no);
-        if (refs_.back().group_no > output_size) {
+        // fmt::print(stderr, "DEBUG: total groups: {}\n", data.back().group_no);
+
+        std::transform(std::begin(data), std::end(data), std::begin(refs_), [](const auto& en) { return en.rf; });
+        for (const auto& en : data)
+            annotations_[en.rf] = annotation_t{en.hamming_distance, en.group_no};
+
+        if (data.back().group_no > output_size) {
             // too many groups, take one seq from each group starting with group 1, ignore groups with high numbers (furtherst from the recent strain)
             ref_indexes to_remove;
             size_t prev_group = 0;
-            for (auto [index, ref] : acmacs::enumerate(refs_)) {
-                if (ref.group_no == prev_group)
+            for (auto [index, en] : acmacs::enumerate(data)) {
+                if (en.group_no == prev_group)
                     to_remove.push_back(index);
                 else {
-                    prev_group = ref.group_no;
+                    prev_group = en.group_no;
                     if (prev_group > output_size)
                         to_remove.push_back(index);
                 }
@@ -207,11 +262,11 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::group_by_hamming_distance(
             while (to_keep < output_size && prev_to_keep != to_keep) {
                 prev_to_keep = to_keep;
                 size_t group_no = 1;
-                for (auto [index, ref] : acmacs::enumerate(refs_)) {
-                    if (ref.group_no >= group_no) {
+                for (auto [index, en] : acmacs::enumerate(data)) {
+                    if (en.group_no >= group_no) {
                         to_keep_indexes.push_back(index);
                         ++to_keep;
-                        group_no = ref.group_no + 1;
+                        group_no = en.group_no + 1;
                     }
                     if (to_keep >= output_size)
                         break;
@@ -262,18 +317,23 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::subset_by_hamming_distance
             return std::next(first, distribution(generator));
         };
 
-        const auto minimal_distance_less_than = [&seqdb](auto first, auto last, std::string_view picked_aa, size_t distance_threshold) -> bool {
-            return std::any_of(first, last, [&seqdb, picked_aa, distance_threshold](const auto& en) { return hamming_distance(picked_aa, en.aa_aligned(seqdb)) < distance_threshold; });
+        // data below are indexes in refs_ and in aas
+        std::vector<packed_sequences_t::sequence_t> aas(refs_.size());
+        std::transform(std::begin(refs_), std::end(refs_), std::begin(aas), [&seqdb](const auto& rf) { return rf.seq_with_sequence(seqdb).amino_acids.aligned; });
+
+        const auto minimal_distance_less_than = [&aas](auto first, auto last, size_t picked, size_t distance_threshold) -> bool {
+            return std::any_of(first, last, [&aas, picked_aa = aas[picked], distance_threshold](size_t en) { return hamming_distance(picked_aa, aas[en]) < distance_threshold; });
         };
 
-        decltype(refs_) best_data;
+        std::vector<size_t> best_data;
         for (size_t distance_threshold = 1; distance_threshold < 10; ++distance_threshold) {
-            auto data = refs_;
+            std::vector<size_t> data(refs_.size());
+            std::iota(std::begin(data), std::end(data), 0ul);
             std::iter_swap(std::begin(data), random_from(std::begin(data), std::end(data)));
             auto selection_start = std::begin(data), selection_end = std::next(selection_start), discarded_start = std::end(data);
             while (discarded_start > selection_end) {
                 auto picked = random_from(selection_end, discarded_start);
-                if (minimal_distance_less_than(selection_start, selection_end, picked->aa_aligned(seqdb), distance_threshold)) { // discard
+                if (minimal_distance_less_than(selection_start, selection_end, *picked, distance_threshold)) { // discard
                     --discarded_start;
                     std::iter_swap(discarded_start, picked);
                 }
@@ -291,8 +351,9 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::subset_by_hamming_distance
         if (best_data.empty())
             throw std::runtime_error(fmt::format("subset_by_hamming_distance_random: best_data is empty"));
         const auto num_seqs = std::min(output_size, best_data.size());
-        refs_.resize(num_seqs);
-        std::copy(std::begin(best_data), std::next(std::begin(best_data), static_cast<ssize_t>(num_seqs)), std::begin(refs_));
+        refs_t selected(num_seqs);
+        std::transform(std::begin(best_data), std::next(std::begin(best_data), static_cast<ssize_t>(num_seqs)), std::begin(selected), [this](size_t index) { return refs_[index]; });
+        refs_ = std::move(selected);
     }
     return *this;
 
@@ -306,32 +367,31 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::report_hamming_bins(const
         std::vector<std::tuple<std::string, size_t, std::vector<size_t>>> seqids_bins(refs_.size()); // seq_id, max_bin, bins
 
         auto others = seqdb.all();
-        others.subtype(refs_[0].entry->virus_type).host(refs_[0].entry->host()).remove_nuc_duplicates(true, false);
+        others.subtype(seqdb, refs_[0].entry->virus_type).host(refs_[0].entry->host()).remove_nuc_duplicates(true, false);
+        std::vector<packed_sequences_t::sequence_t> others_nucs(others.size());
+        std::transform(std::begin(others), std::end(others), std::begin(others_nucs), [&seqdb](const auto& rf) { return rf.seq_with_sequence(seqdb).nucs.aligned; });
 
-#ifdef _OPENMP
-        const int num_threads = omp_get_max_threads();
-        // const int slot_size = number_of_antigens() < 1000 ? 4 : 1;
-#endif
-#pragma omp parallel for default(shared) num_threads(num_threads) firstprivate(others) schedule(static, 1000)
+#pragma omp parallel for default(shared) schedule(static, 1000)
         for (size_t ref_no = 0; ref_no < refs_.size(); ++ref_no) {
             const auto& ref = refs_[ref_no];
             std::get<std::string>(seqids_bins[ref_no]) = ref.seq_id();
 
             // keep non-zero distances only
+            const auto base_seq = ref.seq_with_sequence(seqdb).nucs.aligned;
+            std::vector<size_t> distances;
             size_t max_distance = 0;
-            others.refs_.erase(std::remove_if(std::next(std::begin(others)), std::end(others),
-                                              [&seqdb, &max_distance, base_seq = ref.nuc_aligned(seqdb)](auto& en) {
-                                                  en.hamming_distance = hamming_distance(en.nuc_aligned(seqdb), base_seq, hamming_distance_by_shortest::yes);
-                                                  max_distance = std::max(max_distance, en.hamming_distance);
-                                                  return en.hamming_distance == 0;
-                                              }),
-                               std::end(others));
+            for (size_t other_no = 1; other_no < others_nucs.size(); ++other_no) {
+                if (const auto distance = hamming_distance(others_nucs[other_no], base_seq, hamming_distance_by_shortest::yes); distance > 0) {
+                    distances.push_back(distance);
+                    max_distance = std::max(max_distance, distance);
+                }
+            }
 
             const size_t number_of_bins = max_distance / bin_size + 1;
             auto& bins = std::get<2>(seqids_bins[ref_no]);
             bins.resize(number_of_bins, 0ul);
-            for (const auto& another : others)
-                ++bins[another.hamming_distance / bin_size];
+            for (const auto distance : distances)
+                ++bins[distance / bin_size];
             std::get<1>(seqids_bins[ref_no]) = static_cast<size_t>(std::max_element(std::begin(bins), std::end(bins)) - std::begin(bins));
             if ((ref_no % 1000) == 0)
                 AD_PRINT("{}", ref_no);
@@ -1,3 +1,6 @@
+#include <numeric>
+#include <cstdlib>
+
 #include "acmacs-base/in-json-parser.hh"
 #include "seqdb-3/seqdb-parse.hh"
 #include "seqdb-3/seqdb.hh"
@@ -6,33 +9,68 @@
 
 namespace local
 {
+    // sequence text (view into the source) of a master, packed after parsing
+    struct raw_sequence_t
+    {
+        size_t entry_no;
+        size_t seq_no;
+        acmacs::seqdb::sequence_with_alignment_ref_t amino_acids{};
+        acmacs::seqdb::sequence_with_alignment_ref_t nucs{};
+    };
+
+    struct parse_target_t
+    {
+        std::vector<acmacs::seqdb::SeqdbEntry>& entries;
+        acmacs::seqdb::seqdb_arena_t& arena;
+        std::string_view subtype{}; // seqdb-4 only, in arena
+        std::vector<raw_sequence_t> sequences{};
+    };
+
+    // "A(H3N2)/HONG KONG/1/2020", "B/..."
+    inline bool has_subtype_prefix(std::string_view name) { return name.size() > 1 && (name[0] == 'A' || name[0] == 'a' || name[0] == 'B' || name[0] == 'b') && (name[1] == '/' || name[1] == '('); }
+
     class labs : public in_json::stack_entry
     {
       public:
-        labs(acmacs::seqdb::SeqdbSeq::labs_t& target) : target_{target} {}
+        labs(acmacs::seqdb::SeqdbSeq::labs_t& target, acmacs::seqdb::seqdb_arena_t& arena) : target_{target}, arena_{arena} { arena_.labs.open(); }
         const char* injson_name() override { return "labs"; }
-        void injson_put_array() override {}
 
         void injson_put_key(std::string_view data) override
         {
             in_json::stack_entry::injson_put_key(data);
-            target_.emplace_back(data, acmacs::seqdb::SeqdbSeq::lab_ids_t{});
+            lab_ = arena_.text.store(data);
         }
 
-        void injson_put_string(std::string_view data) override { target_.back().second.emplace_back(data); }
+        void injson_put_array() override
+        {
+            arena_.strings.open();
+            lab_ids_ = acmacs::seqdb::SeqdbSeq::lab_ids_t{};
+        }
+
+        void injson_pop_array() override
+        {
+            target_ = arena_.labs.push_back(acmacs::seqdb::lab_t{lab_, lab_ids_});
+            reset_key();
+        }
+
+        void injson_put_string(std::string_view data) override { lab_ids_ = arena_.strings.push_back(arena_.text.store(data)); }
 
       private:
         acmacs::seqdb::SeqdbSeq::labs_t& target_;
+        acmacs::seqdb::seqdb_arena_t& arena_;
+        std::string_view lab_;
+        acmacs::seqdb::SeqdbSeq::lab_ids_t lab_ids_;
     };
 
     class gisaid_data : public in_json::stack_entry
     {
       public:
-        gisaid_data(acmacs::seqdb::SeqdbSeq::gisaid_data_t& target) : target_{target} {}
+        gisaid_data(acmacs::seqdb::SeqdbSeq::gisaid_data_t& target, acmacs::seqdb::seqdb_arena_t& arena) : target_{target}, arena_{arena} {}
         const char* injson_name() override { return "gisaid"; }
 
         void injson_put_array() override
         {
+            arena_.strings.open();
         }
 
         void injson_pop_array() override
@@ -44,10 +82,10 @@ namespace local
         {
             switch (key_[0]) {
                 case 'i':
-                    target_.isolate_ids.emplace_back(data);
+                    target_.isolate_ids = arena_.strings.push_back(arena_.text.store(data));
                     break;
               case 's':
-                    target_.sample_ids_by_sample_provider.emplace_back(data);
+                    target_.sample_ids_by_sample_provider = arena_.strings.push_back(arena_.text.store(data));
                     break;
               case 'S':         // todo
               case 'm':
@@ -64,22 +102,27 @@ namespace local
 
       private:
         acmacs::seqdb::SeqdbSeq::gisaid_data_t& target_;
+        acmacs::seqdb::seqdb_arena_t& arena_;
     };
 
     class reference : public in_json::stack_entry
     {
       public:
-        reference(acmacs::seqdb::SeqdbSeq::master_ref_t& target) : target_{target} {}
+        reference(acmacs::seqdb::SeqdbSeq::master_ref_t& target, acmacs::seqdb::seqdb_arena_t& arena) : target_{target}, arena_{arena} {}
         const char* injson_name() override { return "reference"; }
 
         void injson_put_string(std::string_view data) override
         {
             switch (key_[0]) {
                 case 'N':
-                    target_.name = data;
+                    target_.name = arena_.text.store(data);
                     break;
                 case 'H':
-                    target_.hash = data;
+                    target_.hash = arena_.text.store(data);
+                    target_.hash_value = acmacs::seqdb::hash_value(data);
+                    break;
+                case 'S': // seqdb-4: master is in another shard
+                    target_.shard = arena_.text.store(data);
                     break;
                 // case 'p':
                 //     target_.passage = data;
@@ -98,12 +141,16 @@ namespace local
 
       private:
         acmacs::seqdb::SeqdbSeq::master_ref_t& target_;
+        acmacs::seqdb::seqdb_arena_t& arena_;
     };
 
     class seq : public in_json::stack_entry
     {
       public:
-        seq(acmacs::seqdb::SeqdbSeq& target) : target_{target} {}
+        seq(acmacs::seqdb::SeqdbSeq& target, parse_target_t& parse_target, size_t entry_no, size_t seq_no)
+            : target_{target}, arena_{parse_target.arena}, parse_target_{parse_target}, entry_no_{entry_no}, seq_no_{seq_no}
+        {
+        }
 
         const char* injson_name() override { return "seq"; }
 
@@ -112,13 +159,13 @@ namespace local
             switch (key_[0]) {
               case 'l':
                   reset_key();
-                  return std::make_unique<labs>(target_.lab_ids);
+                  return std::make_unique<labs>(target_.lab_ids, arena_);
               case 'G':         // gisaid data
                   reset_key();
-                  return std::make_unique<gisaid_data>(target_.gisaid);
+                  return std::make_unique<gisaid_data>(target_.gisaid, arena_);
               case 'R':         // master with identical sequence reference
                   reset_key();
-                  return std::make_unique<reference>(target_.master);
+                  return std::make_unique<reference>(target_.master, arena_);
               default:
                   throw in_json::parse_error(AD_FORMAT("seq: unexpected sub-object, key: \"{}\"", key_));
             }
@@ -128,6 +175,7 @@ namespace local
         {
             // if (key_.size() != 1 || (key_[0] != 'p' && key_[0] != 'c' && key_[0] != 'h' && key_[0] != 'r'))
             //     throw in_json::parse_error(AD_FORMAT("seq: unexpected array, key: \"{}\"", key_));
+            arena_.strings.open();
         }
 
         void injson_pop_array() override
@@ -142,35 +190,36 @@ namespace local
             // else if (key_.size() == 1) {
             switch (key_[0]) {
                 case 'p':
-                    target_.passages.emplace_back(data);
+                    target_.passages = arena_.strings.push_back(arena_.text.store(data));
                     break;
                 case 'r':
-                    target_.reassortants.emplace_back(data);
+                    target_.reassortants = arena_.strings.push_back(arena_.text.store(data));
                     break;
                 case 'c':
-                    target_.clades.emplace_back(data);
+                    target_.clades = arena_.strings.push_back(arena_.text.store(data));
                     break;
                 case 'h':
-                    target_.hi_names.emplace_back(data);
+                    target_.hi_names = arena_.strings.push_back(arena_.text.store(data));
                     break;
                 // case 'g':
                 //     target_.gene = data;
                 //     reset_key();
                 //     break;
                 case 'a':
-                    std::get<std::string_view>(target_.amino_acids) = data;
+                    std::get<std::string_view>(raw().amino_acids) = data;
                     reset_key();
                     break;
                 case 'n':
-                    std::get<std::string_view>(target_.nucs) = data;
+                    std::get<std::string_view>(raw().nucs) = data;
                     reset_key();
                     break;
                 case 'A':
-                    target_.annotations = data;
+                    target_.annotations = arena_.text.store(data);
                     reset_key();
                     break;
                 case 'H':
-                    target_.hash = data;
+                    target_.hash = arena_.text.store(data);
+                    target_.hash_value = acmacs::seqdb::hash_value(data);
                     reset_key();
                     break;
                 case 'i':       // issues
@@ -214,11 +263,11 @@ namespace local
             // if (key_.size() == 1) {
             switch (key_[0]) {
                 case 's':
-                    std::get<acmacs::seqdb::alignment_t>(target_.amino_acids) = acmacs::seqdb::alignment_t{data};
+                    std::get<acmacs::seqdb::alignment_t>(raw().amino_acids) = acmacs::seqdb::alignment_t{data};
                     reset_key();
                     break;
                 case 't':
-                    std::get<acmacs::seqdb::alignment_t>(target_.nucs) = acmacs::seqdb::alignment_t{data};
+                    std::get<acmacs::seqdb::alignment_t>(raw().nucs) = acmacs::seqdb::alignment_t{data};
                     reset_key();
                     break;
                 default:
@@ -232,18 +281,32 @@ namespace local
 
       private:
         acmacs::seqdb::SeqdbSeq& target_;
+        acmacs::seqdb::seqdb_arena_t& arena_;
+        parse_target_t& parse_target_;
+        const size_t entry_no_, seq_no_; // target_ in parse_target_.entries
+        size_t raw_no_{static_cast<size_t>(-1)};
+
+        raw_sequence_t& raw()
+        {
+            if (raw_no_ == static_cast<size_t>(-1)) {
+                raw_no_ = parse_target_.sequences.size();
+                parse_target_.sequences.push_back(raw_sequence_t{entry_no_, seq_no_});
+            }
+            return parse_target_.sequences[raw_no_];
+        }
     };
 
     class entry : public in_json::stack_entry
     {
       public:
-        entry(acmacs::seqdb::SeqdbEntry& target) : target_{target} {}
+        entry(acmacs::seqdb::SeqdbEntry& target, parse_target_t& parse_target, size_t entry_no) : target_{target}, arena_{parse_target.arena}, parse_target_{parse_target}, entry_no_{entry_no} {}
 
         const char* injson_name() override { return "entry"; }
 
         std::unique_ptr<in_json::stack_entry> injson_put_object() override
         {
-            return std::make_unique<seq>(target_.seqs.emplace_back()); // objects are only under "s"
+            auto& target_seq = target_.seqs.emplace_back(); // objects are only under "s"
+            return std::make_unique<seq>(target_seq, parse_target_, entry_no_, target_.seqs.size() - 1);
         }
 
         void injson_put_array() override
@@ -265,27 +328,27 @@ namespace local
         {
             switch (key_[0]) {
                 case 'N':
-                    target_.name = data;
+                    target_.name = arena_.text.store(data);
                     reset_key();
                     // fmt::print(stderr, "NAME: {}\n", name_);
                     break;
                 case 'C':
-                    target_.continent = data;
+                    target_.continent = arena_.text.store(data);
                     reset_key();
                     break;
                 case 'c':
-                    target_.country = data;
+                    target_.country = arena_.text.store(data);
                     reset_key();
                     break;
                 case 'd':
-                    target_.dates.emplace_back(data);
+                    target_.dates.emplace_back(arena_.text.store(data));
                     break;
                 case 'l':
-                    target_.lineage = data;
+                    target_.lineage = arena_.text.store(data);
                     reset_key();
                     break;
                 case 'v':
-                    target_.virus_type = data;
+                    target_.virus_type = arena_.text.store(data);
                     reset_key();
                     break;
                 default:
@@ -298,51 +361,143 @@ namespace local
 
       private:
         acmacs::seqdb::SeqdbEntry& target_;
+        acmacs::seqdb::seqdb_arena_t& arena_;
+        parse_target_t& parse_target_;
+        const size_t entry_no_; // target_ in parse_target_.entries
     };
 
     class db : public in_json::stack_entry
     {
       public:
-        db(std::vector<acmacs::seqdb::SeqdbEntry>& entries) : entries_{entries} {}
+        db(parse_target_t& target) : target_{target}, entries_{target.entries}, arena_{target.arena} {}
 
         const char* injson_name() override { return "db"; }
 
-        std::unique_ptr<in_json::stack_entry> injson_put_object() override { return std::make_unique<entry>(entries_.emplace_back()); }
+        std::unique_ptr<in_json::stack_entry> injson_put_object() override
+        {
+            auto& target_entry = entries_.emplace_back();
+            return std::make_unique<entry>(target_entry, target_, entries_.size() - 1);
+        }
 
         void injson_put_string(std::string_view data) override
         {
             if (key_ == "  version") {
-                if (data != "sequence-database-v2" && data != "sequence-database-v3")
+                if (data != "sequence-database-v2" && data != "sequence-database-v3" && data != "sequence-database-v4")
                     throw in_json::parse_error(AD_FORMAT("unsupported version: {}", data));
                 reset_key();
             }
+            else if (key_ == "subtype") { // seqdb-4
+                target_.subtype = arena_.text.store(data);
+                reset_key();
+            }
             else if (key_ == "  date" || key_ == "_")
                 reset_key();
             else
                 throw in_json::parse_error(AD_FORMAT("unsupported field: \"{}\": {}", key_, data));
         }
 
+        void injson_put_integer(std::string_view data) override
+        {
+            if (key_ == "size") { // seqdb-4: number of entries
+                entries_.reserve(entries_.size() + std::stoul(std::string{data}));
+                reset_key();
+            }
+            else
+                in_json::stack_entry::injson_put_integer(data);
+        }
+
         void injson_put_array() override {}
         void injson_pop_array() override { reset_key(); }
 
       private:
+        parse_target_t& target_;
         std::vector<acmacs::seqdb::v3::SeqdbEntry>& entries_;
+        acmacs::seqdb::seqdb_arena_t& arena_;
     };
 
-    using sink = in_json::object_sink<std::vector<acmacs::seqdb::SeqdbEntry>, db>;
+    using sink = in_json::object_sink<parse_target_t, db>;
+
+    // ----------------------------------------------------------------------
+
+    // aligned parts of the sequences are packed into the arena, parts before the alignment start are copied to the arena text
+    inline void pack_sequences(parse_target_t& target)
+    {
+        const auto before_aligned = [](const acmacs::seqdb::sequence_with_alignment_ref_t& source) {
+            const auto& text = std::get<std::string_view>(source);
+            return text.substr(0, std::min(static_cast<size_t>(std::abs(std::get<acmacs::seqdb::alignment_t>(source).as_number())), text.size()));
+        };
+        const auto aligned = [&before_aligned](const acmacs::seqdb::sequence_with_alignment_ref_t& source) { return std::get<std::string_view>(source).substr(before_aligned(source).size()); };
+
+        std::vector<std::string_view> amino_acids(target.sequences.size()), nucs(target.sequences.size());
+        std::transform(std::begin(target.sequences), std::end(target.sequences), std::begin(amino_acids), [&aligned](const auto& raw) { return aligned(raw.amino_acids); });
+        std::transform(std::begin(target.sequences), std::end(target.sequences), std::begin(nucs), [&aligned](const auto& raw) { return aligned(raw.nucs); });
+        const size_t first_aa = target.arena.amino_acids.size(), first_nuc = target.arena.nucs.size();
+        target.arena.amino_acids.add(amino_acids);
+        target.arena.nucs.add(nucs);
+
+        for (size_t raw_no = 0; raw_no < target.sequences.size(); ++raw_no) {
+            const auto& raw = target.sequences[raw_no];
+            auto& seq = target.entries[raw.entry_no].seqs[raw.seq_no];
+            seq.amino_acids = acmacs::seqdb::packed_sequence_with_alignment_t{target.arena.text.store(before_aligned(raw.amino_acids)), target.arena.amino_acids[first_aa + raw_no],
+                                                                             std::get<acmacs::seqdb::alignment_t>(raw.amino_acids)};
+            seq.nucs = acmacs::seqdb::packed_sequence_with_alignment_t{target.arena.text.store(before_aligned(raw.nucs)), target.arena.nucs[first_nuc + raw_no],
+                                                                      std::get<acmacs::seqdb::alignment_t>(raw.nucs)};
+        }
+        target.sequences.clear();
+    }
 
 } // namespace local
 
 // ----------------------------------------------------------------------
 
-void acmacs::seqdb::v3::parse(std::string_view source, std::vector<SeqdbEntry>& entries)
+void acmacs::seqdb::v3::parse(std::string_view source, std::vector<SeqdbEntry>& entries, seqdb_arena_t& arena)
 {
-    local::sink sink{entries};
+    local::parse_target_t target{entries, arena};
+    local::sink sink{target};
     in_json::parse(sink, std::begin(source), std::end(source));
+    local::pack_sequences(target);
+    if (!target.subtype.empty())
+        throw std::runtime_error{"seqdb-4 shard cannot be loaded as seqdb-3 (names are stored without subtype)"};
     // fmt::print("INFO: seqdb entries read: {}\n", entries.size());
 
 } // acmacs::seqdb::v3::parse
 
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::parse(std::string_view source, std::vector<SeqdbEntry>& entries, seqdb_arena_t& arena, std::string& names)
+{
+    using namespace std::string_view_literals;
+
+    const auto first_entry = static_cast<ssize_t>(entries.size());
+    local::parse_target_t target{entries, arena};
+    local::sink sink{target};
+    in_json::parse(sink, std::begin(source), std::end(source));
+    local::pack_sequences(target);
+    if (target.subtype.empty())
+        throw std::runtime_error{"not a seqdb-4 shard: no subtype"};
+
+    // names are stored without subtype prefix (if it is the subtype of the shard)
+    const auto shard_begin = std::next(std::begin(entries), first_entry);
+    names.clear();
+    names.reserve(std::accumulate(shard_begin, std::end(entries), size_t{0},
+                                  [subtype = target.subtype](size_t sum, const auto& entry) { return local::has_subtype_prefix(entry.name) ? sum : sum + subtype.size() + 1 + entry.name.size(); }));
+    for (auto entry_it = shard_begin; entry_it != std::end(entries); ++entry_it) {
+        auto& entry = *entry_it;
+        if (!local::has_subtype_prefix(entry.name)) {
+            const auto start = names.size();
+            names.append(target.subtype).append(1, '/').append(entry.name);
+            entry.name = std::string_view{names}.substr(start); // names is not reallocated, its size is reserved
+        }
+        if (entry.virus_type.empty()) // present only if differs from the subtype of the shard
+            entry.virus_type = target.subtype;
+        if (entry.lineage == "V"sv)
+            entry.lineage = "VICTORIA"sv;
+        else if (entry.lineage == "Y"sv)
+            entry.lineage = "YAMAGATA"sv;
+    }
+
+} // acmacs::seqdb::v3::parse
+
 // ----------------------------------------------------------------------
 /// Local Variables:
 /// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
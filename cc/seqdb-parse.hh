@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -11,8 +12,12 @@ namespace acmacs::seqdb
     inline namespace v3
     {
         struct SeqdbEntry;
+        struct seqdb_arena_t;
 
-        void parse(std::string_view source, std::vector<SeqdbEntry>& entries_);
+        // strings, lists of SeqdbSeq (passages, hi_names, lab ids, etc.) and packed sequences are stored in arena, entries do not refer to source
+        void parse(std::string_view source, std::vector<SeqdbEntry>& entries_, seqdb_arena_t& arena);
+        // seqdb-4 shard, names of entries (with the subtype prefix restored) are stored in names
+        void parse(std::string_view source, std::vector<SeqdbEntry>& entries_, seqdb_arena_t& arena, std::string& names);
 
     } // namespace v3
 } // namespace seqdb
@@ -1,10 +1,14 @@
 #include "acmacs-base/read-file.hh"
 #include "acmacs-base/counter.hh"
 #include "acmacs-base/range-v3.hh"
+#include "acmacs-base/omp.hh"
 #include "acmacs-base/to-json.hh"
 #include "acmacs-base/string-split.hh"
 #include "acmacs-chart-2/point-index-list.hh"
 #include "seqdb-3/seqdb.hh"
+#include "seqdb-3/output-stream.hh"
+#include "seqdb-3/name-format.hh"
+#include "seqdb-3/aggregate.hh"
 #include "seqdb-3/log.hh"
 
 // ----------------------------------------------------------------------
@@ -35,7 +39,7 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::multiple_dates(bool do_fil
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::subtype(const acmacs::uppercase& virus_type)
+acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::subtype(const Seqdb& seqdb, const acmacs::uppercase& virus_type)
 {
     if (!virus_type.empty()) {
         std::string_view vt = virus_type;
@@ -43,7 +47,8 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::subtype(const acmacs::uppe
             vt = "A(H1N1)";
         else if (vt == "H3")
             vt = "A(H3N2)";
-        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [vt](const auto& en) { return en.entry->virus_type != vt; }), std::end(refs_));
+        const auto code = seqdb.dictionaries().virus_types.find(vt);
+        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [code](const auto& en) { return en.entry->virus_type_code != code; }), std::end(refs_));
     }
     return *this;
 
@@ -51,7 +56,7 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::subtype(const acmacs::uppe
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::lineage(const acmacs::uppercase& lineage)
+acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::lineage(const Seqdb& seqdb, const acmacs::uppercase& lineage)
 {
     if (!lineage.empty()) {
         std::string_view lin = lineage;
@@ -59,7 +64,8 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::lineage(const acmacs::uppe
           case 'V': lin = "VICTORIA"; break;
           case 'Y': lin = "YAMAGATA"; break;
         }
-        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [lin](const auto& en) { return en.entry->lineage != lin; }), std::end(refs_));
+        const auto code = seqdb.dictionaries().lineages.find(lin);
+        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [code](const auto& en) { return en.entry->lineage_code != code; }), std::end(refs_));
     }
     return *this;
 
@@ -67,20 +73,27 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::lineage(const acmacs::uppe
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::lab(const acmacs::uppercase& lab)
+acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::lab(const Seqdb& seqdb, const acmacs::uppercase& lab)
 {
-    if (!lab.empty())
-        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [lab=static_cast<std::string_view>(lab)](const auto& en) { return !en.has_lab(lab); }), std::end(refs_));
+    if (!lab.empty()) {
+        const auto code = seqdb.dictionaries().labs.find(static_cast<std::string_view>(lab));
+        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [code](const auto& en) { return !en.has_lab(code); }), std::end(refs_));
+    }
     return *this;
 
 } // acmacs::seqdb::v3::subset::lab
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::whocc_lab(bool do_filter)
+acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::whocc_lab(const Seqdb& seqdb, bool do_filter)
 {
-    if (do_filter)
-        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [](const auto& en) { return ! (en.has_lab("CDC") || en.has_lab("CRICK") || en.has_lab("NIID") || en.has_lab("VIDRL")); }), std::end(refs_));
+    if (do_filter) {
+        const auto& labs = seqdb.dictionaries().labs;
+        const std::array whocc{labs.find("CDC"), labs.find("CRICK"), labs.find("NIID"), labs.find("VIDRL")};
+        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_),
+                                   [&whocc](const auto& en) { return std::none_of(std::begin(whocc), std::end(whocc), [&en](dictionary_code_t lab) { return en.has_lab(lab); }); }),
+                    std::end(refs_));
+    }
     return *this;
 
 } // acmacs::seqdb::v3::subset::whocc_lab
@@ -97,20 +110,24 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::host(const acmacs::upperca
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::continent(const acmacs::uppercase& continent)
+acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::continent(const Seqdb& seqdb, const acmacs::uppercase& continent)
 {
-    if (!continent.empty())
-        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [continent=static_cast<std::string_view>(continent)](const auto& en) { return en.entry->continent != continent; }), std::end(refs_));
+    if (!continent.empty()) {
+        const auto code = seqdb.dictionaries().continents.find(static_cast<std::string_view>(continent));
+        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [code](const auto& en) { return en.entry->continent_code != code; }), std::end(refs_));
+    }
     return *this;
 
 } // acmacs::seqdb::v3::subset::continent
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::country(const acmacs::uppercase& country)
+acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::country(const Seqdb& seqdb, const acmacs::uppercase& country)
 {
-    if (!country.empty())
-        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [country=static_cast<std::string_view>(country)](const auto& en) { return en.entry->country != country; }), std::end(refs_));
+    if (!country.empty()) {
+        const auto code = seqdb.dictionaries().countries.find(static_cast<std::string_view>(country));
+        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [code](const auto& en) { return en.entry->country_code != code; }), std::end(refs_));
+    }
     return *this;
 
 } // acmacs::seqdb::v3::subset::country
@@ -129,8 +146,10 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::with_issues(const Seqdb& s
 
 acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::clade(const Seqdb& seqdb, const acmacs::uppercase& clade)
 {
-    if (!clade.empty())
-        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [&seqdb,clade=static_cast<std::string_view>(clade)](const auto& en) { return !en.has_clade(seqdb, clade); }), std::end(refs_));
+    if (!clade.empty()) {
+        const auto code = seqdb.dictionaries().clades.find(static_cast<std::string_view>(clade));
+        refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [&seqdb, code](const auto& en) { return !en.has_clade(seqdb, code); }), std::end(refs_));
+    }
     return *this;
 
 } // acmacs::seqdb::v3::subset::clade
@@ -295,8 +314,12 @@ void acmacs::seqdb::v3::remove_nuc_duplicates(subset::refs_t& refs, bool keep_hi
         // move slave seq from [to_remove_canditates_start, std::end(refs)] that reference to
         // a sequence in [std::begin(refs), to_remove_candidates_start]
         // to the [to_remove_start, std::end(refs)] range
-        const auto to_remove_start = std::partition(to_remove_canditates_start, std::end(refs), [beg = std::begin(refs), end = to_remove_canditates_start](const auto& ref1) {
-            return std::find_if(beg, end, [&ref1](const auto& ref2) { return ref2.matches(ref1.seq().master); }) == end;
+        using key_t = std::pair<hash_value_t, std::string_view>;
+        std::vector<key_t> kept(static_cast<size_t>(to_remove_canditates_start - std::begin(refs)));
+        std::transform(std::begin(refs), to_remove_canditates_start, std::begin(kept), [](const auto& ref) { return key_t{ref.seq().hash_value, ref.entry->name}; });
+        std::sort(std::begin(kept), std::end(kept));
+        const auto to_remove_start = std::partition(to_remove_canditates_start, std::end(refs), [&kept](const auto& ref1) {
+            return !std::binary_search(std::begin(kept), std::end(kept), key_t{ref1.seq().master.hash_value, ref1.seq().master.name});
         });
 
         refs.erase(to_remove_start, std::end(refs));
@@ -469,10 +492,10 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::remove_with_front_back_del
 {
     if (remove) {
         refs_.erase(std::remove_if(std::begin(refs_), std::end(refs_), [nuc_length, &seqdb](const auto& en) {
-            const auto nucs = en.nuc_aligned(seqdb);
-            if (nucs.at(pos1_t{1}) == '-')
+            const auto nucs = en.seq_with_sequence(seqdb).nucs.aligned; // packed, not decoded
+            if (at_pos(nucs, pos1_t{1}) == '-')
                 return true;
-            if (nuc_length > 0 && (nucs.size() < pos0_t{nuc_length} || nucs.at(pos1_t{nuc_length}) == '-'))
+            if (nuc_length > 0 && (nucs.size() < nuc_length || at_pos(nucs, pos1_t{nuc_length}) == '-'))
                 return true;    // too short or has deletion in the last nuc
             return false;
         }), std::end(refs_));
@@ -628,6 +651,18 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::sort(sorting srt)
 
 // ----------------------------------------------------------------------
 
+void acmacs::seqdb::v3::subset::sort_by_nuc_aligned_truncated(const Seqdb& seqdb, size_t truncate_at)
+{
+    // sequences are decoded once, not on every comparison
+    std::vector<std::pair<sequence_aligned_t, ref>> keyed(refs_.size());
+    std::transform(std::begin(refs_), std::end(refs_), std::begin(keyed), [&seqdb, truncate_at](const auto& rr) { return std::pair{rr.nuc_aligned(seqdb, truncate_at), rr}; });
+    std::sort(std::begin(keyed), std::end(keyed), [](const auto& e1, const auto& e2) { return e1.first < e2.first; });
+    std::transform(std::begin(keyed), std::end(keyed), std::begin(refs_), [](const auto& en) { return en.second; });
+
+} // acmacs::seqdb::v3::subset::sort_by_nuc_aligned_truncated
+
+// ----------------------------------------------------------------------
+
 acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::report_stat(const Seqdb& seqdb, bool do_report)
 {
     if (do_report) {
@@ -646,8 +681,9 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::report_stat(const Seqdb& s
                     by_year.count(date.substr(0, 4));
                 if (!ref.seq().hi_names.empty())
                     ++with_hi_names;
-                aa_length.count(ref.seq_with_sequence(seqdb).aa_aligned_length_master());
-                nuc_length.count(ref.seq_with_sequence(seqdb).nuc_aligned_length_master());
+                const auto& seq = ref.seq_with_sequence(seqdb); // master lookup once per ref
+                aa_length.count(seq.aa_aligned_length_master());
+                nuc_length.count(seq.nuc_aligned_length_master());
             }
             fmt::print(stderr, "Selected sequences: {:6d}\n      HiDb matches: {:6d}\n        Date range: {} - {}\n", refs_.size(), with_hi_names, min_date, max_date);
             constexpr const size_t limit{10};
@@ -741,6 +777,14 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::report_aa_at(const Seqdb&
 
 // ----------------------------------------------------------------------
 
+acmacs::seqdb::v3::aggregate_table_t acmacs::seqdb::v3::subset::aggregate(const Seqdb& seqdb, std::string_view group_by) const
+{
+    return aggregate_t{group_by}.aggregate(seqdb, *this);
+
+} // acmacs::seqdb::v3::subset::aggregate
+
+// ----------------------------------------------------------------------
+
 std::pair<size_t, std::string> acmacs::seqdb::v3::subset::export_sequences(const Seqdb& seqdb, const export_options& options) const
 {
     auto to_export = export_collect(seqdb, options);
@@ -771,10 +815,80 @@ std::pair<size_t, std::string> acmacs::seqdb::v3::subset::export_sequences(const
 
 acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::export_sequences(std::string_view filename, const Seqdb& seqdb, const export_options& options) const
 {
+    // the same output as export_fasta(export_collect()) but sequences are written directly from seqdb, padded and wrapped on the fly
     if (!filename.empty()) {
-        const auto [num_sequences, fasta] = export_sequences(seqdb, options);
-        AD_LOG(acmacs::log::fasta, "writing {} sequences to {}", num_sequences, filename);
-        acmacs::file::write(filename, fasta);
+        const auto to_export = export_collect_views(seqdb, options);
+        const size_t length = export_length(to_export, options);
+
+        AD_LOG(acmacs::log::fasta, "writing {} sequences to {}", to_export.size(), filename);
+        const int num_threads = options.e_threads == 0 ? omp_get_max_threads() : static_cast<int>(options.e_threads);
+        output_stream_t output{filename, static_cast<size_t>(num_threads)};
+        const bool nucs = options.e_format == export_options::format::fasta_nuc;
+        const name_format_t name_format{options.e_name_format};
+
+        struct chunk_t
+        {
+            fmt::memory_buffer data;
+            std::vector<std::string> warnings;
+            std::string sequence; // decoded sequence of the current record
+        };
+
+        const auto format_record = [this, &seqdb, &options, length, nucs, &name_format](chunk_t& chunk, const ref& en, const packed_sequence_with_alignment_t& source) {
+            // sequence to export is (sequence + padding) of the requested length
+            chunk.sequence.clear();
+            source.text(chunk.sequence, length ? length : std::string_view::npos);
+            const std::string_view sequence{chunk.sequence};
+            const size_t padding = (length && length > sequence.size()) ? length - sequence.size() : 0;
+            const size_t size = sequence.size() + padding;
+            const auto padded = [sequence, padding]() { return fmt::format("{}{}", sequence, std::string(padding, '-')); };
+
+            chunk.data.push_back('>');
+            const size_t name_start = chunk.data.size();
+            name_format.format_to(chunk.data, seqdb, *this, en);
+            const std::string_view name{chunk.data.data() + name_start, chunk.data.size() - name_start}; // valid until chunk.data is modified
+
+            if (const auto dels = static_cast<size_t>(std::count_if(std::begin(sequence), std::end(sequence), [nucs](char nuc_aa) { return nuc_aa == '-' || (nucs && nuc_aa == 'X'); })) + padding;
+                dels > options.e_deletion_report_threshold)
+                chunk.warnings.push_back(fmt::format("{}: {} deletions or unknown AAs, seq length: {}\n{}", name, dels, size, padded()));
+            if (const char last = padding ? '-' : sequence.back(); (last == '-' || last == 'X') && options.e_report_deletions_at_the_end)
+                chunk.warnings.push_back(fmt::format("{}: deletions at the end, seq length: {}\n{}", name, size, padded()));
+
+            chunk.data.push_back('\n');
+            const size_t wrap_at = (options.e_wrap_at == 0 || options.e_wrap_at >= size) ? size : options.e_wrap_at;
+            for (size_t line_start{0}; line_start < size; line_start += wrap_at) {
+                const size_t line_end = std::min(line_start + wrap_at, size);
+                if (line_start < sequence.size())
+                    chunk.data.append(sequence.substr(line_start, line_end - line_start));
+                if (line_end > sequence.size())
+                    std::fill_n(std::back_inserter(chunk.data), line_end - std::max(line_start, sequence.size()), '-');
+                chunk.data.push_back('\n');
+            }
+        };
+
+        // records are formatted by threads in chunks, chunks (and warnings) are written in the order of refs,
+        // i.e. output does not depend on the number of threads
+        constexpr size_t records_per_chunk{1000};
+        const size_t number_of_chunks = (to_export.size() + records_per_chunk - 1) / records_per_chunk;
+        std::vector<chunk_t> chunks(std::min(static_cast<size_t>(num_threads) * 4, number_of_chunks)); // chunks of a batch
+        for (size_t batch_start{0}; batch_start < number_of_chunks; batch_start += chunks.size()) {
+            const size_t batch_size = std::min(chunks.size(), number_of_chunks - batch_start);
+#pragma omp parallel for default(shared) num_threads(num_threads) schedule(dynamic, 1)
+            for (size_t chunk_no = 0; chunk_no < batch_size; ++chunk_no) {
+                auto& chunk = chunks[chunk_no];
+                chunk.data.clear();
+                chunk.warnings.clear();
+                const size_t first = (batch_start + chunk_no) * records_per_chunk, last = std::min(first + records_per_chunk, to_export.size());
+                for (size_t record_no = first; record_no < last; ++record_no)
+                    format_record(chunk, *to_export[record_no].first, to_export[record_no].second);
+            }
+            for (const auto& chunk : ranges::views::take(chunks, batch_size)) {
+                for (const auto& warning : chunk.warnings)
+                    AD_WARNING("{}", warning);
+                output.write(std::string_view{chunk.data.data(), chunk.data.size()});
+            }
+        }
+        output.close();
+        fmt::print("INFO: exported to fasta: {}\n", to_export.size());
     }
     return const_cast<subset&>(*this);
 
@@ -782,24 +896,99 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::export_sequences(std::stri
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::export_json_sequences(std::string_view filename, const Seqdb& seqdb, const export_options& options)
+namespace local
 {
-    if (!filename.empty()) {
-        auto to_export = export_collect(seqdb, options);
+    // Layout of fmt::format("{}\n", to_json::array) of {"N": name, "S": sequence} objects (in-memory json export used before),
+    // taken from to_json output for placeholder records, so the streamed export is byte-identical to it.
+    // formatted: prefix name middle sequence (separator name middle sequence)... suffix
+    class export_json_layout_t
+    {
+      public:
+        export_json_layout_t()
+        {
+            const auto one = format({{name_placeholder, sequence_placeholder}});
+            const auto two = format({{name_placeholder, sequence_placeholder}, {name_placeholder, sequence_placeholder}});
+            const auto name1 = one.find(name_placeholder), sequence1 = one.find(sequence_placeholder, name1);
+            const auto sequence2 = two.find(sequence_placeholder, two.find(name_placeholder));
+            const auto name3 = two.find(name_placeholder, sequence2), sequence3 = two.find(sequence_placeholder, name3);
+            if (name1 == std::string::npos || sequence1 == std::string::npos || name3 == std::string::npos || sequence3 == std::string::npos)
+                throw std::runtime_error{fmt::format("unrecognized to_json layout: {}", two)};
+            empty_ = format({});
+            prefix_ = one.substr(0, name1);
+            middle_ = one.substr(name1 + name_placeholder.size(), sequence1 - name1 - name_placeholder.size());
+            suffix_ = one.substr(sequence1 + sequence_placeholder.size());
+            separator_ = two.substr(sequence2 + sequence_placeholder.size(), name3 - sequence2 - sequence_placeholder.size());
+            if (two != fmt::format("{}{}{}{}{}{}{}{}{}", prefix_, name_placeholder, middle_, sequence_placeholder, separator_, name_placeholder, middle_, sequence_placeholder, suffix_))
+                throw std::runtime_error{fmt::format("unrecognized to_json layout: {}", two)};
+        }
 
-        if (options.e_most_common_length == export_options::most_common_length::yes) {
-            const acmacs::Counter counter(to_export, [](const auto& en) { return en.sequence.size(); });
-            const auto most_common_length = counter.max().first;
-            AD_LOG(acmacs::log::fasta, "most common length: {}", most_common_length);
-            ranges::for_each(to_export, [most_common_length](auto& en) { en.sequence.resize(most_common_length, '-'); });
+        std::string_view empty() const { return empty_; } // no records
+        std::string_view prefix() const { return prefix_; }
+        std::string_view middle() const { return middle_; }
+        std::string_view separator() const { return separator_; }
+        std::string_view suffix() const { return suffix_; }
+
+        // name as it is put by to_json (quotes and escaping), without the surrounding layout
+        std::string name(std::string_view source) const
+        {
+            const auto one = format({{std::string{source}, sequence_placeholder}});
+            return one.substr(prefix_.size(), one.size() - prefix_.size() - middle_.size() - sequence_placeholder.size() - suffix_.size());
         }
-        else if (options.e_length > 0) {
-            AD_LOG(acmacs::log::fasta, "sequence length for exporting: {}", options.e_length);
-            ranges::for_each(to_export, [length = options.e_length](auto& en) { en.sequence.resize(length, '-'); });
+
+      private:
+        static inline const std::string name_placeholder{"NamePlaceholder"}, sequence_placeholder{"SequencePlaceholder"}; // not changed by escaping
+        std::string empty_, prefix_, middle_, separator_, suffix_;
+
+        static std::string format(const std::vector<std::pair<std::string, std::string>>& records)
+        {
+            to_json::array arr;
+            for (const auto& [name, sequence] : records) {
+                arr << to_json::object{
+                    to_json::key_val{"N", name},
+                    to_json::key_val{"S", sequence},
+                };
+            }
+            return fmt::format("{}\n", arr);
         }
+    };
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::export_json_sequences(std::string_view filename, const Seqdb& seqdb, const export_options& options)
+{
+    // [{"N": name, "S": sequence}, ...] in the to_json layout, sequences are decoded from seqdb and padded on the fly
+    if (!filename.empty()) {
+        const auto to_export = export_collect_views(seqdb, options);
+        const size_t length = export_length(to_export, options);
 
         AD_LOG(acmacs::log::fasta, "writing {} sequences to {}", to_export.size(), filename);
-        acmacs::file::write(filename, export_json(to_export, options));
+        output_stream_t output{filename, options.e_threads == 0 ? static_cast<size_t>(omp_get_max_threads()) : options.e_threads};
+        const local::export_json_layout_t layout;
+        const name_format_t name_format{options.e_name_format};
+        fmt::memory_buffer name;
+        std::string sequence;
+        if (to_export.empty())
+            output.write(layout.empty());
+        else
+            output.write(layout.prefix());
+        for (size_t record_no = 0; record_no < to_export.size(); ++record_no) {
+            const auto& [rf, source] = to_export[record_no];
+            sequence.clear();
+            source.text(sequence, length ? length : std::string_view::npos);
+            name.clear();
+            name_format.format_to(name, seqdb, *this, *rf);
+            if (record_no)
+                output.write(layout.separator());
+            output.write(layout.name(std::string_view{name.data(), name.size()}));
+            output.write(layout.middle());
+            output.write(sequence); // amino acids or nucleotides, nothing to escape
+            output.write(length > sequence.size() ? length - sequence.size() : 0, '-');
+        }
+        if (!to_export.empty())
+            output.write(layout.suffix());
+        output.close();
     }
     return *this;
 
@@ -807,67 +996,44 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::export_json_sequences(std:
 
 // ----------------------------------------------------------------------
 
-std::string acmacs::seqdb::v3::subset::make_name(const Seqdb& seqdb, std::string_view name_format, const ref& entry) const
-{
-    const auto nf = ::string::replace(::string::replace(name_format, "\\t", "\t"), "\\n", "\n");
-    return fmt::substitute(nf,                                                                                                                                                                  //
-                           std::pair{"seq_id", [&entry]() { return entry.seq_id(); }},                                                                                                          //
-                           std::pair{"hash", [&entry,&seqdb]() { return entry.seq().with_sequence(seqdb).hash; }},                                                                                                          //
-                           std::pair{"full_name", [&entry]() { return entry.full_name(); }},                                                                                                    //
-                           std::pair{"hi_name_or_full_name", [&entry]() { return entry.hi_name_or_full_name(); }},                                                                              //
-                           std::pair{"hi_names", entry.seq().hi_names},                                                                                                                         //
-                           std::pair{"hi_name", [&entry]() { return !entry.seq().hi_names.empty() ? entry.seq().hi_names.front() : std::string_view{}; }},                                      //
-                           std::pair{"lineage", entry.entry->lineage},                                                                                                                          //
-                           std::pair{"name", entry.entry->name},                                                                                                                                //
-                           std::pair{"date", entry.entry->date()},                                                                                                                              //
-                           std::pair{"dates", entry.entry->dates},                                                                                                                              //
-                           std::pair{"lab_id", [&entry]() { return entry.seq().lab_id(); }},                                                                                                    //
-                           std::pair{"passage", [&entry]() { return entry.seq().passage(); }},                                                                                                  //
-                           std::pair{"clades", [&entry, &seqdb]() { return entry.seq().with_sequence(seqdb).clades; }},                                                                         //
-                           std::pair{"lab", [&entry]() { return entry.seq().lab(); }},                                                                                                          //
-                           std::pair{"country", entry.entry->country},                                                                                                                          //
-                           std::pair{"continent", entry.entry->continent},                                                                                                                      //
-                           std::pair{"group_no", [&entry]() { return entry.group_no ? fmt::format("group:{}", entry.group_no) : std::string{}; }},                                              //
-                           std::pair{"hamming_distance", entry.hamming_distance},                                                                                                               //
-                           std::pair{"nuc_length", [&entry, &seqdb]() { return entry.nuc_aligned_length(seqdb); }},                                                                             //
-                           std::pair{"aa_length", [&entry, &seqdb]() { return entry.aa_aligned_length(seqdb); }},                                                                               //
-                           std::pair{"gisaid_accession_numbers", [&entry]() { return acmacs::string::join(acmacs::string::join_sep_t{"|"}, entry.seq().gisaid.isolate_ids); }},                 //
-                           std::pair{"ncbi_accession_numbers", [&entry]() { return acmacs::string::join(acmacs::string::join_sep_t{"|"}, entry.seq().gisaid.sample_ids_by_sample_provider); }}, //
-                           std::pair{"issues", [&entry, &seqdb]() { return fmt::format("{}", entry.seq().with_sequence(seqdb).issues); }},                                                      //
-
-                           std::pair{"nuc", [&entry, &seqdb]() { return entry.nuc_aligned(seqdb); }}, //
-                           std::pair{"aa", [&entry, &seqdb]() { return entry.aa_aligned(seqdb); }}    //
-    );
+std::string acmacs::seqdb::v3::subset::make_name(const Seqdb& seqdb, const name_format_t& name_format, const ref& entry) const
+{
+    return name_format.format(seqdb, *this, entry);
 
 } // acmacs::seqdb::v3::subset::make_name
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::subset::collected_t acmacs::seqdb::v3::subset::export_collect(const Seqdb& seqdb, const export_options& options) const
+acmacs::seqdb::v3::packed_sequence_with_alignment_t acmacs::seqdb::v3::subset::export_sequence(const Seqdb& seqdb, const export_options& options, const ref& entry) const
 {
-    const auto get_seq = [&options,&seqdb](const auto& entry) -> std::string_view {
-        const auto& seq = entry.seq().with_sequence(seqdb);
-        AD_LOG(acmacs::log::fasta, "{} has-seq:{}", entry.seq_id(), entry.is_master());
-        if (!entry.is_master())
-            AD_LOG(acmacs::log::fasta, "    ref:({} {})", entry.seq().master.name, entry.seq().master.hash);
-        AD_LOG(acmacs::log::fasta, "    aa:{} nuc:{}", seq.aa_aligned_length_master(), seq.nuc_aligned_length_master());
-        if (options.e_format == export_options::format::fasta_aa) {
-            if (options.e_aligned == export_options::aligned::yes)
-                return *seq.aa_aligned_master();
-            else
-                return std::get<std::string_view>(seq.amino_acids);
-        }
-        else {
-            if (options.e_aligned == export_options::aligned::yes)
-                return *seq.nuc_aligned_master();
-            else
-                return std::get<std::string_view>(seq.nucs);
-        }
-    };
+    const auto& seq = entry.seq().with_sequence(seqdb);
+    AD_LOG(acmacs::log::fasta, "{} has-seq:{}", entry.seq_id(), entry.is_master());
+    if (!entry.is_master())
+        AD_LOG(acmacs::log::fasta, "    ref:({} {})", entry.seq().master.name, entry.seq().master.hash);
+    AD_LOG(acmacs::log::fasta, "    aa:{} nuc:{}", seq.aa_aligned_length_master(), seq.nuc_aligned_length_master());
+    if (options.e_format == export_options::format::fasta_aa) {
+        if (options.e_aligned == export_options::aligned::yes)
+            return {std::string_view{}, seq.amino_acids.aligned};
+        else
+            return seq.amino_acids;
+    }
+    else {
+        if (options.e_aligned == export_options::aligned::yes)
+            return {std::string_view{}, seq.nucs.aligned};
+        else
+            return seq.nucs;
+    }
 
+} // acmacs::seqdb::v3::subset::export_sequence
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::subset::collected_t acmacs::seqdb::v3::subset::export_collect(const Seqdb& seqdb, const export_options& options) const
+{
     collected_t result(refs_.size()); // {seq_id, sequence}
+    const name_format_t name_format{options.e_name_format};
     std::transform(std::begin(refs_), std::end(refs_), std::begin(result),
-                   [this, &options, &get_seq, &seqdb](const auto& en) -> collected_entry_t { return {make_name(seqdb, options.e_name_format, en), std::string{get_seq(en)}}; });
+                   [this, &name_format, &options, &seqdb](const auto& en) -> collected_entry_t { return {make_name(seqdb, name_format, en), export_sequence(seqdb, options, en).text()}; });
     // remove entries with empty sequences
     result.erase(std::remove_if(std::begin(result), std::end(result), [](const auto& en) { return en.sequence.empty(); }), std::end(result));
     AD_LOG(acmacs::log::fasta, "collected for exporting: {}", result.size());
@@ -877,6 +1043,40 @@ acmacs::seqdb::v3::subset::collected_t acmacs::seqdb::v3::subset::export_collect
 
 // ----------------------------------------------------------------------
 
+acmacs::seqdb::v3::subset::collected_views_t acmacs::seqdb::v3::subset::export_collect_views(const Seqdb& seqdb, const export_options& options) const
+{
+    collected_views_t result;
+    result.reserve(refs_.size());
+    for (const auto& en : refs_) {
+        if (const auto sequence = export_sequence(seqdb, options, en); !sequence.empty())
+            result.emplace_back(&en, sequence);
+    }
+    AD_LOG(acmacs::log::fasta, "collected for exporting: {}", result.size());
+    return result;
+
+} // acmacs::seqdb::v3::subset::export_collect_views
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::seqdb::v3::subset::export_length(const collected_views_t& entries, const export_options& options)
+{
+    if (options.e_most_common_length == export_options::most_common_length::yes) {
+        const acmacs::Counter counter(entries, [](const auto& en) { return en.second.size(); });
+        const auto length = counter.max().first;
+        AD_LOG(acmacs::log::fasta, "most common length: {}", length);
+        return length;
+    }
+    else if (options.e_length > 0) {
+        AD_LOG(acmacs::log::fasta, "sequence length for exporting: {}", options.e_length);
+        return options.e_length;
+    }
+    else
+        return 0;
+
+} // acmacs::seqdb::v3::subset::export_length
+
+// ----------------------------------------------------------------------
+
 std::string acmacs::seqdb::v3::subset::export_fasta(const collected_t& entries, const export_options& options) const
 {
     fmt::memory_buffer out;
@@ -897,27 +1097,15 @@ std::string acmacs::seqdb::v3::subset::export_fasta(const collected_t& entries,
 
 // ----------------------------------------------------------------------
 
-std::string acmacs::seqdb::v3::subset::export_json(const collected_t& entries, const export_options& /*options*/) const
-{
-    to_json::array arr;
-    for (const auto& en : entries) {
-        arr << to_json::object{
-            to_json::key_val{"N", en.seq_id},
-            to_json::key_val{"S", en.sequence},
-        };
-    }
-    return fmt::format("{}\n", arr);
-
-} // acmacs::seqdb::v3::subset::export_json
-
-// ----------------------------------------------------------------------
-
 acmacs::seqdb::v3::subset acmacs::seqdb::v3::subset::filter_by_indexes(const acmacs::chart::PointIndexList& indexes, enum matched_only matched_only) const
 {
     subset result;
     for (auto index : indexes) {
-        if (index < refs_.size() && (matched_only == matched_only::no || refs_[index]))
+        if (index < refs_.size() && (matched_only == matched_only::no || refs_[index])) {
             result.refs_.push_back(refs_[index]);
+            if (const auto found = annotations_.find(refs_[index]); found != annotations_.end())
+                result.annotations_.insert(*found);
+        }
     }
     return result;
 
@@ -930,8 +1118,17 @@ acmacs::seqdb::v3::subset& acmacs::seqdb::v3::subset::print(const Seqdb& seqdb,
     if (do_print) {
         if (!header.empty())
             fmt::print("{}\n", header);
-        for (const auto& ref : *this)
-            fmt::print("{}\n", make_name(seqdb, name_format, ref));
+        // names are formatted into a buffer reused for all refs and written to stdout in large chunks
+        const name_format_t compiled{name_format};
+        output_stream_t output{"-"};
+        fmt::memory_buffer name;
+        for (const auto& ref : *this) {
+            name.clear();
+            compiled.format_to(name, seqdb, *this, ref);
+            name.push_back('\n');
+            output.write(std::string_view{name.data(), name.size()});
+        }
+        output.close();
     }
     return const_cast<subset&>(*this);
 
@@ -4,8 +4,12 @@
 #include <numeric>
 #include <memory>
 #include <cstdlib>
+#include <charconv>
+#include <cctype>
+#include <exception>
 
 #include "acmacs-base/read-file.hh"
+#include "acmacs-base/filesystem.hh"
 #include "acmacs-base/enumerate.hh"
 #include "acmacs-base/acmacsd.hh"
 #include "acmacs-base/string-split.hh"
@@ -16,8 +20,11 @@
 #include "acmacs-base/string-matcher.hh"
 #include "acmacs-virus/virus-name-normalize.hh"
 #include "acmacs-virus/virus-name-v1.hh"
+#include "locationdb/locdb.hh"
 #include "seqdb-3/seqdb.hh"
 #include "seqdb-3/seqdb-parse.hh"
+#include "seqdb-3/clades.hh"
+#include "seqdb-3/column-profile.hh"
 #include "seqdb-3/log.hh"
 
 // ----------------------------------------------------------------------
@@ -29,38 +36,99 @@
 #endif
 
 static std::string sSeqdbFilename = acmacs::seqdb_v3_dir() + "/seqdb.json.xz";
+static std::vector<std::string> sSeqdb4Subtypes; // shards to load if sSeqdbFilename is seqdb-4 directory
+static acmacs::seqdb::v3::build_indexes_on_load sBuildIndexesOnLoad{acmacs::seqdb::v3::build_indexes_on_load::no};
 
 #pragma GCC diagnostic pop
 
-void acmacs::seqdb::v3::setup(std::string_view filename)
+void acmacs::seqdb::v3::setup(std::string_view filename, build_indexes_on_load bi)
 {
     if (!filename.empty())
         sSeqdbFilename = filename;
+    sBuildIndexesOnLoad = bi;
 
 } // acmacs::seqdb::v3::setup
 
 // ----------------------------------------------------------------------
 
-const acmacs::seqdb::v3::Seqdb& acmacs::seqdb::v3::Seqdb::get()
+void acmacs::seqdb::v3::setup_seqdb4(std::string_view directory, const std::vector<std::string>& subtypes, build_indexes_on_load bi)
+{
+    sSeqdbFilename = directory;
+    sSeqdb4Subtypes = subtypes;
+    sBuildIndexesOnLoad = bi;
+
+} // acmacs::seqdb::v3::setup_seqdb4
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::seqdb4_shard(std::string_view subtype)
+{
+    // "A(H3N2)" -> "h3", "H3" -> "h3", "B" -> "b"
+    if (subtype.starts_with("A(H"))
+        subtype.remove_prefix(2);
+    if (subtype.size() > 1 && (subtype[0] == 'H' || subtype[0] == 'h') && std::isdigit(static_cast<unsigned char>(subtype[1]))) {
+        const auto digits = std::find_if(std::next(std::begin(subtype)), std::end(subtype), [](char cc) { return !std::isdigit(static_cast<unsigned char>(cc)); });
+        return fmt::format("h{}", std::string_view(&subtype[1], static_cast<size_t>(digits - std::next(std::begin(subtype)))));
+    }
+    if (subtype == "B" || subtype == "b")
+        return "b";
+    return "unknown";
+
+} // acmacs::seqdb::v3::seqdb4_shard
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::seqdb::v3::seqdb4_filename(std::string_view directory, std::string_view shard)
+{
+    return fmt::format("{}/seqdb4-{}.json.xz", directory, shard);
+
+} // acmacs::seqdb::v3::seqdb4_filename
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::Seqdb& acmacs::seqdb::v3::Seqdb::instance()
 {
 #pragma GCC diagnostic push
 #ifdef __clang__
 #pragma GCC diagnostic ignored "-Wexit-time-destructors"
 #endif
-    static Seqdb sSeqdb(sSeqdbFilename);
+    static Seqdb sSeqdb(sSeqdbFilename, sSeqdb4Subtypes);
 #pragma GCC diagnostic pop
-
     return sSeqdb;
 
+} // acmacs::seqdb::v3::Seqdb::instance
+
+// ----------------------------------------------------------------------
+
+const acmacs::seqdb::v3::Seqdb& acmacs::seqdb::v3::Seqdb::get()
+{
+    auto& seqdb = instance();
+    [[maybe_unused]] static const bool indexes_built = [&seqdb] {
+        if (sBuildIndexesOnLoad == build_indexes_on_load::yes)
+            seqdb.build_indexes();
+        return true;
+    }();
+
+    return seqdb;
+
 } // acmacs::seqdb::v3::get
 
 // ----------------------------------------------------------------------
 
-acmacs::seqdb::v3::Seqdb::Seqdb(std::string_view filename)
+acmacs::seqdb::v3::Seqdb::Seqdb(std::string_view filename, const std::vector<std::string>& subtypes)
 {
     try {
-        json_text_ = static_cast<std::string>(acmacs::file::read(filename));
-        parse(json_text_, entries_);
+        if (fs::is_directory(filename)) {
+            load_seqdb4(filename, subtypes);
+        }
+        else {
+            auto& source = sources_.emplace_back();
+            parse(static_cast<std::string>(acmacs::file::read(filename)), entries_, source.arena);
+            AD_LOG(acmacs::log::sequences, "seqdb arena: strings: {} in {} blocks, labs: {} in {} blocks, text: {} in {} blocks, aa: {}, nucs: {}", source.arena.strings.allocated(),
+                   source.arena.strings.number_of_blocks(), source.arena.labs.allocated(), source.arena.labs.number_of_blocks(), source.arena.text.allocated(),
+                   source.arena.text.number_of_blocks(), source.arena.amino_acids.size(), source.arena.nucs.size());
+        }
+        build_dictionaries();
         find_slaves();
     }
     catch (in_json::error& err) {
@@ -69,14 +137,126 @@ acmacs::seqdb::v3::Seqdb::Seqdb(std::string_view filename)
     }
     catch (std::exception& err) {
         AD_WARNING("seqdb not loaded: {}", err);
-        json_text_.clear();
         entries_.clear();
+        sources_.clear();
+        slaves_of_masters_.clear();
+        dictionaries_ = dictionaries_t{};
+        codes_.clear();
     }
 
 } // acmacs::seqdb::v3::Seqdb::Seqdb
 
 // ----------------------------------------------------------------------
 
+void acmacs::seqdb::v3::Seqdb::load_seqdb4(std::string_view directory, const std::vector<std::string>& subtypes)
+{
+    std::vector<std::string> filenames;
+    if (subtypes.empty()) {
+        for (const auto& file : fs::directory_iterator(directory)) {
+            if (const auto name = file.path().filename().string(); name.starts_with("seqdb4-") && name.ends_with(".json.xz"))
+                filenames.push_back(file.path().string());
+        }
+        std::sort(std::begin(filenames), std::end(filenames));
+    }
+    else {
+        for (const auto& subtype : subtypes) {
+            if (const auto filename = seqdb4_filename(directory, seqdb4_shard(subtype)); std::find(std::begin(filenames), std::end(filenames), filename) == std::end(filenames))
+                filenames.push_back(filename);
+        }
+    }
+    if (filenames.empty())
+        throw std::runtime_error{fmt::format("no seqdb-4 shards found in {}", directory)};
+
+    // shards are read and parsed in parallel, each one into its own source
+    const auto load = [this](const std::vector<std::string>& shard_filenames) {
+        const size_t first_source = sources_.size();
+        sources_.resize(first_source + shard_filenames.size());
+        std::vector<std::vector<SeqdbEntry>> entries_of_shards(shard_filenames.size());
+        std::vector<std::string> errors(shard_filenames.size());
+        std::vector<std::exception_ptr> exceptions(shard_filenames.size());
+#pragma omp parallel for default(shared) schedule(dynamic, 1)
+        for (size_t shard_no = 0; shard_no < shard_filenames.size(); ++shard_no) {
+            try {
+                auto& source = sources_[first_source + shard_no];
+                parse(static_cast<std::string>(acmacs::file::read(shard_filenames[shard_no])), entries_of_shards[shard_no], source.arena, source.names);
+            }
+            catch (in_json::error& err) {
+                errors[shard_no] = fmt::format("{}:{}:{}: error: {}", shard_filenames[shard_no], err.line_no, err.column_no, err.message);
+            }
+            catch (std::exception&) {
+                exceptions[shard_no] = std::current_exception();
+            }
+        }
+        for (size_t shard_no = 0; shard_no < shard_filenames.size(); ++shard_no) {
+            if (!errors[shard_no].empty()) {
+                AD_ERROR("{}", errors[shard_no]);
+                std::exit(99);
+            }
+            if (exceptions[shard_no])
+                std::rethrow_exception(exceptions[shard_no]);
+        }
+
+        entries_.reserve(entries_.size() + std::accumulate(std::begin(entries_of_shards), std::end(entries_of_shards), size_t{0}, [](size_t sum, const auto& shard) { return sum + shard.size(); }));
+        for (auto& shard : entries_of_shards)
+            std::move(std::begin(shard), std::end(shard), std::back_inserter(entries_));
+    };
+
+    // slaves having master in another shard (reference with "S") need that shard, it is loaded too (and shards referenced by it)
+    std::vector<std::string> loaded;
+    const auto not_loaded = [&loaded, &filenames](const std::string& filename) {
+        const auto same_file = [name = fs::path{filename}.filename()](const std::string& another) { return fs::path{another}.filename() == name; };
+        return std::none_of(std::begin(loaded), std::end(loaded), same_file) && std::none_of(std::begin(filenames), std::end(filenames), same_file);
+    };
+    while (!filenames.empty()) {
+        load(filenames);
+        std::move(std::begin(filenames), std::end(filenames), std::back_inserter(loaded));
+        filenames.clear();
+        for (const auto& entry : entries_) {
+            for (const auto& seq : entry.seqs) {
+                if (!seq.master.shard.empty()) {
+                    if (auto filename = seqdb4_filename(directory, seq.master.shard); not_loaded(filename))
+                        filenames.push_back(std::move(filename));
+                }
+            }
+        }
+        if (!filenames.empty())
+            AD_INFO("seqdb-4: loading {} having masters of sequences in loaded shards", filenames);
+    }
+
+    std::sort(std::begin(entries_), std::end(entries_), [](const auto& e1, const auto& e2) { return e1.name < e2.name; });
+    AD_LOG(acmacs::log::sequences, "seqdb-4 shards loaded: {} entries: {}", loaded, entries_.size());
+
+} // acmacs::seqdb::v3::Seqdb::load_seqdb4
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::Seqdb::build_dictionaries()
+{
+    size_t number_of_codes{0};
+    for (const auto& entry : entries_) {
+        for (const auto& seq : entry.seqs)
+            number_of_codes += seq.lab_ids.size() + seq.clades.size();
+    }
+    codes_.resize(number_of_codes); // not resized afterwards, seqs keep spans into it
+
+    dictionary_code_t* code = codes_.data();
+    for (auto& entry : entries_) {
+        entry.virus_type_code = dictionaries_.virus_types.intern(entry.virus_type);
+        entry.lineage_code = dictionaries_.lineages.intern(entry.lineage);
+        entry.continent_code = dictionaries_.continents.intern(entry.continent);
+        entry.country_code = dictionaries_.countries.intern(entry.country);
+        for (auto& seq : entry.seqs) {
+            seq.lab_codes = SeqdbSeq::codes_t{code, seq.lab_ids.size()};
+            code = std::transform(std::begin(seq.lab_ids), std::end(seq.lab_ids), code, [this](const auto& en) { return dictionaries_.labs.intern(en.first); });
+            seq.clade_codes = SeqdbSeq::codes_t{code, seq.clades.size()};
+            code = std::transform(std::begin(seq.clades), std::end(seq.clades), code, [this](std::string_view clade) { return dictionaries_.clades.intern(clade); });
+        }
+    }
+
+} // acmacs::seqdb::v3::Seqdb::build_dictionaries
+
+// ----------------------------------------------------------------------
+
 // acmacs::seqdb::v3::Seqdb::Seqdb(std::string&& source)
 //     : json_text_(std::move(source))
 // {
@@ -89,7 +269,7 @@ acmacs::seqdb::v3::Seqdb::Seqdb(std::string_view filename)
 acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::all() const
 {
     subset ss;
-    ss.refs_.reserve(entries_.size() * 2);
+    ss.refs_.reserve(std::accumulate(std::begin(entries_), std::end(entries_), size_t{0}, [](size_t sum, const auto& entry) { return sum + entry.seqs.size(); }));
     for (const auto& entry : entries_) {
         for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no)
             ss.refs_.emplace_back(&entry, seq_no);
@@ -151,6 +331,24 @@ acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::find_by_seq_ids(const std::v
 
 // ----------------------------------------------------------------------
 
+acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::find_by_accession_numbers(const std::vector<std::string_view>& accession_numbers) const
+{
+    const auto& index = accession_number_index();
+    subset result(accession_numbers.size());
+    std::transform(std::begin(accession_numbers), std::end(accession_numbers), result.begin(), [&index](std::string_view accession_number) -> ref {
+        // the first in seqdb order if accession number is shared by several seqs
+        if (const auto [first, last] = index.equal_range(accession_number); first != last)
+            return std::min_element(first, last, [](const auto& e1, const auto& e2) { return e1.second.entry == e2.second.entry ? e1.second.seq_index < e2.second.seq_index : e1.second.entry < e2.second.entry; })->second;
+        else
+            return {};
+    });
+
+    return result;
+
+} // acmacs::seqdb::v3::Seqdb::find_by_accession_numbers
+
+// ----------------------------------------------------------------------
+
 acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::select_by_name(std::string_view name) const
 {
     subset ss;
@@ -172,6 +370,26 @@ acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::select_by_name(const std::ve
 
 // ----------------------------------------------------------------------
 
+namespace local
+{
+    // "A(H3N2)/HONG KONG/1/2020" -> "HONG KONG/1/2020"
+    inline std::string_view name_without_subtype(std::string_view name)
+    {
+        if (const auto slash = name.find('/'); slash != std::string_view::npos)
+            return name.substr(slash + 1);
+        else
+            return name;
+    }
+
+    // "A(H3N2)/HONG KONG/1/2020" -> "A(H3N2)"
+    inline std::string_view subtype_of_name(std::string_view name) { return name.substr(0, name.find('/')); }
+
+    inline bool has_subtype_prefix(std::string_view name) { return name.size() > 1 && (name[0] == 'A' || name[0] == 'a' || name[0] == 'B' || name[0] == 'b') && (name[1] == '/' || name[1] == '('); }
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
 void acmacs::seqdb::v3::Seqdb::select_by_name(std::string_view name, subset& subs) const
 {
     using namespace std::string_view_literals;
@@ -189,22 +407,32 @@ void acmacs::seqdb::v3::Seqdb::select_by_name(std::string_view name, subset& sub
         //     fmt::print(stderr, "DEBUG: not found\n", found->name);
     };
 
+    // parsing the name with each subtype prefix (and looking it up) is replaced with a single probe of
+    // name_without_subtype_index, parsing with different prefixes produces the same name without subtype
+    const auto find_name_without_subtype = [&subs, this](std::string_view parsed_name, std::initializer_list<std::string_view> subtypes) {
+        const auto& index = name_without_subtype_index();
+        if (const auto found = index.find(local::name_without_subtype(parsed_name)); found != index.end()) {
+            for (const auto subtype : subtypes) { // in the order of subtypes as if looked up one by one
+                for (const auto* entry : found->second) {
+                    if (local::subtype_of_name(entry->name) == subtype) {
+                        for (size_t seq_no = 0; seq_no < entry->seqs.size(); ++seq_no)
+                            subs.refs_.emplace_back(entry, seq_no);
+                    }
+                }
+            }
+        }
+    };
+
     const auto subs_initial_size = subs.size();
     find_name(name);
     if (subs.size() == subs_initial_size && (name[0] == 'A' || name[0] == 'a' || name[0] == 'B' || name[0] == 'b')) {
         const auto result = acmacs::virus::name::parse(name);
         find_name(result.name());
-        if (subs.size() == subs_initial_size && (name[0] == 'A' || name[0] == 'a') && name[1] == '/') {
-            for (const auto subtype : {"A(H1N1)/"sv, "A(H3N2)/"sv, "A(H1)/"sv, "A(H3)/"sv}) {
-                find_name(acmacs::virus::name::parse(fmt::format("{}{}", subtype, name.substr(2))).name());
-            }
-        }
-    }
-    if (subs.size() == subs_initial_size) {
-        for (const auto subtype : {"A(H1N1)/"sv, "A(H3N2)/"sv, "B/"sv, "A(H1)/"sv, "A(H3)/"sv}) {
-            find_name(acmacs::virus::name::parse(fmt::format("{}{}", subtype, name)).name());
-        }
+        if (subs.size() == subs_initial_size && (name[0] == 'A' || name[0] == 'a') && name[1] == '/')
+            find_name_without_subtype(result.name(), {"A(H1N1)"sv, "A(H3N2)"sv, "A(H1)"sv, "A(H3)"sv});
     }
+    if (subs.size() == subs_initial_size && !local::has_subtype_prefix(name)) // name with subtype prefix cannot match after prepending another subtype
+        find_name_without_subtype(acmacs::virus::name::parse(fmt::format("A(H3N2)/{}", name)).name(), {"A(H1N1)"sv, "A(H3N2)"sv, "B"sv, "A(H1)"sv, "A(H3)"sv});
 
 } // acmacs::seqdb::v3::Seqdb::select_by_name
 
@@ -212,23 +440,15 @@ void acmacs::seqdb::v3::Seqdb::select_by_name(std::string_view name, subset& sub
 
 acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::select_by_accession_number(const std::vector<std::string_view>& accession_numbers) const
 {
-    const auto intersect = [&accession_numbers](const std::vector<std::string_view> ids) {
-        for (const auto& id : ids) {
-            if (const auto found = std::find(std::begin(accession_numbers), std::end(accession_numbers), id); found != std::end(accession_numbers)) {
-                // AD_DEBUG("select_by_accession_number {}", ids);
-                return true;
-            }
-        }
-        return false;
-    };
-
+    const auto& index = accession_number_index();
     subset ss;
-    for (const auto& entry : entries_) {
-        for (auto [seq_no, seq] : acmacs::enumerate(entry.seqs)) {
-            if (intersect(seq.gisaid.isolate_ids) || intersect(seq.gisaid.sample_ids_by_sample_provider))
-                ss.refs_.emplace_back(&entry, seq_no);
-        }
+    for (const auto& accession_number : accession_numbers) {
+        const auto [first, last] = index.equal_range(accession_number);
+        std::transform(first, last, std::back_inserter(ss.refs_), [](const auto& en) { return en.second; });
     }
+    // seqdb order, each seq once
+    std::sort(std::begin(ss.refs_), std::end(ss.refs_), [](const auto& e1, const auto& e2) { return e1.entry == e2.entry ? e1.seq_index < e2.seq_index : e1.entry < e2.entry; });
+    ss.refs_.erase(std::unique(std::begin(ss.refs_), std::end(ss.refs_)), std::end(ss.refs_));
     return ss;
 
 } // acmacs::seqdb::v3::Seqdb::select_by_accession_number
@@ -236,22 +456,30 @@ acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::select_by_accession_number(c
 // ----------------------------------------------------------------------
 
 acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::select_by_name_hash(std::string_view name, std::string_view hash) const
+{
+    return select_by_name_hash(name, hash_value(hash));
+
+} // acmacs::seqdb::v3::Seqdb::select_by_name_hash
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::select_by_name_hash(std::string_view name, hash_value_t hash) const
 {
     subset ss;
     if (auto [found_first, found_last] = hash_index().find(hash); found_first != found_last) {
         bool ref_found{false};
         for (; found_first != found_last; ++found_first) {
-            if (found_first->second.entry->name == name) {
-                ss.append(found_first->second);
+            if (found_first->entry->name == name) {
+                ss.append(*found_first);
                 ref_found = true;
-                // fmt::print(stderr, "DEBUG: select_by_name_hash {} {} -> {}\n", name, hash, found_first->second.full_name());
+                // fmt::print(stderr, "DEBUG: select_by_name_hash {} {:08X} -> {}\n", name, hash, found_first->full_name());
             }
         }
         if (!ref_found)
-            AD_WARNING("Seqdb::select_by_name_hash: name difference for hash {}, no \"{}\"", hash, name);
+            AD_WARNING("Seqdb::select_by_name_hash: name difference for hash {:08X}, no \"{}\"", hash, name);
     }
     // else
-    //     fmt::print(stderr, "DEBUG: select_by_name_hash {} {} -> NOT FOUND\n", name, hash);
+    //     fmt::print(stderr, "DEBUG: select_by_name_hash {} {:08X} -> NOT FOUND\n", name, hash);
     return ss;
 
 } // acmacs::seqdb::v3::Seqdb::select_by_name_hash
@@ -316,8 +544,7 @@ acmacs::seqdb::v3::ref acmacs::seqdb::v3::Seqdb::find_hi_name(std::string_view f
 
 const acmacs::seqdb::v3::seq_id_index_t& acmacs::seqdb::v3::Seqdb::seq_id_index() const
 {
-    std::lock_guard<std::mutex> index_guard(index_access_);
-    if (seq_id_index_.empty()) {
+    std::call_once(seq_id_index_built_, [this]() {
         for (const auto& entry : entries_) {
             for (auto [seq_no, seq] : acmacs::enumerate(entry.seqs)) {
                 for (const auto& designation : seq.designations())
@@ -325,7 +552,7 @@ const acmacs::seqdb::v3::seq_id_index_t& acmacs::seqdb::v3::Seqdb::seq_id_index(
             }
         }
         seq_id_index_.sort();     // force sorting to avoid future raise condition during access from different threads
-    }
+    });
     return seq_id_index_;
 
 } // acmacs::seqdb::v3::Seqdb::seq_id_index
@@ -334,8 +561,7 @@ const acmacs::seqdb::v3::seq_id_index_t& acmacs::seqdb::v3::Seqdb::seq_id_index(
 
 const acmacs::seqdb::v3::hi_name_index_t& acmacs::seqdb::v3::Seqdb::hi_name_index() const
 {
-    std::lock_guard<std::mutex> index_guard(index_access_);
-    if (hi_name_index_.empty()) {
+    std::call_once(hi_name_index_built_, [this]() {
         for (const auto& entry : entries_) {
             for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no) {
                 for (const auto& hi_name : entry.seqs[seq_no].hi_names)
@@ -343,7 +569,7 @@ const acmacs::seqdb::v3::hi_name_index_t& acmacs::seqdb::v3::Seqdb::hi_name_inde
             }
         }
         hi_name_index_.sort();     // force sorting to avoid future raise condition during access from different threads
-    }
+    });
     return hi_name_index_;
 
 } // acmacs::seqdb::v3::Seqdb::hi_name_index
@@ -352,8 +578,7 @@ const acmacs::seqdb::v3::hi_name_index_t& acmacs::seqdb::v3::Seqdb::hi_name_inde
 
 const acmacs::seqdb::v3::lab_id_index_t& acmacs::seqdb::v3::Seqdb::lab_id_index() const
 {
-    std::lock_guard<std::mutex> index_guard(index_access_);
-    if (lab_id_index_.empty()) {
+    std::call_once(lab_id_index_built_, [this]() {
         for (const auto& entry : entries_) {
             for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no) {
                 for (const auto& [lab, lab_ids] : entry.seqs[seq_no].lab_ids) {
@@ -366,7 +591,7 @@ const acmacs::seqdb::v3::lab_id_index_t& acmacs::seqdb::v3::Seqdb::lab_id_index(
         }
         lab_id_index_.sort();     // force sorting to avoid future raise condition during access from different threads
         // duplicates are possible!
-    }
+    });
     return lab_id_index_;
 
 } // acmacs::seqdb::v3::Seqdb::lab_id_index
@@ -375,27 +600,185 @@ const acmacs::seqdb::v3::lab_id_index_t& acmacs::seqdb::v3::Seqdb::lab_id_index(
 
 const acmacs::seqdb::v3::hash_index_t& acmacs::seqdb::v3::Seqdb::hash_index() const
 {
-    std::lock_guard<std::mutex> index_guard(index_access_);
-    if (hash_index_.empty()) {
-        using namespace ranges::views;
-        hash_index_.collect(
-            entries_
-            | for_each([](const auto& entry) {
-                return ranges::yield_from(
-                    ints(0UL, entry.seqs.size())
-                    | transform([&entry](auto seq_no) { return std::pair{entry.seqs[seq_no].hash, seq_no}; })
-                    | filter([](const auto& hash_seq_no) { return !hash_seq_no.first.empty(); })
-                    | transform([&entry](const auto& hash_seq_no) -> std::pair<std::string_view, ref> { return {hash_seq_no.first, ref{&entry, hash_seq_no.second}}; }));
-            }));
-        hash_index_.sort();     // force sorting to avoid future raise condition during access from different threads
-    }
+    std::call_once(hash_index_built_, [this]() {
+        std::vector<std::pair<hash_value_t, ref>> source;
+        for (const auto& entry : entries_) {
+            for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no) {
+                if (const auto& seq = entry.seqs[seq_no]; !seq.hash.empty())
+                    source.emplace_back(seq.hash_value, ref{&entry, seq_no});
+            }
+        }
+        hash_index_.build(std::move(source));
+    });
     return hash_index_;
 
 } // acmacs::seqdb::v3::Seqdb::hash_index
 
 // ----------------------------------------------------------------------
 
-inline std::optional<acmacs::seqdb::v3::ref> match(const acmacs::seqdb::v3::subset& sequences, const acmacs::virus::Reassortant& ag_reassortant, const acmacs::virus::Passage& ag_passage)
+void acmacs::seqdb::v3::hash_index_t::build(std::vector<std::pair<hash_value_t, ref>>&& source)
+{
+    // source is in seqdb order, keep that order for refs with the same hash
+    std::stable_sort(std::begin(source), std::end(source), [](const auto& e1, const auto& e2) { return e1.first < e2.first; });
+
+    refs_.clear();
+    refs_.reserve(source.size());
+    std::vector<slot_t> groups;
+    for (const auto& [hash, rf] : source) {
+        if (groups.empty() || groups.back().hash != hash)
+            groups.push_back(slot_t{hash, static_cast<uint32_t>(refs_.size()), static_cast<uint32_t>(refs_.size())});
+        refs_.push_back(rf);
+        ++groups.back().last;
+    }
+
+    size_t number_of_slots{16};
+    while (number_of_slots < groups.size() * 2)
+        number_of_slots *= 2;
+    slots_.assign(number_of_slots, slot_t{});
+    const size_t mask = number_of_slots - 1;
+    for (const auto& group : groups) {
+        size_t slot_no = group.hash & mask;
+        while (slots_[slot_no].first != slots_[slot_no].last)
+            slot_no = (slot_no + 1) & mask;
+        slots_[slot_no] = group;
+    }
+
+} // acmacs::seqdb::v3::hash_index_t::build
+
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::v3::hash_value_t acmacs::seqdb::v3::hash_value(std::string_view hash)
+{
+    hash_value_t value{0};
+    if (const auto [end, ec] = std::from_chars(hash.data(), hash.data() + hash.size(), value, 16); ec == std::errc{} && end == hash.data() + hash.size())
+        return value;
+    else // not a hex xxhash32 (unexpected), fold it anyway
+        return static_cast<hash_value_t>(std::hash<std::string_view>{}(hash));
+
+} // acmacs::seqdb::v3::hash_value
+
+// ----------------------------------------------------------------------
+
+const acmacs::seqdb::v3::name_without_subtype_index_t& acmacs::seqdb::v3::Seqdb::name_without_subtype_index() const
+{
+    std::call_once(name_without_subtype_index_built_, [this]() {
+        name_without_subtype_index_.reserve(entries_.size());
+        for (const auto& entry : entries_)
+            name_without_subtype_index_[local::name_without_subtype(entry.name)].push_back(&entry);
+    });
+    return name_without_subtype_index_;
+
+} // acmacs::seqdb::v3::Seqdb::name_without_subtype_index
+
+// ----------------------------------------------------------------------
+
+const acmacs::seqdb::v3::accession_number_index_t& acmacs::seqdb::v3::Seqdb::accession_number_index() const
+{
+    std::call_once(accession_number_index_built_, [this]() {
+        for (const auto& entry : entries_) {
+            for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no) {
+                for (const auto& isolate_id : entry.seqs[seq_no].gisaid.isolate_ids)
+                    accession_number_index_.emplace(isolate_id, ref{&entry, seq_no});
+                for (const auto& sample_id : entry.seqs[seq_no].gisaid.sample_ids_by_sample_provider)
+                    accession_number_index_.emplace(sample_id, ref{&entry, seq_no});
+            }
+        }
+    });
+    return accession_number_index_;
+
+} // acmacs::seqdb::v3::Seqdb::accession_number_index
+
+// ----------------------------------------------------------------------
+
+void acmacs::seqdb::v3::Seqdb::build_indexes() const
+{
+#pragma omp parallel sections default(shared)
+    {
+#pragma omp section
+        seq_id_index();
+#pragma omp section
+        hi_name_index();
+#pragma omp section
+        lab_id_index();
+#pragma omp section
+        hash_index();
+#pragma omp section
+        name_without_subtype_index();
+#pragma omp section
+        accession_number_index();
+    }
+
+} // acmacs::seqdb::v3::Seqdb::build_indexes
+
+// ----------------------------------------------------------------------
+
+namespace local
+{
+    // hi_name_matching messages and warnings of one antigen/serum matched in the parallel section, reported in antigen/serum order after it
+    class match_log_t
+    {
+      public:
+        template <typename... Args> void add(fmt::format_string<Args...> format, Args&&... args)
+        {
+            if (acmacs::log::is_enabled(acmacs::log::hi_name_matching))
+                lines_.push_back(line_t{false, indent_, fmt::format(format, std::forward<Args>(args)...)});
+        }
+
+        template <typename... Args> void warning(fmt::format_string<Args...> format, Args&&... args) { lines_.push_back(line_t{true, 0, fmt::format(format, std::forward<Args>(args)...)}); }
+
+        void warnings(const std::vector<std::string>& texts) // e.g. taken from match_cache_t
+        {
+            for (const auto& text : texts)
+                lines_.push_back(line_t{true, 0, text});
+        }
+
+        std::vector<std::string> warnings() const
+        {
+            std::vector<std::string> result;
+            for (const auto& line : lines_) {
+                if (line.warning)
+                    result.push_back(line.text);
+            }
+            return result;
+        }
+
+        // warnings are appended to target, if it is not nullptr
+        void report(std::vector<std::string>* target) const
+        {
+            for (const auto& line : lines_) {
+                if (line.warning && target)
+                    target->push_back(line.text);
+                else if (line.warning)
+                    AD_WARNING("{}", line.text);
+                else
+                    AD_LOG(acmacs::log::hi_name_matching, "{:{}s}{}", "", line.indent * 4, line.text);
+            }
+        }
+
+        struct indent_t
+        {
+            indent_t(match_log_t& log) : log_{log} { ++log_.indent_; }
+            ~indent_t() { --log_.indent_; }
+            match_log_t& log_;
+        };
+
+      private:
+        struct line_t
+        {
+            bool warning;
+            size_t indent;
+            std::string text;
+        };
+
+        std::vector<line_t> lines_;
+        size_t indent_{0};
+    };
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+inline std::optional<acmacs::seqdb::v3::ref> match(const acmacs::seqdb::v3::subset& sequences, const acmacs::virus::Reassortant& ag_reassortant, const acmacs::virus::Passage& ag_passage, local::match_log_t& log)
 {
     if (sequences.empty())
         return std::nullopt;
@@ -403,8 +786,8 @@ inline std::optional<acmacs::seqdb::v3::ref> match(const acmacs::seqdb::v3::subs
     for (size_t seq_no{0}; seq_no < sequences.size(); ++seq_no) {
         const auto& seq = sequences[seq_no].seq();
 
-        AD_LOG(acmacs::log::hi_name_matching, "{} R:{} P:{}", sequences[seq_no].seq_id(), seq.reassortants, seq.passages);
-        AD_LOG_INDENT;
+        log.add("{} R:{} P:{}", sequences[seq_no].seq_id(), seq.reassortants, seq.passages);
+        const local::match_log_t::indent_t indent{log};
         if ((seq.reassortants.empty() && ag_reassortant.empty()) ||
             std::any_of(std::begin(seq.reassortants), std::end(seq.reassortants), [&ag_reassortant](std::string_view reass) { return ag_reassortant == reass; })) {
             if (!seq.passages.empty()) {
@@ -412,23 +795,23 @@ inline std::optional<acmacs::seqdb::v3::ref> match(const acmacs::seqdb::v3::subs
                     if (acmacs::virus::passages_match(ag_passage, acmacs::virus::Passage{s_passage})) {
                         const auto score = string_match::match(s_passage, *ag_passage);
                         score_per_seq[seq_no] = std::max(score_per_seq[seq_no], score);
-                        AD_LOG(acmacs::log::hi_name_matching, "score: {} P:{}", score, s_passage);
+                        log.add("score: {} P:{}", score, s_passage);
                     }
                     else {
                         const string_match::score_t score = 1;
                         score_per_seq[seq_no] = std::max(score_per_seq[seq_no],
                                                          score); // allow using sequence with wrong passage in case nothing else available, e.g. match cell vs. egg, to maximize coloring by clade
-                        AD_LOG(acmacs::log::hi_name_matching, "score: {} passage mismatch ag:\"{}\" seq:\"{}\"", score, ag_passage, s_passage);
+                        log.add("score: {} passage mismatch ag:\"{}\" seq:\"{}\"", score, ag_passage, s_passage);
                     }
                 }
             }
             else {
                 score_per_seq[seq_no] = ag_passage.empty() ? 2 : 1;
-                AD_LOG(acmacs::log::hi_name_matching, "score: {} seq has no passage", score_per_seq[seq_no]);
+                log.add("score: {} seq has no passage", score_per_seq[seq_no]);
             }
         }
         else
-            AD_LOG(acmacs::log::hi_name_matching, "reassortant mismatch");
+            log.add("reassortant mismatch");
     }
     if (const auto best_seq = std::max_element(std::begin(score_per_seq), std::end(score_per_seq)); *best_seq >= 0)
         return sequences[static_cast<size_t>(best_seq - std::begin(score_per_seq))];
@@ -438,39 +821,53 @@ inline std::optional<acmacs::seqdb::v3::ref> match(const acmacs::seqdb::v3::subs
 
 // ----------------------------------------------------------------------
 
-template <typename AgSr> acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const AgSr& antigens_sera, std::string_view /*aChartVirusType*/) const
+template <typename AgSr> acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const AgSr& antigens_sera, std::string_view /*aChartVirusType*/, match_cache_t* cache, std::vector<std::string>* warnings) const
 {
     // check lineage?
     // check virus type
 
-    subset result;
+    // Antigens/sera are matched in batch:
+    //  - keys (name_full, name with reassortant/passage/annotations, lab ids, cache key) are computed for all antigens/sera in one parallel pass
+    //  - keys are resolved against the indexes in another parallel pass, indexes are built before it, lookups are read-only
+    //  - log messages and warnings are collected per antigen/serum and reported in antigen/serum order after resolving
 
-    auto find_by_hi_name = [this](const auto& antigen) -> std::optional<ref> {
+    constexpr bool for_antigens = std::is_same_v<AgSr, chart::Antigens> || std::is_same_v<AgSr, chart::AntigensModify>;
+    constexpr const char* ag_sr_prefix = for_antigens ? "AG" : "SR";
+
+    struct match_key_t
+    {
+        std::string name_full;
+        std::string name_reassortant_passage_annotations;
+        chart::LabIds lab_ids; // antigens only, result depends on lab ids for antigens only
+        std::string cache_key;
+    };
+
+    auto find_by_hi_name = [this](const match_key_t& key) -> std::optional<ref> {
         const auto& hi_name_ind = hi_name_index();
-        if (const auto* found_ref1 = hi_name_ind.find(antigen.format("{name_full}")); found_ref1)
+        if (const auto* found_ref1 = hi_name_ind.find(key.name_full); found_ref1)
             return *found_ref1;
-        else if (const auto* found_ref2 = hi_name_ind.find(antigen.format("{name}{ }{reassortant}{ }{passage}{ }{annotations}")); found_ref2)
+        else if (const auto* found_ref2 = hi_name_ind.find(key.name_reassortant_passage_annotations); found_ref2)
             return *found_ref2;
         else
             return std::nullopt;
     };
 
-    auto find_by_parsed_name = [&](const auto& antigen) -> std::optional<ref> {
+    auto find_by_parsed_name = [&](const auto& antigen, const match_key_t& key, local::match_log_t& log) -> std::optional<ref> {
         if (const auto name_fields = acmacs::virus::name::parse(antigen.name()); name_fields.mutations.empty()) {
             const acmacs::virus::Reassortant ag_reassortant{antigen.reassortant().empty() ? name_fields.reassortant : antigen.reassortant()};
             const acmacs::virus::Passage ag_passage{antigen.passage().empty() ? name_fields.passage : antigen.passage()};
             const auto sequences{select_by_name(name_fields.name())};
-            AD_LOG(acmacs::log::hi_name_matching, "match find_by_parsed_name \"{}\" ({}) \"{}\" sequences:{}", antigen.name(), name_fields.name(), antigen.format("{name_full}"), sequences.size());
-            AD_LOG_INDENT;
-            if (const auto matched = ::match(sequences, ag_reassortant, ag_passage); matched.has_value()) {
-                AD_LOG(acmacs::log::hi_name_matching, "--> {}", matched->seq_id());
+            log.add("match find_by_parsed_name \"{}\" ({}) \"{}\" sequences:{}", antigen.name(), name_fields.name(), key.name_full, sequences.size());
+            const local::match_log_t::indent_t indent{log};
+            if (const auto matched = ::match(sequences, ag_reassortant, ag_passage, log); matched.has_value()) {
+                log.add("--> {}", matched->seq_id());
                 return *matched;
             }
         }
         return std::nullopt;
     };
 
-    auto find_by_lab_id = [&](const auto& lab_id, const auto& antigen) -> std::optional<ref> {
+    auto find_by_lab_id = [&](const auto& lab_id, const auto& antigen, const match_key_t& key, local::match_log_t& log) -> std::optional<ref> {
         if (const auto [first, last] = lab_id_index().find(lab_id); first != last) {
             if (std::distance(first, last) == 1)
                 return first->second;
@@ -480,39 +877,79 @@ template <typename AgSr> acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::mat
                 // AD_DEBUG("{} {} -> {}", antigen.name_full(), r1->first, r1->second.seq_id());
                 sequences.append(r1->second);
             }
-            if (const auto matched = ::match(sequences, antigen.reassortant(), antigen.passage()); matched.has_value()) {
+            if (const auto matched = ::match(sequences, antigen.reassortant(), antigen.passage(), log); matched.has_value()) {
                 // AD_DEBUG("--> {}", matched->seq_id());
                 return *matched;
             }
-            AD_WARNING("multiple refs for {} {} (first is selected): ({}) {}", antigen.name_full(), lab_id, sequences.size(), sequences);
+            log.warning("multiple refs for {} {} (first is selected): ({}) {}", key.name_full, lab_id, sequences.size(), sequences);
             return first->second;
         }
         else
             return std::nullopt;
     };
 
-    size_t num_matched = 0;
-    for (auto antigen : antigens_sera) {
-        std::optional<ref> found_ref{std::nullopt};
-        if constexpr (std::is_same_v<AgSr, chart::Antigens> || std::is_same_v<AgSr, chart::AntigensModify>) {
-            for (const auto& lab_id : antigen->lab_ids()) {
-                found_ref = find_by_lab_id(lab_id, *antigen);
-                if (found_ref.has_value())
-                    break;
+    std::vector<std::decay_t<decltype(*std::begin(antigens_sera))>> antigens;
+    for (auto antigen : antigens_sera)
+        antigens.push_back(antigen);
+
+    // build indexes outside of parallel section
+    acmacs::locationdb::get(); // used by acmacs::virus::name::parse, load locbd outside of threading code, it is not thread safe
+    hi_name_index();
+    if constexpr (for_antigens)
+        lab_id_index();
+
+    std::vector<match_key_t> keys(antigens.size());
+#pragma omp parallel for default(shared) schedule(dynamic, 16)
+    for (size_t ag_no = 0; ag_no < antigens.size(); ++ag_no) {
+        const auto& antigen = *antigens[ag_no];
+        auto& key = keys[ag_no];
+        key.name_full = antigen.format("{name_full}");
+        key.name_reassortant_passage_annotations = antigen.format("{name}{ }{reassortant}{ }{passage}{ }{annotations}");
+        if constexpr (for_antigens)
+            key.lab_ids = antigen.lab_ids();
+        if (cache) {
+            key.cache_key = fmt::format("{}\x01{}\x01{}", ag_sr_prefix, key.name_full, key.name_reassortant_passage_annotations);
+            for (const auto& lab_id : key.lab_ids)
+                fmt::format_to(std::back_inserter(key.cache_key), "\x01{}", lab_id);
+        }
+    }
+
+    subset result;
+    result.refs_.resize(antigens.size());
+    std::vector<local::match_log_t> logs(antigens.size());
+#pragma omp parallel for default(shared) schedule(dynamic, 16)
+    for (size_t ag_no = 0; ag_no < antigens.size(); ++ag_no) {
+        const auto& antigen = *antigens[ag_no];
+        auto& key = keys[ag_no];
+        if (cache) {
+            if (auto cached = cache->find(key.cache_key); cached.has_value()) {
+                result.refs_[ag_no] = std::move(cached->found);
+                logs[ag_no].warnings(cached->warnings);
+                continue;
             }
         }
+
+        std::optional<ref> found_ref{std::nullopt};
+        for (const auto& lab_id : key.lab_ids) {
+            found_ref = find_by_lab_id(lab_id, antigen, key, logs[ag_no]);
+            if (found_ref.has_value())
+                break;
+        }
         if (!found_ref.has_value())
-            found_ref = find_by_hi_name(*antigen);
+            found_ref = find_by_hi_name(key);
         if (!found_ref.has_value())
-            found_ref = find_by_parsed_name(*antigen);
-        if (found_ref.has_value()) {
-            result.refs_.push_back(std::move(*found_ref));
-            ++num_matched;
-        }
-        else
-            result.refs_.emplace_back();
+            found_ref = find_by_parsed_name(antigen, key, logs[ag_no]);
+        if (found_ref.has_value())
+            result.refs_[ag_no] = std::move(*found_ref);
+        if (cache)
+            cache->add(std::move(key.cache_key), result.refs_[ag_no], logs[ag_no].warnings());
     }
-    if constexpr (std::is_same_v<AgSr, acmacs::chart::Antigens> || std::is_same_v<AgSr, acmacs::chart::AntigensModify>)
+
+    for (const auto& log : logs)
+        log.report(warnings);
+
+    const auto num_matched = static_cast<size_t>(std::count_if(std::begin(result.refs_), std::end(result.refs_), [](const auto& rf) { return !rf.empty(); }));
+    if constexpr (for_antigens)
         AD_LOG(acmacs::log::hi_name_matching, "antigens from chart have sequences in seqdb: {}", num_matched);
     else
         AD_LOG(acmacs::log::hi_name_matching, "sera from chart have sequences in seqdb: {}", num_matched);
@@ -521,10 +958,10 @@ template <typename AgSr> acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::mat
 
 } // acmacs::seqdb::v3::Seqdb::match
 
-template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::Antigens&, std::string_view) const;
-template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::AntigensModify&, std::string_view) const;
-template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::Sera&, std::string_view) const;
-template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::SeraModify&, std::string_view) const;
+template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::Antigens&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
+template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::AntigensModify&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
+template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::Sera&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
+template acmacs::seqdb::v3::subset acmacs::seqdb::v3::Seqdb::match(const acmacs::chart::SeraModify&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
 
 // ----------------------------------------------------------------------
 
@@ -573,16 +1010,25 @@ void acmacs::seqdb::v3::populate(acmacs::chart::ChartModify& chart, even_if_alre
 
 // ----------------------------------------------------------------------
 
-std::pair<acmacs::chart::Indexes, acmacs::chart::Indexes> acmacs::seqdb::v3::Seqdb::populate(acmacs::chart::ChartModify& chart) const
+void acmacs::seqdb::v3::update_clades(std::string_view clades_json_filename)
+{
+    Seqdb::instance().update_clades(clades_json_filename.empty() ? std::make_shared<const CladeDefinitions>() : std::make_shared<const CladeDefinitions>(clades_json_filename));
+
+} // acmacs::seqdb::v3::update_clades
+
+// ----------------------------------------------------------------------
+
+std::pair<acmacs::chart::Indexes, acmacs::chart::Indexes> acmacs::seqdb::v3::Seqdb::populate(acmacs::chart::ChartModify& chart, match_cache_t* cache, std::vector<std::string>* warnings) const
 {
-    const auto populate_ag_sr = [this, &chart]<typename AgSr>(AgSr& antigens_sera) -> acmacs::chart::Indexes {
+    const auto populate_ag_sr = [this, &chart, cache, warnings]<typename AgSr>(AgSr& antigens_sera) -> acmacs::chart::Indexes {
         acmacs::chart::Indexes matched;
-        acmacs::enumerate(match(antigens_sera, chart.info()->virus_type(acmacs::chart::Info::Compute::Yes)), [&](auto no, const auto& ref) {
+        acmacs::enumerate(match(antigens_sera, chart.info()->virus_type(acmacs::chart::Info::Compute::Yes), cache, warnings), [&](auto no, const auto& ref) {
             if (ref) {
                 const auto& seq = ref.seq().with_sequence(*this);
                 auto& antigen_serum = antigens_sera.at(no);
-                antigen_serum.sequence_aa(seq.aa_aligned_master());
-                antigen_serum.sequence_nuc(seq.nuc_aligned_master());
+                const auto aa = seq.aa_aligned_master(), nuc = seq.nuc_aligned_master();
+                antigen_serum.sequence_aa(sequence_aligned_ref_t{*aa});
+                antigen_serum.sequence_nuc(sequence_aligned_ref_t{*nuc});
                 if (!seq.clades.empty()) {
                     for (const auto& clade : seq.clades)
                         antigen_serum.add_clade(std::string{clade});
@@ -594,8 +1040,12 @@ std::pair<acmacs::chart::Indexes, acmacs::chart::Indexes> acmacs::seqdb::v3::Seq
                     if (const auto ag_lineage = antigen_serum.lineage(); ag_lineage == acmacs::chart::BLineage::Unknown)
                         antigen_serum.lineage(lineage);
                     else if (ag_lineage != lineage) {
-                        AD_WARNING("{} lineage difference, seqdb: {}, antigen_serum lineage in chart updated",
-                                   acmacs::chart::format_antigen_serum<AgSr>("{ag_sr} {no0:{num_digits}d} {full_name} {lineage}", chart, no, acmacs::chart::collapse_spaces_t::yes), lineage);
+                        auto warning = fmt::format("{} lineage difference, seqdb: {}, antigen_serum lineage in chart updated",
+                                                   acmacs::chart::format_antigen_serum<AgSr>("{ag_sr} {no0:{num_digits}d} {full_name} {lineage}", chart, no, acmacs::chart::collapse_spaces_t::yes), lineage);
+                        if (warnings)
+                            warnings->push_back(std::move(warning));
+                        else
+                            AD_WARNING("{}", warning);
                         antigen_serum.lineage(lineage);
                     }
                 }
@@ -618,34 +1068,26 @@ std::pair<acmacs::chart::Indexes, acmacs::chart::Indexes> acmacs::seqdb::v3::Seq
 
 std::string acmacs::seqdb::v3::Seqdb::sequences_of_chart_for_ace_view_1(const acmacs::chart::Chart& chart) const
 {
-    struct stat_per_pos_t
-    {
-        ssize_t shannon_index = 0; // https://en.wikipedia.org/wiki/Diversity_index
-        std::map<char, size_t> aa_count;
-    };
-
     constexpr size_t max_num_pos = 1000;
-    std::vector<stat_per_pos_t> stat_per_pos(max_num_pos);
+    column_profile_t profile;
     to_json::object json_antigens;
     acmacs::enumerate(match(*chart.antigens(), chart.info()->virus_type()), [&](auto ag_no, const auto& ref) {
         if (ref) {
             const auto sequence = ref.aa_aligned(*this);
             json_antigens << to_json::key_val{std::to_string(ag_no), *sequence};
-            acmacs::enumerate(*sequence, [&stat_per_pos](size_t pos, char aa) {++stat_per_pos[pos].aa_count[aa]; }, 1UL);
+            profile.add(*sequence);
         }
     });
-    for (auto& per_pos : stat_per_pos) {
-        const auto sum = std::accumulate(per_pos.aa_count.begin(), per_pos.aa_count.end(), 0UL, [](auto accum, const auto& entry) { return accum + entry.second; });
-        const auto shannon_index = -std::accumulate(per_pos.aa_count.begin(), per_pos.aa_count.end(), 0.0, [sum = double(sum)](auto accum, const auto& entry) {
-            const double p = static_cast<double>(entry.second) / sum;
-            return accum + p * std::log(p);
-        });
-        per_pos.shannon_index = std::lround(shannon_index * 100);
-    }
+    // per_pos keys are pos1, "0" is always empty
     to_json::object json_per_pos;
-    for (auto [pos, entry] : acmacs::enumerate(stat_per_pos)) {
-        // if (entry.size() > 1) // && (entry.find('X') == entry.end() || entry.size() > 2))
-        json_per_pos << to_json::key_val{std::to_string(pos), to_json::object{to_json::key_val{"shannon", entry.shannon_index}, to_json::key_val{"aa_count", to_json::object::from(entry.aa_count)}}};
+    for (size_t pos1{0}; pos1 < std::max(max_num_pos, *profile.size() + 1); ++pos1) {
+        const auto summary = pos1 > 0 ? profile.summary(pos0_t{pos1 - 1}) : column_profile_t::summary_t{};
+        to_json::object aa_count;
+        if (pos1 > 0) {
+            for (const auto& [aa, count] : profile.frequencies(pos0_t{pos1 - 1}, column_profile_t::sorted::no))
+                aa_count << to_json::key_val{std::string(1, aa), count};
+        }
+        json_per_pos << to_json::key_val{std::to_string(pos1), to_json::object{to_json::key_val{"shannon", std::lround(summary.entropy * 100)}, to_json::key_val{"aa_count", aa_count}}};
     }
     return to_json::object{to_json::key_val{"sequences", to_json::object{to_json::key_val{"antigens", json_antigens}, to_json::key_val{"per_pos", json_per_pos}}}}.compact();
 
@@ -705,8 +1147,23 @@ std::string_view acmacs::seqdb::v3::SeqdbEntry::date() const
 void acmacs::seqdb::v3::Seqdb::find_slaves() const
 {
     if (!slaves_found_) {
-        for (const auto& slave : select_slaves())
-            slave.seq().find_master(*this).add_slave(slave);
+        // slaves of the same master are placed next to each other (in seqdb order), each master gets a span of its slaves
+        std::vector<std::pair<const SeqdbSeq*, ref>> master_slave;
+        for (const auto& entry : entries_) {
+            for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no) {
+                if (const auto& seq = entry.seqs[seq_no]; !seq.is_master())
+                    master_slave.emplace_back(&seq.find_master(*this), ref{&entry, seq_no});
+            }
+        }
+        std::stable_sort(std::begin(master_slave), std::end(master_slave), [](const auto& e1, const auto& e2) { return std::less<const SeqdbSeq*>{}(e1.first, e2.first); });
+
+        slaves_of_masters_.resize(master_slave.size());
+        std::transform(std::begin(master_slave), std::end(master_slave), std::begin(slaves_of_masters_), [](const auto& en) { return en.second; });
+        for (size_t first = 0, last = 0; first < master_slave.size(); first = last) {
+            for (last = first + 1; last < master_slave.size() && master_slave[last].first == master_slave[first].first; ++last)
+                ;
+            master_slave[first].first->slaves_ = std::span<const ref>{slaves_of_masters_.data() + first, last - first};
+        }
         slaves_found_ = true;
     }
 
@@ -714,14 +1171,69 @@ void acmacs::seqdb::v3::Seqdb::find_slaves() const
 
 // ----------------------------------------------------------------------
 
+void acmacs::seqdb::v3::Seqdb::update_clades(std::shared_ptr<const CladeDefinitions> clade_definitions)
+{
+    // clades of each master are computed in parallel, then flattened into the new arena,
+    // there are just a few distinct clade lists, masters having the same list share it in the arena
+    std::vector<std::vector<CladeDefinitions::clade_names_t>> clades_of_entries(entries_.size());
+#pragma omp parallel for default(shared) schedule(static, 256)
+    for (size_t entry_no = 0; entry_no < entries_.size(); ++entry_no) {
+        const auto& entry = entries_[entry_no];
+        const auto virus_type = CladeDefinitions::virus_type_key(entry.virus_type, entry.lineage);
+        auto& clades_of_seqs = clades_of_entries[entry_no];
+        clades_of_seqs.resize(entry.seqs.size());
+        for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no) {
+            if (const auto& seq = entry.seqs[seq_no]; seq.is_master()) // symbols at clade positions are taken from the packed sequences without decoding
+                clades_of_seqs[seq_no] = clade_definitions->clades(
+                    virus_type, [&seq](pos0_t pos0) { return at_pos(seq.amino_acids.aligned, pos0); }, [&seq](pos0_t pos0) { return at_pos(seq.nucs.aligned, pos0); });
+        }
+    }
+
+    std::map<CladeDefinitions::clade_names_t, std::pair<size_t, size_t>> unique_clades; // clades -> offset and size in arena
+    std::vector<std::string_view> clades_arena;
+    std::vector<dictionary_code_t> clade_codes_arena;
+    for (const auto& clades_of_seqs : clades_of_entries) {
+        for (const auto& clades : clades_of_seqs) {
+            if (!clades.empty() && unique_clades.emplace(clades, std::pair{clades_arena.size(), clades.size()}).second) {
+                std::copy(std::begin(clades), std::end(clades), std::back_inserter(clades_arena));
+                std::transform(std::begin(clades), std::end(clades), std::back_inserter(clade_codes_arena), [this](std::string_view clade) { return dictionaries_.clades.intern(clade); });
+            }
+        }
+    }
+
+    for (size_t entry_no = 0; entry_no < entries_.size(); ++entry_no) {
+        auto& entry = entries_[entry_no];
+        for (size_t seq_no = 0; seq_no < entry.seqs.size(); ++seq_no) {
+            if (auto& seq = entry.seqs[seq_no]; seq.is_master()) {
+                if (const auto& clades = clades_of_entries[entry_no][seq_no]; !clades.empty()) {
+                    const auto [offset, size] = unique_clades.find(clades)->second;
+                    seq.clades = SeqdbSeq::strings_t{clades_arena.data() + offset, size};
+                    seq.clade_codes = SeqdbSeq::codes_t{clade_codes_arena.data() + offset, size};
+                }
+                else {
+                    seq.clades = SeqdbSeq::strings_t{};
+                    seq.clade_codes = SeqdbSeq::codes_t{};
+                }
+            }
+        }
+    }
+
+    clades_arena_ = std::move(clades_arena);           // previous clades arena (if any) is not referenced by seqs anymore
+    clade_codes_arena_ = std::move(clade_codes_arena);
+    clade_definitions_ = std::move(clade_definitions); // previous definitions (if any) are not referenced by seqs anymore
+
+} // acmacs::seqdb::v3::Seqdb::update_clades
+
+// ----------------------------------------------------------------------
+
 const acmacs::seqdb::v3::SeqdbSeq& acmacs::seqdb::v3::SeqdbSeq::find_master(const Seqdb& seqdb) const
 {
     if (master.name.empty())
         throw std::runtime_error{fmt::format("internal in SeqdbSeq::find_master: not a slave (name empty): {} {}", master.name, master.hash)}; // master.annotations, master.reassortant, master.passage)};
 
-    for (const auto& ref : seqdb.select_by_name_hash(master.name, master.hash)) {
-        if (ref)
-            return ref.seq();
+    for (auto [found_first, found_last] = seqdb.hash_index().find(master.hash_value); found_first != found_last; ++found_first) {
+        if (found_first->entry->name == master.name)
+            return found_first->seq();
     }
 
     // for (const auto& ref : seqdb.select_by_name(master.name)) {
@@ -737,26 +1249,6 @@ const acmacs::seqdb::v3::SeqdbSeq& acmacs::seqdb::v3::SeqdbSeq::find_master(cons
 
 // ----------------------------------------------------------------------
 
-void acmacs::seqdb::v3::SeqdbSeq::add_slave(const ref& slave) const
-{
-    if (!slaves_)
-        slaves_ = std::make_unique<std::vector<ref>>();
-    slaves_->push_back(slave);
-
-} // acmacs::seqdb::v3::SeqdbSeq::add_slave
-
-// ----------------------------------------------------------------------
-
-const std::vector<acmacs::seqdb::v3::ref>& acmacs::seqdb::v3::SeqdbSeq::slaves() const
-{
-    if (!slaves_)
-        slaves_ = std::make_unique<std::vector<ref>>();
-    return *slaves_;
-
-} // acmacs::seqdb::v3::SeqdbSeq::slaves
-
-// ----------------------------------------------------------------------
-
 // returns designations with and without hash
 std::vector<std::string> acmacs::seqdb::v3::SeqdbSeq::designations(bool just_first) const
 {
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <map>
+#include <deque>
+#include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
+#include <optional>
 
 #include "acmacs-base/log.hh"
 #include "acmacs-base/string-join.hh"
@@ -11,6 +15,8 @@
 #include "seqdb-3/aa-at-pos.hh"
 #include "seqdb-3/seq-id.hh"
 #include "seqdb-3/sequence-issues.hh"
+#include "seqdb-3/arena.hh"
+#include "seqdb-3/dictionary.hh"
 
 // ----------------------------------------------------------------------
 
@@ -20,15 +26,25 @@ namespace acmacs::seqdb::inline v3
     struct SeqdbSeq;
     struct SeqdbEntry;
     class subset;
+    class name_format_t;
+    class aggregate_table_t;
+    class CladeDefinitions;
 
     enum class even_if_already_popuplated { no, yes };
+    enum class build_indexes_on_load { no, yes };
+
+    // xxhash32 of the sequence, stored in seqdb as 8 hex digits ("H" key), parsed into an integer on load
+    using hash_value_t = uint32_t;
+    hash_value_t hash_value(std::string_view hash);
 
     struct master_ref_t
     {
         std::string_view name;
         std::string_view hash;
+        hash_value_t hash_value{0}; // parsed hash
+        std::string_view shard;     // seqdb-4 only: shard of the master if it differs from the shard of the slave
 
-        constexpr bool operator==(const master_ref_t& rhs) const { return name == rhs.name && hash == rhs.hash; }
+        constexpr bool operator==(const master_ref_t& rhs) const { return hash_value == rhs.hash_value && name == rhs.name; }
         constexpr bool operator!=(const master_ref_t& rhs) const { return !operator==(rhs); }
         // std::string_view annotations;
         // std::string_view reassortant;
@@ -36,17 +52,17 @@ namespace acmacs::seqdb::inline v3
         // constexpr bool operator==(const master_ref_t& rhs) const { return name == rhs.name && annotations == rhs.annotations && reassortant == rhs.reassortant && passage == rhs.passage; }
     };
 
+    // 16 bytes, refs are copied by every subset filter
+    // group_no and hamming_distance are kept by subset in a side column (subset::group_no_of, subset::hamming_distance_of)
     struct ref
     {
         const SeqdbEntry* entry;
-        size_t seq_index;
-        size_t group_no{0};             // for group_by_hamming_distance
-        size_t hamming_distance{0};     // for group_by_hamming_distance and nuc_hamming_distance_to_base, printed using {hamming_distance}
+        uint32_t seq_index;
         bool marked_for_removal{false}; // py-seqdb remove_nuc_duplicates_by_aligned_truncated
 
-        ref() : entry{nullptr}, seq_index{static_cast<size_t>(-1)} {}
-        ref(const SeqdbEntry* a_entry, size_t a_index) : entry{a_entry}, seq_index{a_index} {}
-        ref(const SeqdbEntry& a_entry, size_t a_index) : entry{&a_entry}, seq_index{a_index} {}
+        ref() : entry{nullptr}, seq_index{static_cast<uint32_t>(-1)} {}
+        ref(const SeqdbEntry* a_entry, size_t a_index) : entry{a_entry}, seq_index{static_cast<uint32_t>(a_index)} {}
+        ref(const SeqdbEntry& a_entry, size_t a_index) : entry{&a_entry}, seq_index{static_cast<uint32_t>(a_index)} {}
 
         constexpr bool operator==(const ref& rhs) const { return entry == rhs.entry && seq_index == rhs.seq_index; }
         constexpr bool operator!=(const ref& rhs) const { return !operator==(rhs); }
@@ -63,14 +79,16 @@ namespace acmacs::seqdb::inline v3
         std::string hi_name_or_full_name() const;
         bool has_issues(const Seqdb& seqdb) const;
         bool has_lab(std::string_view lab) const;
+        bool has_lab(dictionary_code_t lab) const;
         bool has_clade(const Seqdb& seqdb, std::string_view clade) const;
+        bool has_clade(const Seqdb& seqdb, dictionary_code_t clade) const;
         bool has_hi_names() const;
         bool matches(const amino_acid_at_pos1_eq_list_t& aa_at_pos1) const;
         bool matches(const amino_acid_at_pos1_list_t& aa_at_pos1) const;
         bool matches(const master_ref_t& master) const;
 
-        sequence_aligned_ref_t aa_aligned(const Seqdb& seqdb, size_t length = std::string_view::npos) const;
-        sequence_aligned_ref_t nuc_aligned(const Seqdb& seqdb, size_t length = std::string_view::npos) const;
+        sequence_aligned_t aa_aligned(const Seqdb& seqdb, size_t length = std::string_view::npos) const; // decoded
+        sequence_aligned_t nuc_aligned(const Seqdb& seqdb, size_t length = std::string_view::npos) const; // decoded
         size_t aa_aligned_length(const Seqdb& seqdb) const;
         size_t nuc_aligned_length(const Seqdb& seqdb) const;
         char aa_at_pos(const Seqdb& seqdb, pos0_t pos0) const;
@@ -80,7 +98,63 @@ namespace acmacs::seqdb::inline v3
     using seq_id_index_t = map_with_duplicating_keys_t<seq_id_t, ref>; // duplicating seq_ids without hash present (for backward compatibility)
     using hi_name_index_t = map_with_unique_keys_t<std::string_view, ref>;
     using lab_id_index_t = map_with_duplicating_keys_t<std::string, ref>;
-    using hash_index_t = map_with_duplicating_keys_t<std::string_view, ref>;
+
+    // hash value -> refs to seqs having that hash in seqdb order
+    // flat open addressing table with linear probing and load factor <= 0.5, lookup usually touches just one slot
+    class hash_index_t
+    {
+      public:
+        using const_iterator = std::vector<ref>::const_iterator;
+
+        void build(std::vector<std::pair<hash_value_t, ref>>&& source);
+        std::pair<const_iterator, const_iterator> find(hash_value_t hash) const;
+        bool empty() const { return refs_.empty(); }
+        size_t size() const { return refs_.size(); }
+
+      private:
+        struct slot_t
+        {
+            hash_value_t hash{0};
+            uint32_t first{0}, last{0}; // range in refs_, first == last: free slot
+        };
+
+        std::vector<slot_t> slots_; // size is a power of 2
+        std::vector<ref> refs_;
+    };
+
+    using accession_number_index_t = std::unordered_multimap<std::string_view, ref>; // gisaid isolate ids (EPI_ISL_) and ncbi accession numbers
+    using name_without_subtype_index_t = std::unordered_map<std::string_view, std::vector<const SeqdbEntry*>>; // name without "A(H3N2)/" prefix -> entries in seqdb order
+
+    // thread safe cache of Seqdb::match results shared between charts (e.g. seqdb3-chart-populate --threads)
+    // warnings issued when matching are kept with the result and issued again when the result is taken from the cache
+    class match_cache_t
+    {
+      public:
+        struct entry_t
+        {
+            ref found; // empty if antigen/serum was not matched
+            std::vector<std::string> warnings;
+        };
+
+        // returns nullopt if key not found
+        std::optional<entry_t> find(const std::string& key) const
+        {
+            std::shared_lock<std::shared_mutex> lock{access_};
+            if (const auto found = data_.find(key); found != data_.end())
+                return found->second;
+            return std::nullopt;
+        }
+
+        void add(std::string&& key, const ref& found, std::vector<std::string>&& warnings)
+        {
+            std::unique_lock<std::shared_mutex> lock{access_};
+            data_.emplace(std::move(key), entry_t{found, std::move(warnings)});
+        }
+
+      private:
+        mutable std::shared_mutex access_;
+        std::unordered_map<std::string, entry_t> data_;
+    };
 
     class Seqdb
     {
@@ -93,6 +167,7 @@ namespace acmacs::seqdb::inline v3
         subset select_by_seq_id(const std::vector<std::string_view>& seq_ids) const;
         subset select_by_name(std::string_view name) const;
         subset select_by_name_hash(std::string_view name, std::string_view hash) const;
+        subset select_by_name_hash(std::string_view name, hash_value_t hash) const;
         subset select_by_name(const std::vector<std::string_view>& names) const;
         subset select_by_accession_number(const std::vector<std::string_view>& accession_numbers) const;
         subset select_by_regex(std::string_view re) const;
@@ -103,9 +178,14 @@ namespace acmacs::seqdb::inline v3
         const hi_name_index_t& hi_name_index() const;
         const lab_id_index_t& lab_id_index() const;
         const hash_index_t& hash_index() const;
+        const name_without_subtype_index_t& name_without_subtype_index() const;
+        const accession_number_index_t& accession_number_index() const;
+        void build_indexes() const; // eagerly builds all indexes above in parallel, otherwise each one is built on first use
+        const dictionaries_t& dictionaries() const { return dictionaries_; }
 
         // returned subset contains elements for each antigen, i.e. it may contain empty ref's
-        template <typename AgSr> subset match(const AgSr& antigens_sera, std::string_view aChartVirusType = {}) const;
+        // warnings are reported with AD_WARNING or, if warnings is not nullptr, appended to it (in the antigen/serum order)
+        template <typename AgSr> subset match(const AgSr& antigens_sera, std::string_view aChartVirusType = {}, match_cache_t* cache = nullptr, std::vector<std::string>* warnings = nullptr) const;
 
         using aas_indexes_t = std::map<std::string, std::vector<size_t>>;
         aas_indexes_t aa_at_pos1_for_antigens(const acmacs::chart::Antigens& aAntigens, const std::vector<size_t>& aPositions1) const;
@@ -116,10 +196,13 @@ namespace acmacs::seqdb::inline v3
         clades_t clades_for_name(std::string_view name, clades_for_name_inclusive inclusive = clades_for_name_inclusive::no) const;
 
         // returns number of antigens and sera matched (populated)
-        std::pair<acmacs::chart::Indexes, acmacs::chart::Indexes> populate(acmacs::chart::ChartModify& chart) const;
+        // warnings are reported with AD_WARNING or, if warnings is not nullptr, appended to it (e.g. to report them in the chart order when charts are populated in parallel)
+        std::pair<acmacs::chart::Indexes, acmacs::chart::Indexes> populate(acmacs::chart::ChartModify& chart, match_cache_t* cache = nullptr, std::vector<std::string>* warnings = nullptr) const;
 
         // returns subset where each entry corresponds to the entry in seq_ids
         subset find_by_seq_ids(const std::vector<std::string_view>& seq_ids) const;
+        // returns subset where each entry corresponds to the entry in accession_numbers (first seq found, empty ref if not found)
+        subset find_by_accession_numbers(const std::vector<std::string_view>& accession_numbers) const;
 
         // returns json with data for ace-view/2018 sequences_of_chart command
         std::string sequences_of_chart_for_ace_view_1(const acmacs::chart::Chart& chart) const;
@@ -128,19 +211,45 @@ namespace acmacs::seqdb::inline v3
 
         void find_slaves() const;
 
+        // recomputes clades of master sequences (e.g. after changing clades.json) without re-scanning
+        // clade_definitions is kept by seqdb, clades of sequences are views into it
+        // not thread safe: requires exclusive access to seqdb, clades and clade codes obtained before the update are invalidated
+        void update_clades(std::shared_ptr<const CladeDefinitions> clade_definitions);
+
       private:
-        std::string json_text_;
-        std::vector<SeqdbEntry> entries_;
+        // data of the loaded file: seqdb-3 or one shard of seqdb-4, entries keep views into its arena, the json text is released after parsing
+        struct source_t
+        {
+            std::string names;   // seqdb-4: names of entries with the subtype prefix
+            seqdb_arena_t arena; // strings, lists and packed sequences of the entries
+        };
+
+        std::deque<source_t> sources_; // seqdb-4 shards may be added after others are parsed, elements must not move
+        std::vector<SeqdbEntry> entries_; // sorted by name
         mutable seq_id_index_t seq_id_index_;
         mutable hi_name_index_t hi_name_index_;
         mutable lab_id_index_t lab_id_index_;
         mutable hash_index_t hash_index_;
-        mutable std::mutex index_access_; // acmacs-api is multi-threaded app
+        mutable name_without_subtype_index_t name_without_subtype_index_;
+        mutable accession_number_index_t accession_number_index_;
+        // acmacs-api is multi-threaded app: indexes are built once on the first use (or by build_indexes()) and never modified afterwards, access is lock free
+        mutable std::once_flag seq_id_index_built_, hi_name_index_built_, lab_id_index_built_, hash_index_built_, name_without_subtype_index_built_, accession_number_index_built_;
         mutable bool slaves_found_{false};
-
-        Seqdb(std::string_view filename);
+        mutable std::vector<ref> slaves_of_masters_; // compressed sparse row: slaves grouped by master, SeqdbSeq::slaves_ of each master is a view into it
+        std::shared_ptr<const CladeDefinitions> clade_definitions_;          // set by update_clades
+        std::vector<std::string_view> clades_arena_;                         // clades of SeqdbSeq set by update_clades, views into clade_definitions_
+        dictionaries_t dictionaries_;                                        // clades are added by update_clades (exclusive access)
+        std::vector<dictionary_code_t> codes_;                               // lab and clade codes of all SeqdbSeq
+        std::vector<dictionary_code_t> clade_codes_arena_;                   // clade codes of SeqdbSeq set by update_clades
+
+        Seqdb(std::string_view filename, const std::vector<std::string>& subtypes);
+        static Seqdb& instance(); // get() and update_clades() only
+        friend void update_clades(std::string_view clades_json_filename);
         // Seqdb(std::string&& source);
 
+        void load_seqdb4(std::string_view directory, const std::vector<std::string>& subtypes);
+        void build_dictionaries();
+
         void select_by_name(std::string_view name, subset& subs) const;
 
         // supports seq_ids before 2020-03-12, e.g. with _d1 etc. suffixes and without has suffix
@@ -148,17 +257,27 @@ namespace acmacs::seqdb::inline v3
         std::pair<seq_id_iter, seq_id_iter> find_seq_id(std::string_view seq_id) const;
     };
 
-    void setup(std::string_view filename);
+    void setup(std::string_view filename, build_indexes_on_load bi = build_indexes_on_load::no);
+    // seqdb-4: loads just shards of the subtypes (e.g. "A(H3N2)", "H3", "B") from directory, all shards if subtypes is empty
+    // plus shards having masters of sequences in the loaded ones
+    void setup_seqdb4(std::string_view directory, const std::vector<std::string>& subtypes = {}, build_indexes_on_load bi = build_indexes_on_load::no);
+
+    // seqdb-4 is one file per HA subtype, e.g. A(H3N2) and A(H3) (referencing A(H3N2) masters) are in <directory>/seqdb4-h3.json.xz
+    std::string seqdb4_shard(std::string_view subtype); // "A(H3N2)", "A(H3)", "H3" -> "h3", "B" -> "b"
+    std::string seqdb4_filename(std::string_view directory, std::string_view shard);
     inline const Seqdb& get()
     {
         return Seqdb::get();
     }
     void populate(acmacs::chart::ChartModify& chart, even_if_already_popuplated eiap = even_if_already_popuplated::no);
+    // empty filename: $ACMACSD_ROOT/share/conf/clades.json
+    // not thread safe: no other thread may use seqdb during the update (see Seqdb::update_clades)
+    void update_clades(std::string_view clades_json_filename = {});
 
-    extern template subset Seqdb::match(const acmacs::chart::Antigens&, std::string_view) const;
-    extern template subset Seqdb::match(const acmacs::chart::AntigensModify&, std::string_view) const;
-    extern template subset Seqdb::match(const acmacs::chart::Sera&, std::string_view) const;
-    extern template subset Seqdb::match(const acmacs::chart::SeraModify&, std::string_view) const;
+    extern template subset Seqdb::match(const acmacs::chart::Antigens&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
+    extern template subset Seqdb::match(const acmacs::chart::AntigensModify&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
+    extern template subset Seqdb::match(const acmacs::chart::Sera&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
+    extern template subset Seqdb::match(const acmacs::chart::SeraModify&, std::string_view, match_cache_t*, std::vector<std::string>*) const;
 
     // ----------------------------------------------------------------------
 
@@ -176,6 +295,7 @@ namespace acmacs::seqdb::inline v3
         size_t e_length{0};                    // truncate/extend all sequences to this length
         size_t e_deletion_report_threshold{4}; // if sequence has this or more deletions, report the name.
         bool e_report_deletions_at_the_end{false};
+        size_t e_threads{1};                   // export_sequences to file: number of threads formatting records and compressing .xz output, 0 - number of cores
 
         export_options& fasta(bool nucs)
         {
@@ -228,50 +348,63 @@ namespace acmacs::seqdb::inline v3
             e_report_deletions_at_the_end = report;
             return *this;
         }
+        export_options& threads(size_t threads)
+        {
+            e_threads = threads;
+            return *this;
+        }
     };
 
     // ----------------------------------------------------------------------
 
     struct SeqdbSeq
     {
-        using lab_ids_t = std::vector<std::string_view>;
-        using labs_t = std::vector<std::pair<std::string_view, lab_ids_t>>;
+        using strings_t = std::span<const std::string_view>; // lists are stored in the arena of Seqdb
+        using lab_ids_t = acmacs::seqdb::v3::lab_ids_t;
+        using labs_t = std::span<const lab_t>;
+        using codes_t = std::span<const dictionary_code_t>; // parallel to the corresponding strings_t
         using master_ref_t = acmacs::seqdb::v3::master_ref_t;
 
         struct gisaid_data_t
         {
-            std::vector<std::string_view> isolate_ids;                   // gisaid accession numbers
-            std::vector<std::string_view> sample_ids_by_sample_provider; // ncbi accession numbers
+            strings_t isolate_ids;                   // gisaid accession numbers
+            strings_t sample_ids_by_sample_provider; // ncbi accession numbers
         };
 
         // sequence either contains nucs, amino_acids, clades or reference master sequence with the same nucs
         master_ref_t master;                       // for slave only
-        sequence_with_alignment_ref_t amino_acids; // for master only
-        sequence_with_alignment_ref_t nucs;        // for master only
+        packed_sequence_with_alignment_t amino_acids; // for master only
+        packed_sequence_with_alignment_t nucs;        // for master only
         std::string_view annotations;
-        std::vector<std::string_view> reassortants;
-        std::vector<std::string_view> passages;
-        std::vector<std::string_view> clades; // for master only
-        std::vector<std::string_view> hi_names;
+        strings_t reassortants;
+        strings_t passages;
+        strings_t clades; // for master only, may be recomputed by Seqdb::update_clades
+        strings_t hi_names;
         std::string_view hash;
+        hash_value_t hash_value{0}; // parsed hash
+        std::string_view shard;     // seqdb-4 only: shard of the master if it differs from the shard of the slave
         sequence::issues_t issues;
         labs_t lab_ids;
         gisaid_data_t gisaid;
-        mutable std::unique_ptr<std::vector<ref>> slaves_; // for master only, list of slaves pointing to this master
+        // codes in Seqdb::dictionaries()
+        codes_t lab_codes;
+        codes_t clade_codes; // for master only, updated together with clades
+        mutable std::span<const ref> slaves_; // for master only, slaves pointing to this master, view into Seqdb, set by Seqdb::find_slaves
 
         bool has_lab(std::string_view lab) const
         {
             return std::any_of(std::begin(lab_ids), std::end(lab_ids), [lab](const auto& en) { return en.first == lab; });
         }
+        bool has_lab(dictionary_code_t lab) const { return std::find(std::begin(lab_codes), std::end(lab_codes), lab) != std::end(lab_codes); }
         bool has_reassortant(std::string_view reassortant) const { return std::find(std::begin(reassortants), std::end(reassortants), reassortant) != std::end(reassortants); }
-        bool matches(const amino_acid_at_pos1_eq_list_t& aa_at_pos1_eq) const { return acmacs::seqdb::matches(acmacs::seqdb::aligned(amino_acids), aa_at_pos1_eq); }
-        bool matches(const amino_acid_at_pos1_list_t& aa_at_pos1) const { return acmacs::seqdb::matches(acmacs::seqdb::aligned(amino_acids), aa_at_pos1); }
-        bool matches(const nucleotide_at_pos1_eq_list_t& nuc_at_pos1_eq) const { return acmacs::seqdb::matches(acmacs::seqdb::aligned(nucs), nuc_at_pos1_eq); }
-        bool matches(const nucleotide_at_pos1_list_t& nuc_at_pos1) const { return acmacs::seqdb::matches(acmacs::seqdb::aligned(nucs), nuc_at_pos1); }
+        bool matches(const amino_acid_at_pos1_eq_list_t& aa_at_pos1_eq) const { return acmacs::seqdb::matches(amino_acids.aligned, aa_at_pos1_eq); }
+        bool matches(const amino_acid_at_pos1_list_t& aa_at_pos1) const { return acmacs::seqdb::matches(amino_acids.aligned, aa_at_pos1); }
+        bool matches(const nucleotide_at_pos1_eq_list_t& nuc_at_pos1_eq) const { return acmacs::seqdb::matches(nucs.aligned, nuc_at_pos1_eq); }
+        bool matches(const nucleotide_at_pos1_list_t& nuc_at_pos1) const { return acmacs::seqdb::matches(nucs.aligned, nuc_at_pos1); }
 
         constexpr bool matches_without_name(const master_ref_t& other_reference) const
         {
-            return hash == other_reference.hash;
+            return hash_value == other_reference.hash_value;
             // return annotations == other_reference.annotations &&
             //        ((other_reference.reassortant.empty() && reassortants.empty()) || std::find(std::begin(reassortants), std::end(reassortants), other_reference.reassortant) !=
             //        std::end(reassortants)) &&
@@ -285,15 +418,17 @@ namespace acmacs::seqdb::inline v3
                 throw std::runtime_error(fmt::format("SeqdbSeq::has_clade_master is used for seq with the reference to {}, hi_names: {}", master.name, hi_names));
             return std::find(std::begin(clades), std::end(clades), clade) != std::end(clades);
         }
+        bool has_clade_master(dictionary_code_t clade) const { return std::find(std::begin(clade_codes), std::end(clade_codes), clade) != std::end(clade_codes); }
 
-        constexpr sequence_aligned_ref_t aa_aligned_master(size_t length = std::string_view::npos) const { return acmacs::seqdb::aligned(amino_acids, length); }
-        constexpr sequence_aligned_ref_t nuc_aligned_master(size_t length = std::string_view::npos) const { return acmacs::seqdb::aligned(nucs, length); }
+        // sequences are decoded from the packed storage, use amino_acids.aligned and nucs.aligned to avoid decoding
+        sequence_aligned_t aa_aligned_master(size_t length = std::string_view::npos) const { return sequence_aligned_t{amino_acids.aligned.decode(length)}; }
+        sequence_aligned_t nuc_aligned_master(size_t length = std::string_view::npos) const { return sequence_aligned_t{nucs.aligned.decode(length)}; }
 
-        size_t aa_aligned_length_master() const { return acmacs::seqdb::aligned_length(amino_acids); }
-        size_t nuc_aligned_length_master() const { return acmacs::seqdb::aligned_length(nucs); }
+        size_t aa_aligned_length_master() const { return amino_acids.aligned.size(); }
+        size_t nuc_aligned_length_master() const { return nucs.aligned.size(); }
 
-        char aa_at_pos_master(pos0_t pos0) const { return acmacs::seqdb::at_pos(amino_acids, pos0); }
-        char aa_at_pos_master(pos1_t pos1) const { return acmacs::seqdb::at_pos(amino_acids, pos1); }
+        char aa_at_pos_master(pos0_t pos0) const { return acmacs::seqdb::at_pos(amino_acids.aligned, pos0); }
+        char aa_at_pos_master(pos1_t pos1) const { return acmacs::seqdb::at_pos(amino_acids.aligned, pos1); }
 
         std::string_view lab() const { return lab_ids.empty() ? std::string_view{} : lab_ids.front().first; }
         std::string_view lab_id() const { return (lab_ids.empty() || lab_ids.front().second.empty()) ? std::string_view{} : lab_ids.front().second.front(); }
@@ -305,8 +440,7 @@ namespace acmacs::seqdb::inline v3
         // bool is_slave() const { return !is_master(); }
         const SeqdbSeq& with_sequence(const Seqdb& seqdb) const { return is_master() ? *this : find_master(seqdb); }
         const SeqdbSeq& find_master(const Seqdb& seqdb) const;
-        void add_slave(const ref& slave) const;
-        const std::vector<ref>& slaves() const;
+        std::span<const ref> slaves() const { return slaves_; }
     };
 
     struct SeqdbEntry
@@ -318,6 +452,11 @@ namespace acmacs::seqdb::inline v3
         std::string_view lineage;
         std::string_view virus_type;
         std::vector<SeqdbSeq> seqs;
+        // codes in Seqdb::dictionaries()
+        dictionary_code_t virus_type_code{dictionary_t::not_found};
+        dictionary_code_t lineage_code{dictionary_t::not_found};
+        dictionary_code_t continent_code{dictionary_t::not_found};
+        dictionary_code_t country_code{dictionary_t::not_found};
 
         std::string host() const;
         bool date_within(std::string_view start, std::string_view end) const { return !dates.empty() && (start.empty() || dates.front() >= start) && (end.empty() || dates.front() < end); }
@@ -352,14 +491,14 @@ namespace acmacs::seqdb::inline v3
         const auto& front() const { return refs_.front(); }
 
         subset& multiple_dates(bool do_filter = true);
-        subset& subtype(const acmacs::uppercase& virus_type);
-        subset& lineage(const acmacs::uppercase& lineage);
-        subset& lab(const acmacs::uppercase& lab);
-        subset& whocc_lab(bool do_filter = true);
+        subset& subtype(const Seqdb& seqdb, const acmacs::uppercase& virus_type);
+        subset& lineage(const Seqdb& seqdb, const acmacs::uppercase& lineage);
+        subset& lab(const Seqdb& seqdb, const acmacs::uppercase& lab);
+        subset& whocc_lab(const Seqdb& seqdb, bool do_filter = true);
         subset& host(const acmacs::uppercase& host);
         subset& dates(std::string_view start, std::string_view end);
-        subset& continent(const acmacs::uppercase& continent);
-        subset& country(const acmacs::uppercase& country);
+        subset& continent(const Seqdb& seqdb, const acmacs::uppercase& continent);
+        subset& country(const Seqdb& seqdb, const acmacs::uppercase& country);
         subset& with_issues(const Seqdb& seqdb, bool keep_with_issues);
         subset& clade(const Seqdb& seqdb, const acmacs::uppercase& clade);
         subset& recent(size_t recent, master_only master);
@@ -399,6 +538,11 @@ namespace acmacs::seqdb::inline v3
         subset& report_aa_at(const Seqdb& seqdb, const pos1_list_t& pos1_list);
         subset& report_hamming_distance(bool do_report);
         subset& report_hamming_bins(const Seqdb& seqdb, size_t bin_size);
+        aggregate_table_t aggregate(const Seqdb& seqdb, std::string_view group_by) const; // group_by: comma separated keys, see aggregate_t
+
+        // set by nuc_hamming_distance_to, nuc_hamming_distance_to_base and group_by_hamming_distance, 0 if not set
+        size_t hamming_distance_of(const ref& rf) const;
+        size_t group_no_of(const ref& rf) const;
 
         subset& append(const ref& seq)
         {
@@ -418,13 +562,22 @@ namespace acmacs::seqdb::inline v3
         enum class matched_only { no, yes };
         subset filter_by_indexes(const acmacs::chart::PointIndexList& indexes, enum matched_only matched_only = matched_only::yes) const;
 
-        void sort_by_nuc_aligned_truncated(const Seqdb& seqdb, size_t truncate_at)
-        {
-            std::sort(std::begin(refs_), std::end(refs_), [&seqdb, truncate_at](const auto& e1, const auto& e2) { return e1.nuc_aligned(seqdb, truncate_at) < e2.nuc_aligned(seqdb, truncate_at); });
-        }
+        void sort_by_nuc_aligned_truncated(const Seqdb& seqdb, size_t truncate_at);
 
       private:
+        struct annotation_t
+        {
+            size_t hamming_distance{0};
+            size_t group_no{0};
+        };
+
+        struct ref_hash
+        {
+            size_t operator()(const ref& rf) const noexcept { return std::hash<const void*>{}(rf.entry) ^ (size_t{rf.seq_index} << 20); }
+        };
+
         refs_t refs_;
+        std::unordered_map<ref, annotation_t, ref_hash> annotations_; // side column, empty unless hamming distances or groups computed
         using ref_indexes = std::vector<size_t>;
 
         subset(size_t size) : refs_(size) {}
@@ -445,10 +598,7 @@ namespace acmacs::seqdb::inline v3
         {
             std::sort(std::begin(refs_), std::end(refs_), [](const auto& e1, const auto& e2) { return e1.entry->date() < e2.entry->date(); });
         }
-        void sort_by_hamming_distance()
-        {
-            std::sort(std::begin(refs_), std::end(refs_), [](const auto& e1, const auto& e2) { return e1.hamming_distance < e2.hamming_distance; });
-        }
+        void sort_by_hamming_distance();
 
         refs_t::iterator most_recent_with_hi_name();
         void remove(ref_indexes& to_remove);
@@ -463,10 +613,14 @@ namespace acmacs::seqdb::inline v3
         };
         using collected_t = std::vector<collected_entry_t>;
 
+        packed_sequence_with_alignment_t export_sequence(const Seqdb& seqdb, const export_options& options, const ref& entry) const; // packed in seqdb, decode with text()
         collected_t export_collect(const Seqdb& seqdb, const export_options& options) const;
         std::string export_fasta(const collected_t& entries, const export_options& options) const;
-        std::string export_json(const collected_t& entries, const export_options& options) const;
-        std::string make_name(const Seqdb& seqdb, std::string_view name_format, const ref& entry) const;
+
+        using collected_views_t = std::vector<std::pair<const ref*, packed_sequence_with_alignment_t>>; // {ref, sequence}, sequence is packed in seqdb and decoded when written
+        collected_views_t export_collect_views(const Seqdb& seqdb, const export_options& options) const; // entries with non-empty sequences
+        static size_t export_length(const collected_views_t& entries, const export_options& options); // 0: keep sequence length
+        std::string make_name(const Seqdb& seqdb, const name_format_t& name_format, const ref& entry) const;
 
         friend class Seqdb;
     };
@@ -477,8 +631,21 @@ namespace acmacs::seqdb::inline v3
 
     inline bool ref::matches(const SeqdbSeq::master_ref_t& master) const
     {
-        return entry->name == master.name && seq().matches_without_name(master);
+        return seq().matches_without_name(master) && entry->name == master.name;
+    }
+
+    inline std::pair<hash_index_t::const_iterator, hash_index_t::const_iterator> hash_index_t::find(hash_value_t hash) const
+    {
+        if (!slots_.empty()) {
+            const size_t mask = slots_.size() - 1;
+            for (size_t slot_no = hash & mask; slots_[slot_no].first != slots_[slot_no].last; slot_no = (slot_no + 1) & mask) {
+                if (slots_[slot_no].hash == hash)
+                    return {std::next(std::begin(refs_), static_cast<ssize_t>(slots_[slot_no].first)), std::next(std::begin(refs_), static_cast<ssize_t>(slots_[slot_no].last))};
+            }
+        }
+        return {std::end(refs_), std::end(refs_)};
     }
+
     inline const SeqdbSeq& ref::seq() const
     {
         return entry->seqs[seq_index];
@@ -523,10 +690,18 @@ namespace acmacs::seqdb::inline v3
     {
         return seq().has_lab(lab);
     }
+    inline bool ref::has_lab(dictionary_code_t lab) const
+    {
+        return seq().has_lab(lab);
+    }
     inline bool ref::has_clade(const Seqdb& seqdb, std::string_view clade) const
     {
         return seq_with_sequence(seqdb).has_clade_master(clade);
     }
+    inline bool ref::has_clade(const Seqdb& seqdb, dictionary_code_t clade) const
+    {
+        return seq_with_sequence(seqdb).has_clade_master(clade);
+    }
     inline bool ref::has_hi_names() const
     {
         return !seq().hi_names.empty();
@@ -539,11 +714,11 @@ namespace acmacs::seqdb::inline v3
     {
         return seq().matches(aa_at_pos1);
     }
-    inline sequence_aligned_ref_t ref::aa_aligned(const Seqdb& seqdb, size_t length) const
+    inline sequence_aligned_t ref::aa_aligned(const Seqdb& seqdb, size_t length) const
     {
         return seq_with_sequence(seqdb).aa_aligned_master(length);
     }
-    inline sequence_aligned_ref_t ref::nuc_aligned(const Seqdb& seqdb, size_t length) const
+    inline sequence_aligned_t ref::nuc_aligned(const Seqdb& seqdb, size_t length) const
     {
         return seq_with_sequence(seqdb).nuc_aligned_master(length);
     }
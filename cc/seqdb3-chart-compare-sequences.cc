@@ -49,7 +49,7 @@ int main(int argc, char* const argv[])
             acmacs::open_or_quicklook(opt.open && opt.html != "-" && opt.html != "=", false, opt.html);
         }
         if (opt.json)
-            acmacs::file::write(opt.json, subsets_to_compare.format_json(2));
+            subsets_to_compare.write_json(opt.json);
 
         fmt::print("{}\n\n{}\n\n", subsets_to_compare.format_seq_ids(0), subsets_to_compare.format_summary(0, 5, 0.2));
 
@@ -1,7 +1,9 @@
 #include "acmacs-base/argv.hh"
+#include "acmacs-base/omp.hh"
 #include "acmacs-chart-2/factory-import.hh"
 #include "acmacs-chart-2/factory-export.hh"
 #include "acmacs-chart-2/chart-modify.hh"
+#include "locationdb/locdb.hh"
 #include "seqdb-3/seqdb.hh"
 
 // ----------------------------------------------------------------------
@@ -13,49 +15,68 @@ struct Options : public argv
 
     option<str> db{*this, "db", dflt{""}};
     option<bool> no_export{*this, 'n', "no-export"};
+    option<size_t> threads{*this, 'j', "threads", dflt{1ul}, desc{"number of charts processed in parallel sharing matching results, 0 - number of cores"}};
     option<str_array> verbose{*this, 'v', "verbose", desc{"comma separated list (or multiple switches) of enablers"}};
 
     argument<str_array> chart_name{*this, arg_name{"chart_name"}, mandatory};
 };
 
+// report(std::string, report_line) is called for each line of the report, warnings of matching and populating are reported too
+enum class report_line { print, warning };
+template <typename Report> static void populate(std::string_view chart_name, bool do_export, std::string_view program_name, acmacs::seqdb::match_cache_t* cache, Report&& report);
+
+static inline void print_report_line(const std::string& line, report_line line_type)
+{
+    if (line_type == report_line::warning)
+        AD_WARNING("{}", line);
+    else
+        AD_PRINT("{}", line);
+}
+
+// ----------------------------------------------------------------------
+
 int main(int argc, char* const argv[])
 {
     try {
         Options opt(argc, argv);
         acmacs::log::enable(opt.verbose);
 
-        acmacs::seqdb::setup(opt.db);
-        for (const auto& chart_name : *opt.chart_name) {
-            acmacs::chart::ChartModify chart{acmacs::chart::import_from_file(chart_name)};
-            AD_PRINT("{}", chart_name);
-            const auto [matched_antigens, matched_sera] = acmacs::seqdb::get().populate(chart);
-
-            AD_PRINT("AG matched: {} (of {})", matched_antigens.size(), chart.number_of_antigens());
-            if (matched_antigens.size() < chart.number_of_antigens()) {
-                AD_PRINT("AG NOT matched: {}", chart.number_of_antigens() - matched_antigens.size());
-                for (const auto ag_no : range_from_0_to(chart.number_of_antigens())) {
-                    if (!matched_antigens.contains(ag_no))
-                        AD_PRINT("  {:5d} {}", ag_no, chart.antigens()->at(ag_no)->name_full());
+        acmacs::seqdb::setup(opt.db, *opt.threads == 1 ? acmacs::seqdb::build_indexes_on_load::no : acmacs::seqdb::build_indexes_on_load::yes);
+        if (*opt.threads == 1) {
+            for (const auto& chart_name : *opt.chart_name)
+                populate(chart_name, !opt.no_export, opt.program_name(), nullptr, [](std::string&& line, report_line line_type) { print_report_line(line, line_type); });
+        }
+        else {
+            // charts are imported, matched and exported by several threads, matching results are shared via cache
+            // report is printed in the order of charts
+#ifdef _OPENMP
+            const int num_threads = *opt.threads == 0 ? omp_get_max_threads() : static_cast<int>(*opt.threads);
+#endif
+            acmacs::seqdb::get().hi_name_index(); // load seqdb outside of threading code
+            acmacs::locationdb::get();            // used by Seqdb::match, load locdb outside of threading code, it is not thread safe
+            acmacs::seqdb::match_cache_t cache;
+            std::vector<std::string> errors(opt.chart_name->size());
+#pragma omp parallel for default(shared) num_threads(num_threads) schedule(dynamic, 1) ordered
+            for (size_t chart_no = 0; chart_no < opt.chart_name->size(); ++chart_no) {
+                std::vector<std::pair<std::string, report_line>> report;
+                try {
+                    populate((*opt.chart_name)[chart_no], !opt.no_export, opt.program_name(), &cache,
+                             [&report](std::string&& line, report_line line_type) { report.emplace_back(std::move(line), line_type); });
+                }
+                catch (std::exception& err) {
+                    errors[chart_no] = fmt::format("{}: {}", (*opt.chart_name)[chart_no], err);
                 }
+#pragma omp ordered
+                for (const auto& [line, line_type] : report)
+                    print_report_line(line, line_type);
             }
-
-            AD_PRINT("SR matched: {} (of {})", matched_sera.size(), chart.number_of_sera());
-            if (matched_sera.size() < chart.number_of_sera()) {
-                AD_PRINT("SR NOT matched: {}", chart.number_of_sera() - matched_sera.size());
-                for (const auto sr_no : range_from_0_to(chart.number_of_sera())) {
-                    if (!matched_sera.contains(sr_no))
-                        AD_PRINT("  {:5d} {}", sr_no, chart.sera()->at(sr_no)->name_full());
+            if (const auto failed = std::count_if(std::begin(errors), std::end(errors), [](const auto& err) { return !err.empty(); }); failed > 0) {
+                for (const auto& err : errors) {
+                    if (!err.empty())
+                        AD_ERROR("{}", err);
                 }
+                return 1;
             }
-
-            // for (const auto ag_no : matched_antigens)
-            //     AD_PRINT("    {:5d} {} {}", ag_no, chart.antigens()->at(ag_no)->name_full(), chart.antigens()->at(ag_no)->clades());
-            // AD_PRINT("  sera: {:5d} (of {:5d})", matched_sera.size(), chart.number_of_sera());
-            // for (const auto sr_no : matched_sera)
-            //     AD_PRINT("    {:5d} {} {}", sr_no, chart.sera()->at(sr_no)->name_full(), chart.sera()->at(sr_no)->clades());
-
-            if (!opt.no_export)
-                acmacs::chart::export_factory(chart, chart_name, opt.program_name());
         }
         return 0;
     }
@@ -65,6 +86,46 @@ int main(int argc, char* const argv[])
     }
 }
 
+// ----------------------------------------------------------------------
+
+template <typename Report> void populate(std::string_view chart_name, bool do_export, std::string_view program_name, acmacs::seqdb::match_cache_t* cache, Report&& report)
+{
+    acmacs::chart::ChartModify chart{acmacs::chart::import_from_file(chart_name)};
+    report(std::string{chart_name}, report_line::print);
+    std::vector<std::string> warnings;
+    const auto [matched_antigens, matched_sera] = acmacs::seqdb::get().populate(chart, cache, &warnings);
+    for (auto& warning : warnings)
+        report(std::move(warning), report_line::warning);
+
+    report(fmt::format("AG matched: {} (of {})", matched_antigens.size(), chart.number_of_antigens()), report_line::print);
+    if (matched_antigens.size() < chart.number_of_antigens()) {
+        report(fmt::format("AG NOT matched: {}", chart.number_of_antigens() - matched_antigens.size()), report_line::print);
+        for (const auto ag_no : range_from_0_to(chart.number_of_antigens())) {
+            if (!matched_antigens.contains(ag_no))
+                report(fmt::format("  {:5d} {}", ag_no, chart.antigens()->at(ag_no)->name_full()), report_line::print);
+        }
+    }
+
+    report(fmt::format("SR matched: {} (of {})", matched_sera.size(), chart.number_of_sera()), report_line::print);
+    if (matched_sera.size() < chart.number_of_sera()) {
+        report(fmt::format("SR NOT matched: {}", chart.number_of_sera() - matched_sera.size()), report_line::print);
+        for (const auto sr_no : range_from_0_to(chart.number_of_sera())) {
+            if (!matched_sera.contains(sr_no))
+                report(fmt::format("  {:5d} {}", sr_no, chart.sera()->at(sr_no)->name_full()), report_line::print);
+        }
+    }
+
+    // for (const auto ag_no : matched_antigens)
+    //     AD_PRINT("    {:5d} {} {}", ag_no, chart.antigens()->at(ag_no)->name_full(), chart.antigens()->at(ag_no)->clades());
+    // AD_PRINT("  sera: {:5d} (of {:5d})", matched_sera.size(), chart.number_of_sera());
+    // for (const auto sr_no : matched_sera)
+    //     AD_PRINT("    {:5d} {} {}", sr_no, chart.sera()->at(sr_no)->name_full(), chart.sera()->at(sr_no)->clades());
+
+    if (do_export)
+        acmacs::chart::export_factory(chart, chart_name, program_name);
+
+} // populate
+
 // ----------------------------------------------------------------------
 /// Local Variables:
 /// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
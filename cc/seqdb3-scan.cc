@@ -48,6 +48,7 @@ struct Options : public argv
     option<bool> gisaid{*this, "gisaid", desc{"perform gisaid related name fixes and adjustments"}};
     option<str>  ncbi{*this, "ncbi", dflt{""}, desc{"directory with files downloaded from ncbi, see acmacs-whocc/doc/gisaid.org"}};
     option<bool> dont_eliminate_identical{*this, "dont-eliminate-identical", desc{"do not find identical sequences"}};
+    option<str>  banded_alignment{*this, "banded-alignment", dflt{"no"}, desc{"use banded alignment to detect deletions/insertions: no, fallback (if heuristic failed), always"}};
 
     option<str>  print_aa_for{*this, "print-aa-for", dflt{""}};
     option<str>  print_not_aligned_for{*this, "print-not-aligned-for", dflt{""}, desc{"ALL or comma separated: H1N,H3,B"}};
@@ -64,6 +65,7 @@ struct Options : public argv
 };
 
 static int report(const std::vector<acmacs::seqdb::scan::fasta::scan_result_t>& sequences, const Options& opt);
+static acmacs::seqdb::scan::banded_alignment banded_alignment(std::string_view source);
 static void report_messages(acmacs::messages::messages_t& messages);
 static void report_issues(const std::vector<acmacs::seqdb::scan::fasta::scan_result_t>& all_sequences);
 
@@ -92,7 +94,7 @@ int main(int argc, char* const argv[])
         acmacs::seqdb::scan::fasta::remove_without_names(all_sequences);
         acmacs::seqdb::scan::fasta::merge_duplicates(all_sequences);
         acmacs::seqdb::scan::translate_align(all_sequences);
-        acmacs::seqdb::scan::detect_insertions_deletions(all_sequences);
+        acmacs::seqdb::scan::detect_insertions_deletions(all_sequences, banded_alignment(opt.banded_alignment));
         acmacs::seqdb::scan::detect_lineages_clades(all_sequences);
         // acmacs::seqdb::scan::fasta::sort_by_date(all_sequences);
         acmacs::seqdb::scan::match_hidb(all_sequences); // sorts all_sequences by name
@@ -171,6 +173,21 @@ int main(int argc, char* const argv[])
 
 // ----------------------------------------------------------------------
 
+acmacs::seqdb::scan::banded_alignment banded_alignment(std::string_view source)
+{
+    if (source == "no")
+        return acmacs::seqdb::scan::banded_alignment::no;
+    else if (source == "fallback")
+        return acmacs::seqdb::scan::banded_alignment::fallback;
+    else if (source == "always")
+        return acmacs::seqdb::scan::banded_alignment::always;
+    else
+        throw std::runtime_error{fmt::format("unrecognized --banded-alignment value: \"{}\"", source)};
+
+} // banded_alignment
+
+// ----------------------------------------------------------------------
+
 template <typename Key> static inline std::vector<std::pair<Key, size_t>> sorted_by_count(const std::map<Key, size_t>& source)
 {
     const auto order_by_value_reverse = [](const auto& e1, const auto& e2) { return e1.second > e2.second; };
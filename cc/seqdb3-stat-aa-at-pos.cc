@@ -1,8 +1,8 @@
 #include "acmacs-base/argv.hh"
 #include "acmacs-base/read-file.hh"
 #include "acmacs-base/string-split.hh"
-#include "acmacs-base/counter.hh"
 #include "seqdb-3/seqdb.hh"
+#include "seqdb-3/column-profile.hh"
 
 // ----------------------------------------------------------------------
 
@@ -31,21 +31,23 @@ int main(int argc, char* const argv[])
         else
             subset = seqdb.select_by_seq_id(opt.seqids);
 
-        std::vector<acmacs::CounterChar> aa_at_pos;
-        for (const auto& ref : subset) {
-            const auto aa = ref.aa_aligned(seqdb);
-            if (aa_at_pos.size() < *aa.size())
-                aa_at_pos.resize(*aa.size());
-            for (acmacs::seqdb::pos0_t pos{0}; pos < aa.size(); ++pos)
-                aa_at_pos[*pos].count(aa.at(pos));
-        }
+        std::vector<acmacs::seqdb::sequence_aligned_t> decoded(subset.size());
+        std::transform(std::begin(subset), std::end(subset), std::begin(decoded), [&seqdb](const auto& ref) { return ref.aa_aligned(seqdb); });
+        std::vector<std::string_view> sequences(decoded.size());
+        std::transform(std::begin(decoded), std::end(decoded), std::begin(sequences), [](const auto& seq) -> std::string_view { return *seq; });
+        acmacs::seqdb::column_profile_t aa_at_pos;
+        aa_at_pos.add(sequences);
 
         const auto min_second_to_report = static_cast<size_t>(static_cast<double>(subset.size()) * *opt.second_counter_threshold);
         // AD_DEBUG("subset:{} threshold:{} min-second:{}", subset.size(), static_cast<double>(subset.size()) * *opt.second_counter_threshold, min_second_to_report);
-        for (size_t pos{0}; pos < aa_at_pos.size(); ++pos) {
-            const auto data = aa_at_pos[pos].pairs(acmacs::CounterChar::sorted::yes);
-            if (data.size() > 1 && data[1].first != 'X' && data[1].second > min_second_to_report)
-                fmt::print("{:3d} {}\n", pos + 1, aa_at_pos[pos].report_sorted_max_first("  {value}:{counter}"));
+        for (acmacs::seqdb::pos0_t pos{0}; pos < aa_at_pos.size(); ++pos) {
+            const auto data = aa_at_pos.frequencies(pos, acmacs::seqdb::column_profile_t::sorted::yes);
+            if (data.size() > 1 && data[1].first != 'X' && data[1].second > min_second_to_report) {
+                fmt::print("{:3d}", *pos + 1);
+                for (const auto& [aa, count] : data)
+                    fmt::print("  {}:{}", aa, count);
+                fmt::print("\n");
+            }
         }
 
         return 0;
@@ -1,11 +1,11 @@
 #include <set>
+#include <map>
 
 #include "acmacs-base/argv.hh"
-#include "acmacs-base/counter.hh"
 #include "acmacs-base/string.hh"
 #include "acmacs-base/string-split.hh"
-#include "acmacs-base/date.hh"
 #include "seqdb-3/seqdb.hh"
+#include "seqdb-3/aggregate.hh"
 
 // ----------------------------------------------------------------------
 
@@ -23,6 +23,8 @@ struct Options : public argv
     option<str>       end_date{*this, "end-date"};
     option<str>       clades{*this, "clades", desc{"comma separated list"}};
 
+    option<str>       format{*this, "format", dflt{"table"}, desc{"table, json, csv"}};
+
 };
 
 int main(int argc, char* const argv[])
@@ -30,47 +32,56 @@ int main(int argc, char* const argv[])
     try {
         Options opt(argc, argv);
 
-        const auto date_within = [&opt](std::string_view date) {
-            return !date.empty() && (opt.start_date.empty() || date >= *opt.start_date) && (opt.end_date.empty() || date < *opt.end_date);
-        };
-
         acmacs::seqdb::setup(opt.db);
         const auto& seqdb = acmacs::seqdb::get();
 
-        auto ss = seqdb.all()
-                .subtype(opt.subtype)
-                .lineage(opt.lineage)
-                .host("HUMAN");
+        const auto selected = seqdb.all()
+                .subtype(seqdb, opt.subtype)
+                .lineage(seqdb, opt.lineage)
+                .host("HUMAN")
+                .dates(*opt.start_date, *opt.end_date);
+        const auto table = selected.aggregate(seqdb, "continent,season,clade");
 
+        if (*opt.format == "json") {
+            fmt::print("{}", table.json());
+            return 0;
+        }
+        if (*opt.format == "csv") {
+            fmt::print("{}", table.csv());
+            return 0;
+        }
 
         using data_key = std::pair<std::string, std::string>;
-        std::map<data_key, acmacs::Counter<std::string>> data; // {continent, season} -> clade -> count
+        std::map<data_key, std::map<std::string, size_t>> data; // {continent, season} -> clade -> count
         std::set<std::string> all_clades;
         std::set<std::string> continents{"all"};
 
-        for (const auto& ref : ss) {
-            if (const auto date = date::from_string(ref.entry->date(), date::allow_incomplete::yes, date::throw_on_error::no); date::month_ok(date) && date_within(ref.entry->date()) && !ref.entry->continent.empty()) {
-                std::string season;
-                if (const auto month = date::get_month(date); month >= 4 && month < 10)
-                    season = fmt::format("{}-04", date::get_year(date));
-                else if (month >= 10)
-                    season = fmt::format("{}-10", date::get_year(date));
-                else
-                    season = fmt::format("{}-10", date::get_year(date) - 1);
-                const std::string continent{ref.entry->continent};
-                continents.insert(continent);
-                for (const auto& clade : ref.seq_with_sequence(seqdb).clades) {
-                    all_clades.insert(std::string{clade});
-                    data[data_key{continent, season}].count(clade);
-                    data[data_key{"all", season}].count(clade);
-                }
-            }
+        // continents of sequences having season, including sequences without clades
+        for (const auto& row : selected.aggregate(seqdb, "continent,season").rows)
+            continents.insert(row.values[0]);
+        for (const auto& row : table.rows) {
+            const auto& continent = row.values[0];
+            const auto& season = row.values[1];
+            const auto& clade = row.values[2];
+            all_clades.insert(clade);
+            data[data_key{continent, season}][clade] += row.count;
+            data[data_key{"all", season}][clade] += row.count;
         }
+        const auto count_of = [](const auto& counter, std::string_view clade) -> size_t {
+            if (const auto found = counter.find(std::string{clade}); found != std::end(counter))
+                return found->second;
+            return 0;
+        };
 
         fmt::print("Clades: {}\nContinents: {}\n", all_clades, continents);
         if (opt.clades.empty()) {
             for (const auto& [key, counter] : data) {
-                fmt::print("{} {} {}\n", key.first, key.second, counter.report_sorted_max_first("  {first}: {second}"));
+                std::vector<std::pair<std::string, size_t>> sorted(std::begin(counter), std::end(counter));
+                std::stable_sort(std::begin(sorted), std::end(sorted), [](const auto& e1, const auto& e2) { return e1.second > e2.second; });
+                fmt::print("{} {} ", key.first, key.second);
+                for (const auto& [clade, count] : sorted)
+                    fmt::print("  {}: {}", clade, count);
+                fmt::print("\n");
             }
         }
         else {
@@ -88,13 +99,13 @@ int main(int argc, char* const argv[])
                         fmt::print("{}  ", key.second);
                         size_t sum{0};
                         for (const auto& clade : clades) {
-                            const auto val = counter[std::string{clade}];
+                            const auto val = count_of(counter, clade);
                             fmt::print("  {:7d}    ", val);
                             sum += val;
                         }
                         fmt::print("      ");
                         for (const auto& clade : clades) {
-                            if (const auto val = counter[std::string{clade}]; val > 0)
+                            if (const auto val = count_of(counter, clade); val > 0)
                                 fmt::print("  {:5.1f}%    ", static_cast<double>(val) / static_cast<double>(sum) * 100.0);
                             else
                                 fmt::print("            ");
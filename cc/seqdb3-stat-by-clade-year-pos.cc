@@ -1,10 +1,11 @@
 #include <set>
+#include <algorithm>
 
 #include "acmacs-base/argv.hh"
-#include "acmacs-base/counter.hh"
 #include "acmacs-base/string.hh"
 // #include "acmacs-base/date.hh"
 #include "seqdb-3/seqdb.hh"
+#include "seqdb-3/aggregate.hh"
 
 // ----------------------------------------------------------------------
 
@@ -14,6 +15,8 @@ struct Options : public argv
     Options(int a_argc, const char* const a_argv[], on_error on_err = on_error::exit) : argv() { parse(a_argc, a_argv, on_err); }
 
     option<str> db{*this, "db"};
+    option<size_t> pos{*this, "pos", dflt{142ul}, desc{"aa position to count"}};
+    option<str> format{*this, "format", dflt{"table"}, desc{"table, json, csv"}};
 
     // option<str>       subtype{*this, "flu", desc{"B, A(H1N1), H1, A(H3N2), H3"}};
     // option<str>       lineage{*this, "lineage"};
@@ -34,26 +37,30 @@ int main(int argc, char* const argv[])
         using namespace std::string_view_literals;
         using pp  = std::pair<std::string_view, std::string_view>;
 
-        std::map<std::string_view, std::map<std::string_view, acmacs::CounterChar>> table; // clade -> year -> aa -> count
-        std::set<char> all_aa;
         const std::array years{pp{"2016"sv, "2017"sv}, pp{"2017"sv, "2018"sv}, pp{"2018"sv, "2019"sv}, pp{"2019"sv, "2020"sv}, pp{"2020"sv, "2021"sv}};
         const std::array clades{"3C.2A"sv, "3C.2A1"sv, "3C.2A1A"sv, "3C.2A1B"sv, "3C.2A2"sv, "3C.2A3"sv, "3C.2A4"sv, "3C.3A"sv};
 
-        for (const auto& [start, end] : years) {
-            for (const auto clade : clades) {
-                auto ss = seqdb.all()
-                        .subtype("H3")
-                        .host("HUMAN")
-                        .dates(start, end)
-                        .clade(seqdb, clade)
-                        ;
-                for (const auto& ref : ss) {
-                    const auto aa = ref.aa_at_pos(seqdb, acmacs::seqdb::pos1_t{142});
-                    table[clade][start].count(aa);
-                    all_aa.insert(aa);
-                }
-            }
+        const auto table = seqdb.all()
+                .subtype(seqdb, "H3")
+                .host("HUMAN")
+                .dates(years.front().first, years.back().second)
+                .aggregate(seqdb, fmt::format("clade,year,aa{}", *opt.pos));
+
+        if (*opt.format == "json") {
+            fmt::print("{}", table.json());
+            return 0;
+        }
+        if (*opt.format == "csv") {
+            fmt::print("{}", table.csv());
+            return 0;
+        }
+
+        std::set<char> all_aa;
+        for (const auto& row : table.rows) {
+            if (std::find(std::begin(clades), std::end(clades), row.values[0]) != std::end(clades))
+                all_aa.insert(row.values[2].front());
         }
+        const auto count = [&table](std::string_view clade, std::string_view year, char aa) { return table.count({clade, year, std::string_view{&aa, 1}}); };
 
         fmt::print("{}\n\n", all_aa);
 
@@ -83,8 +90,8 @@ int main(int argc, char* const argv[])
             fmt::print("{:{}s}", ::string::lower(clade.substr(3)), clade_width);
             for (const auto& [start, end] : years) {
                 for (const auto aa : all_aa) {
-                    if (const auto count{table[clade][start][aa]}; count > 0)
-                        fmt::print("{:{}s}{:{}d}{:{}s}", "", aa_sep_width, table[clade][start][aa], aa_width, "", aa_sep_width);
+                    if (const auto num{count(clade, start, aa)}; num > 0)
+                        fmt::print("{:{}s}{:{}d}{:{}s}", "", aa_sep_width, num, aa_width, "", aa_sep_width);
                     else
                         fmt::print("{:{}s}{:{}s}{:{}s}", "", aa_sep_width, "", aa_width, "", aa_sep_width);
                 }
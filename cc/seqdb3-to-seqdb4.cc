@@ -0,0 +1,39 @@
+#include "acmacs-base/argv.hh"
+#include "acmacs-base/filesystem.hh"
+#include "seqdb-3/seqdb.hh"
+#include "seqdb-3/create.hh"
+
+// ----------------------------------------------------------------------
+
+using namespace acmacs::argv;
+struct Options : public argv
+{
+    Options(int a_argc, const char* const a_argv[], on_error on_err = on_error::exit) : argv() { parse(a_argc, a_argv, on_err); }
+
+    option<str> db{*this, "db", desc{"seqdb-3 file to convert"}};
+
+    argument<str> output_dir{*this, arg_name{"output-dir"}, mandatory};
+};
+
+int main(int argc, char* const argv[])
+{
+    try {
+        Options opt(argc, argv);
+        acmacs::seqdb::setup(opt.db);
+        const auto& seqdb = acmacs::seqdb::get();
+        if (seqdb.empty())
+            throw std::runtime_error{"seqdb not loaded"};
+        fs::create_directories(*opt.output_dir);
+        acmacs::seqdb::create_seqdb4(*opt.output_dir, seqdb);
+        return 0;
+    }
+    catch (std::exception& err) {
+        fmt::print(stderr, "ERROR: {}\n", err);
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
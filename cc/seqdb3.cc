@@ -3,6 +3,7 @@
 #include "acmacs-base/date.hh"
 #include "acmacs-base/string-split.hh"
 #include "acmacs-base/read-file.hh"
+#include "acmacs-base/filesystem.hh"
 #include "acmacs-base/range-v3.hh"
 #include "acmacs-base/coredump.hh"
 #include "acmacs-whocc-data/labs.hh"
@@ -16,13 +17,14 @@ struct Options : public argv
 {
     Options(int a_argc, const char* const a_argv[], on_error on_err = on_error::exit) : argv() { parse(a_argc, a_argv, on_err); }
 
-    option<str> db{*this, "db"};
+    option<str> db{*this, "db", desc{"seqdb-3 file or seqdb-4 directory"}};
 
     // select
     option<str_array> seq_id{*this, "seq-id", desc{"initially filter by seq-id, all matching"}};
     option<str>       seq_id_from{*this, "seq-id-from", desc{"read list of seq ids from a file (one per line) and initially select them all"}};
     option<str_array> name{*this, 'n', "name", desc{"initially filter by name (name only, full string equality, multiple -n possible)"}};
     option<str>       names_from{*this, "names-from", desc{"read names from a file (one per line)\n                                       and initially select them all (name only, full string equality)"}};
+    option<str_array> accession_number{*this, "accession-number", desc{"initially filter by accession number (gisaid and/or ncbi), multiple possible"}};
     option<str>       accession_numbers_from{*this, "accession-numbers-from", desc{"read accession numbers (gisaid and/or ncbi) names from a file (one per line)\n                                       and initially select them all (full string equality)"}};
     option<str>       subtype{*this, "flu", desc{"B, A(H1N1), H1, A(H3N2), H3"}};
     option<str>       host{*this, "host"};
@@ -89,10 +91,15 @@ struct Options : public argv
     option<bool>      not_aligned{*this, "not-aligned", desc{"do not align for exporting"}};
     option<bool>      most_common_length{*this, "most-common-length", desc{"truncate or extend with - all sequences to make them all of the same length,\n                                       most common among original sequences"}};
     option<size_t>    length{*this, "length", dflt{0ul}, desc{"truncate or extend with - all sequences to make them all of the same length,\n                                       0 - do not truncate/extend"}};
+    option<size_t>    threads{*this, 'j', "threads", dflt{0ul}, desc{"number of threads formatting and compressing (.xz) fasta and json export, 0 - number of cores, output does not depend on it"}};
 
     option<str_array> verbose{*this, 'v', "verbose", desc{"comma separated list (or multiple switches) of enablers"}};
 };
 
+static acmacs::seqdb::subset select_by_accession_number(const acmacs::seqdb::Seqdb& seqdb, const std::vector<std::string_view>& accession_numbers);
+
+// ----------------------------------------------------------------------
+
 int main(int argc, char* const argv[])
 {
     // acmacs::enable_coredump();
@@ -103,7 +110,10 @@ int main(int argc, char* const argv[])
         Options opt(argc, argv);
         acmacs::log::enable(opt.verbose);
 
-        acmacs::seqdb::setup(opt.db);
+        if (!opt.db->empty() && fs::is_directory(*opt.db)) // seqdb-4, load just the shard of the requested subtype
+            acmacs::seqdb::setup_seqdb4(opt.db, opt.subtype->empty() ? std::vector<std::string>{} : std::vector<std::string>{std::string{*opt.subtype}});
+        else
+            acmacs::seqdb::setup(opt.db);
         const auto& seqdb = acmacs::seqdb::get();
 
         const auto init = [&] {
@@ -115,8 +125,10 @@ int main(int argc, char* const argv[])
                 return seqdb.select_by_name(*opt.name);
             else if (opt.names_from)
                 return seqdb.select_by_name(acmacs::string::split(static_cast<std::string>(acmacs::file::read(opt.names_from)), "\n", acmacs::string::Split::StripRemoveEmpty));
+            else if (!opt.accession_number->empty())
+                return select_by_accession_number(seqdb, *opt.accession_number);
             else if (opt.accession_numbers_from)
-                return seqdb.select_by_accession_number(acmacs::string::split(static_cast<std::string>(acmacs::file::read(opt.accession_numbers_from)), "\n", acmacs::string::Split::StripRemoveEmpty));
+                return select_by_accession_number(seqdb, acmacs::string::split(static_cast<std::string>(acmacs::file::read(opt.accession_numbers_from)), "\n", acmacs::string::Split::StripRemoveEmpty));
             else
                 return seqdb.all();
         };
@@ -174,14 +186,14 @@ int main(int argc, char* const argv[])
 
         init()
             .remove_nuc_duplicates(opt.remove_nuc_duplicates, opt.keep_all_hi_matched)
-            .subtype(acmacs::uppercase{*opt.subtype})
-            .lineage(acmacs::uppercase{*opt.lineage})
-            .lab(acmacs::whocc::lab_name_normalize(*opt.lab))
-            .whocc_lab(opt.whocc_lab)
+            .subtype(seqdb, acmacs::uppercase{*opt.subtype})
+            .lineage(seqdb, acmacs::uppercase{*opt.lineage})
+            .lab(seqdb, acmacs::whocc::lab_name_normalize(*opt.lab))
+            .whocc_lab(seqdb, opt.whocc_lab)
             .host(acmacs::uppercase{*opt.host})
             .dates(fix_date(opt.start_date), fix_date(opt.end_date))
-            .continent(acmacs::uppercase{*opt.continent})
-            .country(fix_country(acmacs::uppercase{*opt.country}))
+            .continent(seqdb, acmacs::uppercase{*opt.continent})
+            .country(seqdb, fix_country(acmacs::uppercase{*opt.country}))
             .with_issues(seqdb, opt.with_issues)
             .clade(seqdb, acmacs::uppercase{*opt.clade})
             .aa_at_pos(seqdb, aa_at_pos)
@@ -219,6 +231,7 @@ int main(int argc, char* const argv[])
                                   .most_common_length(opt.most_common_length ? acmacs::seqdb::export_options::most_common_length::yes : acmacs::seqdb::export_options::most_common_length::no)
                                   .length(opt.length)
                                   .name_format(opt.name_format)
+                                  .threads(opt.threads)
                                   .deletion_report_threshold(acmacs::uppercase{*opt.subtype})) // acmacs::seqdb::v3::subset::make_name
             .export_json_sequences(opt.json, seqdb,
                               acmacs::seqdb::export_options{}
@@ -227,7 +240,7 @@ int main(int argc, char* const argv[])
                                   .most_common_length(opt.most_common_length ? acmacs::seqdb::export_options::most_common_length::yes : acmacs::seqdb::export_options::most_common_length::no)
                                   .length(opt.length)
                                   .name_format(opt.name_format)
-                                  )
+                                  .threads(opt.threads))
             .print(seqdb, opt.name_format, print_header, opt.print /* || opt.fasta */)                       // acmacs::seqdb::v3::subset::make_name
             .report_hamming_distance(opt.report_hamming_distance && !opt.base_seq_id->empty());
 
@@ -239,6 +252,19 @@ int main(int argc, char* const argv[])
     }
 }
 
+// ----------------------------------------------------------------------
+
+acmacs::seqdb::subset select_by_accession_number(const acmacs::seqdb::Seqdb& seqdb, const std::vector<std::string_view>& accession_numbers)
+{
+    const auto found = seqdb.find_by_accession_numbers(accession_numbers);
+    for (size_t no = 0; no < accession_numbers.size(); ++no) {
+        if (found[no].empty())
+            AD_WARNING("accession number not found in seqdb: {}", accession_numbers[no]);
+    }
+    return seqdb.select_by_accession_number(accession_numbers);
+
+} // select_by_accession_number
+
 // ----------------------------------------------------------------------
 /// Local Variables:
 /// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
@@ -13,8 +13,25 @@ int main(int argc, char* const argv[])
         return 1;
     }
 
-    const auto res = acmacs::seqdb::scan::deletions_insertions(argv[1], argv[2], acmacs::debug::yes);
-    fmt::print("{}\n{}\n", acmacs::seqdb::scan::format_aa(res.insertions, argv[1], '.'), acmacs::seqdb::scan::format_aa(res.deletions, argv[2], '.'));
+    const auto report = [&](std::string_view title, auto&& func) -> std::optional<acmacs::seqdb::scan::deletions_insertions_t> {
+        try {
+            const auto res = func(argv[1], argv[2], acmacs::debug::yes);
+            fmt::print("{}:{}\n{}\n{}\n\n", title, res, acmacs::seqdb::scan::format_aa(res.insertions, argv[1], '.'), acmacs::seqdb::scan::format_aa(res.deletions, argv[2], '.'));
+            return res;
+        }
+        catch (std::exception& err) {
+            fmt::print("{}: {}\n", title, err.what());
+            return std::nullopt;
+        }
+    };
+
+    const auto heuristic = report("heuristic", [](auto&&... args) { return acmacs::seqdb::scan::deletions_insertions(args...); });
+    const auto banded = report("banded", [](auto&&... args) { return acmacs::seqdb::scan::deletions_insertions_banded(args...); });
+    if (heuristic.has_value() != banded.has_value() || (heuristic.has_value() && fmt::format("{}", *heuristic) != fmt::format("{}", *banded))) {
+        fmt::print("heuristic and banded results differ\n");
+        return 2;
+    }
+    return 0;
 }
 
 // ----------------------------------------------------------------------
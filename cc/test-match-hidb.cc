@@ -0,0 +1,127 @@
+// Checks hidb matching of seqdb3-scan against hidb:
+//  - for every antigen name in the B, H1, H3 hidb the name index used by match_hidb finds the same antigens as hidb::Antigens::find
+//  - hi_names assigned by match_hidb using the name index are the same as assigned using hidb::Antigens::find (previous implementation)
+//  - hi_names assigned by match_hidb running in parallel are the same as assigned by match_hidb running in one thread
+// Sequences to match are made of every n-th antigen of hidb (n is the argument, default 10): two sequences with the antigen name,
+// one with the antigen passage and reassortant and one with the passage of the next antigen, plus sequences with the antigen name
+// written differently (lower case, doubled space, subtype without H and N) which hidb::Antigens::find may still find.
+
+#include <string>
+#include <vector>
+#include <cctype>
+#include <algorithm>
+
+#include "acmacs-base/omp.hh"
+#include "hidb-5/hidb.hh"
+#include "seqdb-3/scan-fasta.hh"
+#include "seqdb-3/scan-match-hidb.hh"
+
+// ----------------------------------------------------------------------
+
+// previous match_hidb name lookup, reference for the name index
+static hidb::AntigenIndexList find_by_name_in_hidb(const hidb::Antigens& antigens, std::string_view name)
+{
+    return antigens.find(std::string{name}, hidb::fix_location::no, hidb::find_fuzzy::no);
+}
+
+// the antigen name written differently
+static std::vector<std::string> name_variants(std::string_view name)
+{
+    std::vector<std::string> variants;
+    auto& lower = variants.emplace_back(name);
+    std::transform(std::begin(lower), std::end(lower), std::begin(lower), [](char cc) { return static_cast<char>(std::tolower(static_cast<unsigned char>(cc))); });
+    if (const auto space = name.find(' '); space != std::string_view::npos)
+        variants.push_back(fmt::format("{}  {}", name.substr(0, space), name.substr(space + 1)));
+    if (name.substr(0, 2) == "A(") {
+        if (const auto slash = name.find('/'); slash != std::string_view::npos)
+            variants.push_back(fmt::format("A{}", name.substr(slash)));
+    }
+    return variants;
+}
+
+// ----------------------------------------------------------------------
+
+int main(int argc, char* const argv[])
+{
+    if (argc > 2) {
+        fmt::print(stderr, "Usage {} [<use-every-nth-antigen>]\n", argv[0]);
+        return 1;
+    }
+    const size_t step = argc == 2 ? std::stoul(argv[1]) : 10;
+
+    try {
+        size_t differ{0};
+
+        for (const std::string_view subtype : {"B", "H1", "H3"}) {
+            for (const auto& name : acmacs::seqdb::scan::hidb_name_index_differences(subtype)) {
+                fmt::print("name index differs from hidb find: {}\n", name);
+                ++differ;
+            }
+        }
+
+        std::vector<acmacs::seqdb::scan::fasta::scan_result_t> sequences;
+        for (const auto& [subtype, type_subtype] : {std::pair{"B", "B"}, std::pair{"H1", "A(H1N1)"}, std::pair{"H3", "A(H3N2)"}}) {
+            const auto antigens = hidb::get(acmacs::virus::type_subtype_t{subtype}, report_time::no).antigens();
+            for (size_t antigen_no = 0; (antigen_no + 1) < antigens->size(); antigen_no += step) {
+                const auto antigen = antigens->at(hidb::AntigenIndex{antigen_no});
+                const auto next_antigen = antigens->at(hidb::AntigenIndex{antigen_no + 1});
+                const acmacs::virus::name_t name{fmt::format("{}", antigen->name())};
+                const auto add = [&sequences, type_subtype, &antigen](const acmacs::virus::name_t& seq_name, const acmacs::virus::Passage& passage) {
+                    auto& entry = sequences.emplace_back();
+                    entry.sequence.name(seq_name);
+                    entry.sequence.set_shift(0, acmacs::virus::type_subtype_t{type_subtype});
+                    entry.sequence.reassortant(antigen->reassortant());
+                    entry.sequence.add_passage(passage);
+                };
+                for (const auto& passage : {antigen->passage(), next_antigen->passage()})
+                    add(name, acmacs::virus::Passage{passage});
+                for (const auto& variant : name_variants(*name))
+                    add(acmacs::virus::name_t{variant}, acmacs::virus::Passage{antigen->passage()});
+            }
+        }
+
+        auto sequences_serial = sequences, sequences_reference = sequences;
+        const auto max_threads = omp_get_max_threads();
+        omp_set_num_threads(1);
+        acmacs::seqdb::scan::match_hidb(sequences_reference, &find_by_name_in_hidb);
+        acmacs::seqdb::scan::match_hidb(sequences_serial);
+        omp_set_num_threads(max_threads);
+        acmacs::seqdb::scan::match_hidb(sequences);
+
+        const auto hi_names_of = [](const auto& entry) {
+            const auto& hi_names = entry.sequence.hi_names();
+            return std::vector<std::string>(hi_names.begin(), hi_names.end());
+        };
+
+        size_t matched{0};
+        for (size_t seq_no = 0; seq_no < sequences.size(); ++seq_no) {
+            const auto parallel = hi_names_of(sequences[seq_no]), serial = hi_names_of(sequences_serial[seq_no]), reference = hi_names_of(sequences_reference[seq_no]);
+            if (serial != reference) {
+                fmt::print("hi_names differ from hidb find: {}\n  name index: {}\n  hidb find:  {}\n", sequences_reference[seq_no].sequence.full_name(), serial, reference);
+                ++differ;
+            }
+            if (parallel != serial) {
+                fmt::print("hi_names differ: {}\n  parallel: {}\n  serial:   {}\n", sequences[seq_no].sequence.full_name(), parallel, serial);
+                ++differ;
+            }
+            else if (!parallel.empty())
+                ++matched;
+        }
+
+        fmt::print("sequences: {}  matched: {}  differ: {}  threads: {}\n", sequences.size(), matched, differ, max_threads);
+        if (matched == 0) {
+            fmt::print("nothing matched\n");
+            return 2;
+        }
+        return differ == 0 ? 0 : 2;
+    }
+    catch (std::exception& err) {
+        fmt::print(stderr, "ERROR: {}\n", err.what());
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
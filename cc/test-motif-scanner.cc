@@ -0,0 +1,296 @@
+// Compares initial alignment by motifs (acmacs::seqdb::scan::align_by_motifs, Aho-Corasick scanner)
+// with the sequential search of every motif within its window used before the scanner.
+// Input: file with one amino acid sequence per line, empty lines and lines starting with # are ignored.
+
+#include <optional>
+#include <tuple>
+
+#include "acmacs-base/fmt.hh"
+#include "acmacs-base/read-file.hh"
+#include "acmacs-base/string-split.hh"
+#include "seqdb-3/scan-align.hh"
+
+// ----------------------------------------------------------------------
+
+namespace local
+{
+    inline bool has_infix(std::string_view source, size_t pos, std::string_view match)
+    {
+        return source.substr(pos, match.size()) == match;
+    }
+
+    inline std::string::size_type find_in_sequence(std::string_view sequence, size_t limit, std::initializer_list<const char*> look_for)
+    {
+        const auto source = sequence.substr(0, limit);
+        for (const char* str : look_for) {
+            if (const auto pos = source.find(str); pos != std::string::npos)
+                return pos;
+        }
+        return std::string::npos;
+    }
+
+    static std::optional<std::tuple<int, const char*>> align_sequential(std::string_view amino_acids)
+    {
+        // --------------------------------------------------
+        // first stage
+
+        // H3
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MKTII"});
+            pos != std::string::npos &&
+            (amino_acids[pos + 16] == 'Q' || amino_acids[pos + 15] == 'A')) // amino_acids.substr(pos + 15, 2) != "DR") { // DR[ISV]C - start of the B sequence (signal peptide is 15 aas!)
+            return std::tuple{static_cast<int>(pos) + 16, "A(H3)"};
+
+        // H1
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MKV", "MKA", "MEA", "MEV"});
+            pos != std::string::npos && (has_infix(amino_acids, pos + 17, "DTLC") || has_infix(amino_acids, pos + 17, "DTIC")))
+            return std::tuple{static_cast<int>(pos) + 17, "A(H1)"};
+
+        // B
+        {
+            // Only B has CTDL at first 100 AAs
+            if (const auto pos = find_in_sequence(amino_acids, 100, {"CTDL"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 59, "B"};
+            // Only B has NSPHVV at first 100 AAs
+            if (const auto pos = find_in_sequence(amino_acids, 100, {"NSPHVV"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 10, "B"};
+            // B specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"EHIRL"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 114, "B"};
+            // Only B (YAMAGATA?) has CPNATS in whole AA sequence
+            if (const auto pos = find_in_sequence(amino_acids, 250, {"CPNATS"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 142, "B"};
+            if (const auto pos = find_in_sequence(amino_acids, 250, {"PNATSK"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 143, "B"};
+            // B specific (VICTORIA?)
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"NVTNG"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 144, "B"};
+        }
+
+        // H2
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MTIT", "MAII"}); pos != std::string::npos && has_infix(amino_acids, pos + 14, "GDQIC"))
+            return std::tuple{static_cast<int>(pos) + 15, "A(H2)"};
+
+        // H4
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MLS"}); pos != std::string::npos && (amino_acids[pos + 16] == 'Q' || has_infix(amino_acids, pos + 16, "SQNY")))
+            return std::tuple{static_cast<int>(pos) + 16, "A(H4)"};
+
+        // H5
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MEKIV", "MERIV"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos) + 16, "A(H5)"};
+
+        // H6
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MIAIIV", "MIAIII"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos) + 16, "A(H6)"};
+
+        // H7
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MNIQ", "MNNQ", "MNTQ"});
+            pos != std::string::npos && amino_acids[pos + 17] != 'S' && has_infix(amino_acids, pos + 18, "DKIC")) // SDKIC is H15 most probably
+            return std::tuple{static_cast<int>(pos) + 18, "A(H7)"};
+
+        // H8
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MEKFIA"}); pos != std::string::npos && amino_acids[pos + 17] == 'D')
+            return std::tuple{static_cast<int>(pos) + 17, "A(H8)"};
+
+        // H9
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"METIS", "MEIIS", "MEV"}); pos != std::string::npos && has_infix(amino_acids, pos + 17, "ADKIC"))
+            return std::tuple{static_cast<int>(pos) + 18, "A(H9)"};
+
+        // H10
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MYK"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos) + 17, "A(H10)"};
+
+        // H11
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MK"}); pos != std::string::npos && has_infix(amino_acids, pos + 16, "DEIC"))
+            return std::tuple{static_cast<int>(pos) + 16, "A(H11)"};
+
+        // H12
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MEK"}); pos != std::string::npos && has_infix(amino_acids, pos + 15, "AYDKIC"))
+            return std::tuple{static_cast<int>(pos) + 17, "A(H12)"};
+
+        // H13
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MDI", "MAL", "MEV"}); pos != std::string::npos && has_infix(amino_acids, pos + 17, "ADRIC"))
+            return std::tuple{static_cast<int>(pos) + 18, "A(H13)"};
+
+        // H14
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MIA"}); pos != std::string::npos && has_infix(amino_acids, pos + 14, "AYSQITN"))
+            return std::tuple{static_cast<int>(pos) + 17, "A(H14)"};
+
+        // H15 - second stage only
+
+        // H16
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MMVK", "MMIK"}); pos != std::string::npos && has_infix(amino_acids, pos + 19, "DKIC"))
+            return std::tuple{static_cast<int>(pos) + 19, "A(H16)"};
+
+        // H17
+        if (const auto pos = find_in_sequence(amino_acids, 20, {"MEL"}); pos != std::string::npos && has_infix(amino_acids, pos + 17, "GDRICI"))
+            return std::tuple{static_cast<int>(pos) + 18, "A(H17)"};
+
+        // --------------------------------------------------
+        // second stage
+
+        // H4
+        if (const auto pos = find_in_sequence(amino_acids, 100, {"QNYT"}); pos != std::string::npos && has_infix(amino_acids, pos + 11, "GHHA"))
+            return std::tuple{static_cast<int>(pos), "A(H4)"};
+
+        // H11 (DEICIGYL is specific)
+        if (const auto pos = find_in_sequence(amino_acids, 50, {"DEICIGYL"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos), "A(H11)"};
+
+        // H15
+        if (const auto pos = find_in_sequence(amino_acids, 100, {"KSDKICLGHHA"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos) + 2, "A(H15)"};
+
+        // --------------------------------------------------
+        // third stage
+
+        // H3
+        {
+            // Only H3 (and H0N0) has CTLID in the whole AA sequence
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"CTLID", "CTLMDALL", "CTLVD"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 63, "A(H3)"};
+            // Only H3 (and H0N0) has PNGTIVKTI in the whole AA sequence
+            if (const auto pos = find_in_sequence(amino_acids, 100, {"PNGTIVKTI"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 20, "A(H3)"};
+            // Only H3 (and H0N0) has DKLYIWG in the whole AA sequence
+            if (const auto pos = find_in_sequence(amino_acids, 200, {"DKLYIWG"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 174, "A(H3)"};
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"SNCYPYDV"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 94, "A(H3)"};
+        }
+
+        // H1
+        {
+            // VLEKN is H1 specific (whole AA sequence)
+            if (const auto pos = find_in_sequence(amino_acids, 50, {"VLEKN"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 18, "A(H1)"};
+            // SSWSYI and ESWSYI are H1 specific (whole AA sequence)
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"SSWSYI", "ESWSYI"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 73, "A(H1)"};
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"FERFEI"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 110, "A(H1)"};
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 200, {"IWLVKKG"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 148, "A(H1)"};
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 200, {"SSVSSF"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 105, "A(H1)"};
+        }
+
+        // H5
+        {
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 100, {"GVKPLIL", "GVRPLIL"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 45, "A(H5)"};
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 100, {"GWLLGNPMCDE"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 58, "A(H5)"};
+            // specific at first 150
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"NHFE"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 108, "A(H5)"};
+        }
+
+        // H6
+        {
+            // QKEER is H6 specific
+            if (const auto pos = find_in_sequence(amino_acids, 100, {"QKEER"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 35, "A(H6)"};
+            // EELKA is H6 specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"EELKA"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 98, "A(H6)"};
+        }
+
+        // H7
+        {
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 100, {"GQCGL"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 51, "A(H7)"};
+        }
+
+        // H8
+        {
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 200, {"FYRSINWL"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 141, "A(H8)"};
+        }
+
+        // H9
+        {
+            // QSTN is H9 specific
+            if (const auto pos = find_in_sequence(amino_acids, 50, {"QSTN"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 7, "A(H9)"};
+            // CDLLLGG, CDLLLEG are H9 specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"CDLLLGG", "CDLLLEG"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 66, "A(H9)"};
+            // LEELRS is H9 specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"LEELRS"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 97, "A(H9)"};
+            // SARSYQ is H9 specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"SARSYQ"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 106, "A(H9)"};
+            // SSYQRIQ is H9 specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"SSYQRIQ"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 108, "A(H9)"};
+        }
+
+        // H10
+        {
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 50, {"NGTIVKTLTNE"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 11, "A(H10)"};
+            // specific
+            if (const auto pos = find_in_sequence(amino_acids, 150, {"QKIMESG"}); pos != std::string::npos)
+                return std::tuple{static_cast<int>(pos) - 99, "A(H10)"};
+        }
+
+        // H11 (SSVEL is specific)
+        if (const auto pos = find_in_sequence(amino_acids, 100, {"SSVEL"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos) - 27, "A(H11)"};
+
+        // H13 (specific)
+        if (const auto pos = find_in_sequence(amino_acids, 50, {"VGYLSTN"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos) - 4, "A(H13)"};
+
+        // H16 (specific)
+        if (const auto pos = find_in_sequence(amino_acids, 70, {"DTLTENGVP", "DTLIENGVP"}); pos != std::string::npos)
+            return std::tuple{static_cast<int>(pos) - 16, "A(H16)"};
+
+        return std::nullopt;
+    }
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+int main(int argc, char* const argv[])
+{
+    if (argc != 2) {
+        fmt::print(stderr, "Usage {} <file-with-aa-sequences>\n", argv[0]);
+        return 1;
+    }
+
+    const auto format = [](const std::optional<std::tuple<int, const char*>>& res) { return res.has_value() ? fmt::format("{} {}", std::get<const char*>(*res), std::get<int>(*res)) : std::string{"not aligned"}; };
+
+    const auto source = static_cast<std::string>(acmacs::file::read(argv[1]));
+    size_t sequences{0}, aligned{0}, differ{0};
+    for (const auto line : acmacs::string::split(source, "\n", acmacs::string::Split::StripRemoveEmpty)) {
+        if (line[0] == '#')
+            continue;
+        ++sequences;
+        const auto by_scanner = acmacs::seqdb::scan::align_by_motifs(line);
+        if (const auto sequential = local::align_sequential(line); format(by_scanner) != format(sequential)) {
+            fmt::print("scanner: {}  sequential: {}\n  {}\n", format(by_scanner), format(sequential), line);
+            ++differ;
+        }
+        else if (by_scanner.has_value())
+            ++aligned;
+    }
+    fmt::print("sequences: {}  aligned: {}  differ: {}\n", sequences, aligned, differ);
+    return differ == 0 ? 0 : 2;
+}
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End:
@@ -0,0 +1,86 @@
+// Checks that Seqdb::match finds the same sequences for antigens and sera of a chart
+//  - running in one thread and running in parallel
+//  - with and without match_cache_t (second run with the cache takes results from it)
+
+#include <string>
+#include <vector>
+
+#include "acmacs-base/omp.hh"
+#include "acmacs-chart-2/factory-import.hh"
+#include "acmacs-chart-2/chart.hh"
+#include "seqdb-3/seqdb.hh"
+
+// ----------------------------------------------------------------------
+
+namespace local
+{
+    inline std::vector<std::string> seq_ids(const acmacs::seqdb::subset& matched)
+    {
+        std::vector<std::string> result;
+        for (const auto& ref : matched)
+            result.push_back(ref.empty() ? std::string{} : fmt::format("{}", ref.seq_id()));
+        return result;
+    }
+
+    template <typename AgSr> size_t compare(const acmacs::seqdb::Seqdb& seqdb, const AgSr& antigens_sera, std::string_view ag_sr, size_t& matched)
+    {
+        const auto max_threads = omp_get_max_threads();
+        omp_set_num_threads(1);
+        const auto serial = seq_ids(seqdb.match(antigens_sera));
+        omp_set_num_threads(max_threads);
+        const auto parallel = seq_ids(seqdb.match(antigens_sera));
+        acmacs::seqdb::match_cache_t cache;
+        const auto cache_filled = seq_ids(seqdb.match(antigens_sera, {}, &cache));
+        const auto from_cache = seq_ids(seqdb.match(antigens_sera, {}, &cache));
+
+        size_t differ{0};
+        for (size_t no = 0; no < serial.size(); ++no) {
+            if (parallel[no] != serial[no] || cache_filled[no] != serial[no] || from_cache[no] != serial[no]) {
+                fmt::print("{} {} {} differs\n  serial:     \"{}\"\n  parallel:   \"{}\"\n  with cache: \"{}\"\n  from cache: \"{}\"\n", ag_sr, no, antigens_sera.at(no)->format("{name_full}"), serial[no], parallel[no],
+                           cache_filled[no], from_cache[no]);
+                ++differ;
+            }
+            else if (!serial[no].empty()) {
+                fmt::print("{} {} {} -> {}\n", ag_sr, no, antigens_sera.at(no)->format("{name_full}"), serial[no]);
+                ++matched;
+            }
+        }
+        return differ;
+    }
+
+} // namespace local
+
+// ----------------------------------------------------------------------
+
+int main(int argc, char* const argv[])
+{
+    if (argc != 3) {
+        fmt::print(stderr, "Usage {} <seqdb> <chart>\n", argv[0]);
+        return 1;
+    }
+
+    try {
+        acmacs::seqdb::setup(argv[1]);
+        const auto& seqdb = acmacs::seqdb::get();
+        auto chart = acmacs::chart::import_from_file(argv[2]);
+
+        size_t matched{0};
+        const auto differ = local::compare(seqdb, *chart->antigens(), "AG", matched) + local::compare(seqdb, *chart->sera(), "SR", matched);
+
+        fmt::print("antigens: {}  sera: {}  matched: {}  differ: {}  threads: {}\n", chart->number_of_antigens(), chart->number_of_sera(), matched, differ, omp_get_max_threads());
+        if (matched == 0) {
+            fmt::print("nothing matched\n");
+            return 2;
+        }
+        return differ == 0 ? 0 : 2;
+    }
+    catch (std::exception& err) {
+        fmt::print(stderr, "ERROR: {}\n", err.what());
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------
+/// Local Variables:
+/// eval: (if (fboundp 'eu-rename-buffer) (eu-rename-buffer))
+/// End: